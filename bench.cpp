@@ -0,0 +1,1705 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ptr.h"
+#include "ptr_vector.h"
+#include "ptr_hugepage.h"
+#include "ptr_mmap.h"
+#include "ptr_uninitialized.h"
+#include "ptr_aligned.h"
+#include "ptr_simd.h"
+#include "ptr_parallel.h"
+#include "ptr_shm.h"
+#include "ptr_buffer.h"
+#include "ptr_sharded.h"
+#include "ptr_snapshot.h"
+#include "ptr_lazy.h"
+#include "ptr_pmr.h"
+#include "ptr_nonnull.h"
+#include "ptr_map.h"
+#include "ptr_queue.h"
+#include "ptr_teardown.h"
+#include "ptr_cache.h"
+#include "ptr_pool.h"
+
+//
+// benchmarks - build with optimizations on, e.g.
+//
+//   g++ -std=c++17 -O2 -pthread bench.cpp -o bench
+//
+// run them all with "./bench", or only some with "./bench Relocation ..."
+//
+
+// a simple wall clock stopwatch
+class Stopwatch
+{
+	public:
+		Stopwatch() : m_start(std::chrono::steady_clock::now()) { }
+
+		double Seconds() const
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+};
+
+// keeps the optimizer from throwing away results we never look at
+template <typename T>
+static void Consume(const T& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+// counts every operator new, so benchmarks can report allocations (kept out
+// of line, or the compiler spots free() meeting operator new and complains)
+static std::atomic<size_t> s_allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t bytes)
+{
+	s_allocations.fetch_add(1,std::memory_order_relaxed);
+	void* p = malloc(bytes ? bytes : 1);
+	if ( !p )
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// counts this thread's dTLB load misses, when the kernel lets us
+class DtlbMisses
+{
+	public:
+		DtlbMisses()
+		{
+			perf_event_attr attr;
+			memset(&attr,0,sizeof(attr));
+			attr.type           = PERF_TYPE_HW_CACHE;
+			attr.size           = sizeof(attr);
+			attr.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			attr.disabled       = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv     = 1;
+			m_fd = int(syscall(SYS_perf_event_open,&attr,0,-1,-1,0));
+		}
+
+		~DtlbMisses()
+		{
+			if ( m_fd >= 0 )
+			{
+				close(m_fd);
+			}
+		}
+
+		void Start()
+		{
+			if ( m_fd >= 0 )
+			{
+				ioctl(m_fd,PERF_EVENT_IOC_RESET,0);
+				ioctl(m_fd,PERF_EVENT_IOC_ENABLE,0);
+			}
+		}
+
+		// -1 when unavailable
+		long long Stop()
+		{
+			long long count = -1;
+			if ( m_fd < 0 || ioctl(m_fd,PERF_EVENT_IOC_DISABLE,0) != 0 || read(m_fd,&count,sizeof(count)) != sizeof(count) )
+			{
+				count = -1;
+			}
+			return count;
+		}
+
+	private:
+		int m_fd;
+};
+
+static void PrintMisses(long long misses)
+{
+	if ( misses < 0 )
+	{
+		printf("  dTLB misses: n/a\n");
+	}
+	else
+	{
+		printf("  dTLB misses: %12lld\n",misses);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchRelocation()
+{
+	const size_t kCount = 10000000;
+
+	// one shared object, so every element's counter is the same cache line
+	// and the cost measured is purely grab()/drop() traffic, not allocation
+	ptr<int> shared(new int(42));
+
+	{
+		std::vector< ptr<int> > v;
+		v.reserve(kCount);
+		for (size_t i=0;i<kCount;++i)
+		{
+			v.push_back(shared);
+		}
+
+		Stopwatch sw;
+		v.reserve(kCount*2);
+		printf("  std::vector  10M-element reallocation: %8.2f ms\n",sw.Seconds()*1000.0);
+	}
+
+	{
+		ptr_vector< ptr<int> > v;
+		v.reserve(kCount);
+		for (size_t i=0;i<kCount;++i)
+		{
+			v.push_back(shared);
+		}
+
+		Stopwatch sw;
+		v.reserve(kCount*2);
+		printf("  ptr_vector   10M-element reallocation: %8.2f ms\n",sw.Seconds()*1000.0);
+	}
+
+	{
+		Stopwatch sw;
+		std::vector< ptr<int> > v;
+		for (size_t i=0;i<kCount;++i)
+		{
+			v.push_back(shared);
+		}
+		Consume(v);
+		printf("  std::vector  10M push_back, growing:    %8.2f ms\n",sw.Seconds()*1000.0);
+	}
+
+	{
+		Stopwatch sw;
+		ptr_vector< ptr<int> > v;
+		for (size_t i=0;i<kCount;++i)
+		{
+			v.push_back(shared);
+		}
+		Consume(v);
+		printf("  ptr_vector   10M push_back, growing:    %8.2f ms\n",sw.Seconds()*1000.0);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchHugePageScan()
+{
+	const size_t kCount   = (size_t(1) << 30) / sizeof(float); // 1GB
+	const size_t kLookups = 1 << 24;
+
+	const char*      names[] = { "4KB pages  ", "THP        ", "MAP_HUGETLB" };
+	const huge_pages modes[] = { huge_none, huge_transparent, huge_explicit };
+
+	for (int m=0;m<3;++m)
+	{
+		array_ptr<float> a = make_huge_array<float>(kCount,modes[m]);
+		if ( !a )
+		{
+			printf("  %s allocation failed\n",names[m]);
+			continue;
+		}
+		const float* p = &a[0];
+
+		DtlbMisses counter;
+
+		// sequential scan
+		counter.Start();
+		Stopwatch seq;
+		float sum = 0;
+		for (size_t i=0;i<kCount;++i)
+		{
+			sum += p[i];
+		}
+		Consume(sum);
+		double seconds = seq.Seconds();
+		printf("  %s sequential: %6.2f GB/s",names[m],(kCount*sizeof(float))/seconds/1e9);
+		PrintMisses(counter.Stop());
+
+		// random gather, where the TLB really matters
+		counter.Start();
+		Stopwatch rnd;
+		unsigned x = 12345;
+		for (size_t i=0;i<kLookups;++i)
+		{
+			x = x*1664525u + 1013904223u;
+			sum += p[x % kCount];
+		}
+		Consume(sum);
+		seconds = rnd.Seconds();
+		printf("  %s random:     %6.2f M lookups/s",names[m],kLookups/seconds/1e6);
+		PrintMisses(counter.Stop());
+	}
+}
+
+///////////////////////////////////
+
+static void BenchMappedFile()
+{
+	const size_t kCount = (size_t(512) << 20) / sizeof(double); // 512MB
+
+	char path[] = "/tmp/ptr_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if ( fd < 0 )
+	{
+		printf("  couldn't create a temporary file\n");
+		return;
+	}
+	{
+		std::vector<double> data(kCount,1.0);
+		FILE* f = fdopen(fd,"wb");
+		fwrite(&data[0],sizeof(double),kCount,f);
+		fclose(f);
+	}
+
+	// the old way, read everything into a new[] buffer
+	{
+		Stopwatch sw;
+		FILE* f = fopen(path,"rb");
+		array_ptr<double> a = new double[kCount];
+		size_t got = fread(&a[0],sizeof(double),kCount,f);
+		fclose(f);
+		double ready = sw.Seconds();
+
+		double sum = 0;
+		for (size_t i=0;i<got;++i)
+		{
+			sum += a[i];
+		}
+		Consume(sum);
+		printf("  read into new[]: ready %8.2f ms, ready + scan %8.2f ms\n",ready*1000.0,sw.Seconds()*1000.0);
+	}
+
+	// mapped, nothing happens until we look
+	{
+		Stopwatch sw;
+		array_ptr<const double> a = map_file<double>(path,map_sequential);
+		double ready = sw.Seconds();
+
+		double sum = 0;
+		const double* p = &a[0];
+		for (size_t i=0;i<a.size();++i)
+		{
+			sum += p[i];
+		}
+		Consume(sum);
+		printf("  map_file():      ready %8.2f ms, ready + scan %8.2f ms\n",ready*1000.0,sw.Seconds()*1000.0);
+	}
+
+	unlink(path);
+}
+
+///////////////////////////////////
+
+static void BenchAllocateAndFill()
+{
+	const size_t kCount  = (size_t(256) << 20) / sizeof(double); // 256MB
+	const int    kCycles = 8;
+
+	const char* names[] = { "new double[n]()           ", "make_uninitialized_array()", "make_zeroed_array()       " };
+
+	for (int m=0;m<3;++m)
+	{
+		Stopwatch sw;
+		for (int c=0;c<kCycles;++c)
+		{
+			array_ptr<double> a;
+			switch ( m )
+			{
+				case 0: a = new double[kCount](); break;
+				case 1: a = make_uninitialized_array<double>(kCount); break;
+				case 2: a = make_zeroed_array<double>(kCount); break;
+			}
+
+			// stands in for the read() that would fill it
+			double* p = &a[0];
+			for (size_t i=0;i<kCount;++i)
+			{
+				p[i] = double(i);
+			}
+			Consume(p[kCount-1]);
+		}
+		double seconds = sw.Seconds();
+		printf("  %s allocate + fill: %6.2f GB/s\n",names[m],(double(kCount)*sizeof(double)*kCycles)/seconds/1e9);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchArrayKernels()
+{
+	const size_t kCount = size_t(1) << 24; // 64MB of floats
+	const int    kReps  = 10;
+
+	const char* isas[] = { "generic", "SSE2", "AVX2", "AVX-512" };
+	printf("  dispatching to %s\n",isas[array_simd_isa()]);
+
+	array_ptr<float> a = make_aligned_array<float,64>(kCount);
+	array_ptr<float> b = make_aligned_array<float,64>(kCount);
+
+	// the loops everyone writes by hand, through operator[]
+	double scalar[7] = { 0 };
+	double simd[7]   = { 0 };
+	for (int r=0;r<kReps;++r)
+	{
+		Stopwatch fill;
+		for (size_t i=0;i<kCount;++i) { a[i] = 1.0f; }
+		scalar[0] += fill.Seconds();
+
+		Stopwatch copy;
+		for (size_t i=0;i<kCount;++i) { b[i] = a[i]; }
+		scalar[1] += copy.Seconds();
+
+		Stopwatch compare;
+		bool equal = true;
+		for (size_t i=0;i<kCount && equal;++i) { equal = (a[i] == b[i]); }
+		Consume(equal);
+		scalar[2] += compare.Seconds();
+
+		Stopwatch find;
+		size_t found = kCount;
+		for (size_t i=0;i<kCount;++i) { if ( a[i] == 2.0f ) { found = i; break; } }
+		Consume(found);
+		scalar[3] += find.Seconds();
+
+		Stopwatch minmax;
+		float lo = a[0], hi = a[0];
+		for (size_t i=0;i<kCount;++i) { lo = a[i] < lo ? a[i] : lo; hi = a[i] > hi ? a[i] : hi; }
+		Consume(lo); Consume(hi);
+		scalar[4] += minmax.Seconds();
+
+		Stopwatch sum;
+		float total = 0;
+		for (size_t i=0;i<kCount;++i) { total += a[i]; }
+		Consume(total);
+		scalar[5] += sum.Seconds();
+
+		Stopwatch transform;
+		for (size_t i=0;i<kCount;++i) { b[i] = a[i] * 2.0f + 1.0f; }
+		scalar[6] += transform.Seconds();
+	}
+	for (int r=0;r<kReps;++r)
+	{
+		Stopwatch fill;
+		array_fill(a,1.0f);
+		simd[0] += fill.Seconds();
+
+		Stopwatch copy;
+		array_copy(b,a);
+		simd[1] += copy.Seconds();
+
+		Stopwatch compare;
+		Consume(array_equal(a,b));
+		simd[2] += compare.Seconds();
+
+		Stopwatch find;
+		Consume(array_find(a,2.0f));
+		simd[3] += find.Seconds();
+
+		Stopwatch minmax;
+		Consume(array_min(a));
+		Consume(array_max(a));
+		simd[4] += minmax.Seconds();
+
+		Stopwatch sum;
+		Consume(array_sum(a));
+		simd[5] += sum.Seconds();
+
+		Stopwatch transform;
+		array_transform(b,a,[](float x) { return x * 2.0f + 1.0f; });
+		simd[6] += transform.Seconds();
+	}
+
+	const char* names[] = { "fill     ", "copy     ", "equal    ", "find     ", "min + max", "sum      ", "transform" };
+	for (int k=0;k<7;++k)
+	{
+		printf("  %s scalar %8.2f ms   simd %8.2f ms   %5.1fx\n",names[k],scalar[k]*1000.0/kReps,simd[k]*1000.0/kReps,scalar[k]/simd[k]);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchParallelScaling()
+{
+	const size_t kCount = size_t(1) << 24; // 128MB of doubles
+	const int    kReps  = 4;
+
+	array_ptr<double> a = make_uninitialized_array<double>(kCount);
+	array_ptr<double> b = make_uninitialized_array<double>(kCount);
+
+	// the caller is always one of the threads, so a pool of k - 1 workers
+	// gives k cores
+	const unsigned hardware = std::thread::hardware_concurrency();
+	double base[3] = { 0 };
+	for (unsigned k=1;k<=(hardware ? hardware : 1);++k)
+	{
+		work_pool pool(k-1);
+		double seconds[3] = { 0 };
+		for (int r=0;r<kReps;++r)
+		{
+			Stopwatch transform;
+			parallel_for(a,[](double& x) { x = 1.0; },pool);
+			parallel_transform(b,a,[](double x) { return x * 2.0 + 1.0; },pool);
+			seconds[0] += transform.Seconds();
+
+			Stopwatch reduce;
+			Consume(parallel_reduce(b,0.0,[](double s, double x) { return s + x; },pool));
+			seconds[1] += reduce.Seconds();
+
+			unsigned seed = 12345;
+			for (size_t i=0;i<kCount;++i)
+			{
+				seed = seed * 1103515245u + 12345u;
+				a[i] = double(seed >> 8);
+			}
+			Stopwatch sort;
+			parallel_sort(a,std::less<double>(),pool);
+			seconds[2] += sort.Seconds();
+		}
+		if ( k == 1 )
+		{
+			memcpy(base,seconds,sizeof(base));
+		}
+		printf("  %2u cores: for + transform %8.2f ms (%4.2fx)   reduce %8.2f ms (%4.2fx)   sort %8.2f ms (%4.2fx)\n",k,
+			seconds[0]*1000.0/kReps,base[0]/seconds[0],
+			seconds[1]*1000.0/kReps,base[1]/seconds[1],
+			seconds[2]*1000.0/kReps,base[2]/seconds[2]);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchSharedMemoryHandoff()
+{
+	const size_t kCount = (size_t(256) << 20) / sizeof(double); // 256MB
+
+	char name[64];
+	snprintf(name,sizeof(name),"/ptr_bench_%d",(int)getpid());
+
+	// through a pipe: write it all in, read it all back out on the other side
+	{
+		array_ptr<double> a = make_uninitialized_array<double>(kCount);
+		for (size_t i=0;i<kCount;++i) { a[i] = double(i); }
+
+		int fds[2];
+		if ( pipe(fds) != 0 )
+		{
+			return;
+		}
+
+		Stopwatch sw;
+		pid_t child = fork();
+		if ( child == 0 )
+		{
+			close(fds[0]);
+			const char* p    = reinterpret_cast<const char*>(&a[0]);
+			size_t      left = kCount * sizeof(double);
+			while ( left )
+			{
+				ssize_t written = write(fds[1],p,left);
+				if ( written <= 0 )
+				{
+					_exit(1);
+				}
+				p    += written;
+				left -= size_t(written);
+			}
+			_exit(0);
+		}
+		close(fds[1]);
+
+		array_ptr<double> b = make_uninitialized_array<double>(kCount);
+		char*  p    = reinterpret_cast<char*>(&b[0]);
+		size_t left = kCount * sizeof(double);
+		while ( left )
+		{
+			ssize_t got = read(fds[0],p,left);
+			if ( got <= 0 )
+			{
+				break;
+			}
+			p    += got;
+			left -= size_t(got);
+		}
+		close(fds[0]);
+		waitpid(child,0,0);
+		Consume(b[kCount-1]);
+		printf("  pipe:            %8.2f ms\n",sw.Seconds()*1000.0);
+	}
+
+	// through shared memory: the other side just maps it
+	{
+		array_ptr<double> a = make_shm_array<double>(name,kCount);
+		if ( !a )
+		{
+			return;
+		}
+		for (size_t i=0;i<kCount;++i) { a[i] = double(i); }
+
+		Stopwatch sw;
+		pid_t child = fork();
+		if ( child == 0 )
+		{
+			array_ptr<double> b = open_shm_array<double>(name);
+			const bool        ok = b && b[kCount-1] == double(kCount-1);
+			b = 0;
+			_exit(ok ? 0 : 1);
+		}
+		waitpid(child,0,0);
+		printf("  make_shm_array(): %7.2f ms\n",sw.Seconds()*1000.0);
+	}
+}
+
+///////////////////////////////////
+
+static void BenchBufferParsing()
+{
+	// a big batch of HTTP-ish header lines
+	std::string text;
+	for (int i=0;text.size()<(size_t(64) << 20);++i)
+	{
+		char line[128];
+		snprintf(line,sizeof(line),"X-Request-Header-%d: a value long enough to miss the small string buffer %d\r\n",i % 100,i);
+		text += line;
+	}
+	const size_t kBytes = text.size();
+
+	array_ptr<char> raw = make_uninitialized_array<char>(kBytes);
+	memcpy(&raw[0],text.data(),kBytes);
+	text = std::string();
+
+	// copying each field out into a std::string of its own
+	{
+		size_t    before = s_allocations;
+		size_t    fields = 0;
+		Stopwatch sw;
+		std::string rest(&raw[0],kBytes);
+		size_t      at = 0;
+		while ( at < rest.size() )
+		{
+			size_t end   = rest.find("\r\n",at);
+			size_t colon = rest.find(':',at);
+			std::string name  = rest.substr(at,colon - at);
+			std::string value = rest.substr(colon + 2,end - colon - 2);
+			Consume(name);
+			Consume(value);
+			fields += 2;
+			at = end + 2;
+		}
+		double seconds = sw.Seconds();
+		printf("  std::string copies: %8.2f MB/s, %10zu allocations for %zu fields\n",kBytes/seconds/1e6,s_allocations - before,fields);
+	}
+
+	// slicing byte_buffers
+	{
+		size_t    before = s_allocations;
+		size_t    fields = 0;
+		Stopwatch sw;
+		byte_buffer rest(raw,kBytes);
+		while ( !rest.empty() )
+		{
+			byte_buffer line  = rest.split("\r\n");
+			byte_buffer name  = line.split(':');
+			line.remove_prefix(1);
+			Consume(name);
+			Consume(line);
+			fields += 2;
+		}
+		double seconds = sw.Seconds();
+		printf("  byte_buffer slices: %8.2f MB/s, %10zu allocations for %zu fields\n",kBytes/seconds/1e6,s_allocations - before,fields);
+	}
+}
+
+///////////////////////////////////
+
+template <typename Handle>
+static double CopyOnThreads(const Handle& global, unsigned threads, int copies)
+{
+	std::atomic<bool>        go(false);
+	std::vector<std::thread> workers;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			while ( !go ) { }
+			for (int i=0;i<copies;++i)
+			{
+				Handle copy = global;
+				Consume(copy);
+			}
+		}));
+	}
+
+	Stopwatch sw;
+	go = true;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers[t].join();
+	}
+	return sw.Seconds();
+}
+
+static void BenchShardedCopies()
+{
+	const int kCopies = 10000000;
+
+	std::shared_ptr<int> shared(new int(0));
+	sharded_ptr<int>     sharded(new int(0));
+
+	// the same number of copies per thread, so perfect scaling is a flat line
+	const unsigned hardware = std::thread::hardware_concurrency();
+	for (unsigned k=1;k<=(hardware ? hardware : 1);k*=2)
+	{
+		double one  = CopyOnThreads(shared,k,kCopies);
+		double many = CopyOnThreads(sharded,k,kCopies);
+		printf("  %3u threads: std::shared_ptr %6.2f ns/copy   sharded_ptr %6.2f ns/copy\n",k,one*1e9/kCopies,many*1e9/kCopies);
+	}
+
+	sharded.retire();
+}
+
+///////////////////////////////////
+
+struct Settings
+{
+	int    verbosity;
+	double scale;
+};
+
+static void BenchImmortalCopies()
+{
+	const size_t kHandles = 1 << 20;
+	const int    kReps    = 50;
+
+	static Settings s_defaults = { 1, 1.0 };
+
+	// the same object handed out a million times over, and let go again
+	ptr<Settings> counted  = new Settings(s_defaults);
+	ptr<Settings> immortal = make_immortal(&s_defaults);
+
+	ptr_vector< ptr<Settings> > handles;
+	handles.reserve(kHandles);
+	const char* names[] = { "counted ", "immortal" };
+	for (int m=0;m<2;++m)
+	{
+		const ptr<Settings>& source = m ? immortal : counted;
+
+		Stopwatch sw;
+		for (int r=0;r<kReps;++r)
+		{
+			for (size_t i=0;i<kHandles;++i)
+			{
+				handles.push_back(source);
+			}
+			handles.clear();
+		}
+		printf("  %s ptr<> copy + destroy: %6.2f ns\n",names[m],sw.Seconds()*1e9/(double(kHandles)*kReps));
+	}
+}
+
+///////////////////////////////////
+
+struct SnapshotRecord
+{
+	SnapshotRecord() : id(0), score(0.0) { }
+
+	long long           id;
+	double              score;
+	ptr<SnapshotRecord> parent;
+};
+
+void ptr_snapshot(ptr_writer& w, const SnapshotRecord& r)
+{
+	w.write(r.id);
+	w.write(r.score);
+	w.write(r.parent);
+}
+
+void ptr_restore(ptr_reader& r, SnapshotRecord& record)
+{
+	r.read(record.id);
+	r.read(record.score);
+	r.read(record.parent);
+}
+
+static void BenchSnapshot()
+{
+	const size_t kRecords = 1 << 20;
+	const size_t kParents = 1024;
+	const size_t kFloats  = size_t(32) << 20; // 128MB
+
+	char path[64];
+	snprintf(path,sizeof(path),"/tmp/ptr_bench_snapshot_%d",(int)getpid());
+
+	// a million small objects sharing a thousand parents, and one big array
+	array_ptr< ptr<SnapshotRecord> > records = make_aligned_array<ptr<SnapshotRecord>,64>(kRecords);
+	for (size_t i=0;i<kRecords;++i)
+	{
+		records[i] = new SnapshotRecord;
+		records[i]->id     = (long long)i;
+		records[i]->score  = double(i) * 0.25;
+		records[i]->parent = i < kParents ? ptr<SnapshotRecord>() : records[i % kParents];
+	}
+	array_ptr<float> samples = make_uninitialized_array<float>(kFloats);
+	for (size_t i=0;i<kFloats;++i)
+	{
+		samples[i] = float(i);
+	}
+
+	std::vector<char> buffer(1 << 20);
+	{
+		std::ofstream out(path,std::ios::binary);
+		out.rdbuf()->pubsetbuf(&buffer[0],std::streamsize(buffer.size()));
+
+		Stopwatch sw;
+		ptr_writer w(out);
+		w.write(records);
+		w.write(samples);
+		w.flush();
+		out.flush();
+		printf("  write:       %8.2f ms, %zu objects\n",sw.Seconds()*1000.0,w.objects());
+	}
+
+	// the same bytes read straight into a buffer, for comparison
+	std::ifstream size_probe(path,std::ios::binary | std::ios::ate);
+	const size_t bytes = size_t(size_probe.tellg());
+	{
+		array_ptr<char> raw = make_uninitialized_array<char>(bytes);
+		std::ifstream in(path,std::ios::binary);
+
+		Stopwatch sw;
+		in.read(&raw[0],std::streamsize(bytes));
+		double seconds = sw.Seconds();
+		printf("  raw read:    %8.2f ms, %8.2f MB/s\n",seconds*1000.0,bytes/seconds/1e6);
+	}
+	{
+		std::ifstream in(path,std::ios::binary);
+		in.rdbuf()->pubsetbuf(&buffer[0],std::streamsize(buffer.size()));
+
+		Stopwatch sw;
+		ptr_reader r(in);
+		array_ptr< ptr<SnapshotRecord> > restored_records;
+		array_ptr<float>                 restored_samples;
+		r.read(restored_records);
+		r.read(restored_samples);
+		double seconds = sw.Seconds();
+		printf("  restore:     %8.2f ms, %8.2f MB/s%s\n",seconds*1000.0,bytes/seconds/1e6,r.good() ? "" : " (failed!)");
+	}
+
+	unlink(path);
+}
+
+///////////////////////////////////
+
+// stands in for something slow to build, a parsed config or a lookup table
+struct ExpensiveTable
+{
+	ExpensiveTable(unsigned seed) : values(new unsigned[16384])
+	{
+		for (unsigned i=0;i<16384;++i)
+		{
+			seed = seed * 1103515245u + 12345u;
+			values[i] = seed >> 8;
+		}
+	}
+
+	unsigned Lookup(unsigned i) const { return values[i & 16383]; }
+
+	array_ptr<unsigned> values;
+};
+
+static void BenchLazyStartup()
+{
+	const unsigned kTables = 2000;
+	const unsigned kUsed   = 100; // only 5% are ever looked at
+	const int      kLooks  = 10000000;
+
+	// built up front
+	{
+		Stopwatch startup;
+		std::vector< ptr<ExpensiveTable> > tables;
+		for (unsigned i=0;i<kTables;++i)
+		{
+			tables.push_back(new ExpensiveTable(i));
+		}
+		double ready = startup.Seconds();
+
+		Stopwatch use;
+		unsigned sum = 0;
+		for (int i=0;i<kLooks;++i)
+		{
+			sum += tables[unsigned(i) % kUsed]->Lookup(unsigned(i));
+		}
+		Consume(sum);
+		printf("  eager ptr<>:   startup %8.2f ms, %5.2f ns per use\n",ready*1000.0,use.Seconds()*1e9/kLooks);
+	}
+
+	// built when first used
+	{
+		Stopwatch startup;
+		std::vector< ptr< lazy_ptr<ExpensiveTable> > > tables;
+		for (unsigned i=0;i<kTables;++i)
+		{
+			tables.push_back(new lazy_ptr<ExpensiveTable>([i]() { return ptr<ExpensiveTable>(new ExpensiveTable(i)); }));
+		}
+		double ready = startup.Seconds();
+
+		Stopwatch use;
+		unsigned sum = 0;
+		for (int i=0;i<kLooks;++i)
+		{
+			sum += (*tables[unsigned(i) % kUsed])->Lookup(unsigned(i));
+		}
+		Consume(sum);
+		printf("  lazy_ptr<>:    startup %8.2f ms, %5.2f ns per use (first uses build)\n",ready*1000.0,use.Seconds()*1e9/kLooks);
+	}
+}
+
+///////////////////////////////////
+
+struct RequestState
+{
+	RequestState(unsigned i) : id(i), bytes(i * 3) {}
+	unsigned id;
+	unsigned bytes;
+};
+
+static void BenchPmrArena()
+{
+	const int kRequests = 20000;
+	const int kObjects  = 50; // objects per request
+
+	// everything through the global heap
+	{
+		size_t before = s_allocations;
+		Stopwatch sw;
+		unsigned sum = 0;
+		for (int r=0;r<kRequests;++r)
+		{
+			std::vector< ptr<RequestState> > live;
+			live.reserve(kObjects);
+			for (int i=0;i<kObjects;++i)
+			{
+				live.push_back(new RequestState(unsigned(i)));
+				sum += live.back()->bytes;
+			}
+		}
+		Consume(sum);
+		printf("  new/delete:          %6.2f ns per object, %5.2f heap allocations per object\n",sw.Seconds()*1e9/(double(kRequests)*kObjects),double(s_allocations-before)/(double(kRequests)*kObjects));
+	}
+
+	// a monotonic arena per request
+	{
+		size_t before = s_allocations;
+		Stopwatch sw;
+		unsigned sum = 0;
+		for (int r=0;r<kRequests;++r)
+		{
+			char                                buffer[8192];
+			std::pmr::monotonic_buffer_resource arena(buffer,sizeof(buffer));
+			std::vector< ptr<RequestState> >    live;
+			live.reserve(kObjects);
+			for (int i=0;i<kObjects;++i)
+			{
+				live.push_back(make_pmr<RequestState>(&arena,unsigned(i)));
+				sum += live.back()->bytes;
+			}
+		}
+		Consume(sum);
+		printf("  pmr monotonic arena: %6.2f ns per object, %5.2f heap allocations per object\n",sw.Seconds()*1e9/(double(kRequests)*kObjects),double(s_allocations-before)/(double(kRequests)*kObjects));
+	}
+
+	// a pool shared across requests
+	{
+		size_t before = s_allocations;
+		std::pmr::unsynchronized_pool_resource pool;
+		Stopwatch sw;
+		unsigned sum = 0;
+		for (int r=0;r<kRequests;++r)
+		{
+			std::vector< ptr<RequestState> > live;
+			live.reserve(kObjects);
+			for (int i=0;i<kObjects;++i)
+			{
+				live.push_back(make_pmr<RequestState>(&pool,unsigned(i)));
+				sum += live.back()->bytes;
+			}
+		}
+		Consume(sum);
+		printf("  pmr pool:            %6.2f ns per object, %5.2f heap allocations per object\n",sw.Seconds()*1e9/(double(kRequests)*kObjects),double(s_allocations-before)/(double(kRequests)*kObjects));
+	}
+}
+
+///////////////////////////////////
+
+struct PolicyObject : public ptr_intrusive_base
+{
+	PolicyObject() : value(1) { }
+	int value;
+};
+
+template <typename Handle>
+static void BenchPolicy(const char* name)
+{
+	const size_t kHandles = 1 << 20;
+	const int    kReps    = 20;
+	const int    kFresh   = 1000000;
+
+	// copying one object over and over, and letting the copies go
+	Handle                source = new PolicyObject;
+	ptr_vector< Handle >  handles;
+	handles.reserve(kHandles);
+
+	Stopwatch copies;
+	for (int r=0;r<kReps;++r)
+	{
+		for (size_t i=0;i<kHandles;++i)
+		{
+			handles.push_back(source);
+		}
+		handles.clear();
+	}
+	const double copy_ns = copies.Seconds()*1e9/(double(kHandles)*kReps);
+
+	// and making new ones
+	size_t before = s_allocations;
+	Stopwatch fresh;
+	int sum = 0;
+	for (int i=0;i<kFresh;++i)
+	{
+		Handle h = new PolicyObject;
+		sum += h->value;
+	}
+	Consume(sum);
+	printf("  %-24s %2u bytes, copy + destroy %5.2f ns, new + delete %6.2f ns (%.0f allocations)\n",name,unsigned(sizeof(Handle)),copy_ns,fresh.Seconds()*1e9/kFresh,double(s_allocations-before)/kFresh);
+}
+
+static void BenchPolicyCopies()
+{
+	BenchPolicy< ptr<PolicyObject> >("ptr<>");
+	BenchPolicy< basic_ptr<PolicyObject,ptr_synchronized> >("synchronized");
+	BenchPolicy< basic_ptr<PolicyObject,ptr_unsynchronized,ptr_delete,ptr_intrusive> >("intrusive");
+	BenchPolicy< basic_ptr<PolicyObject,ptr_synchronized,ptr_delete,ptr_intrusive> >("synchronized intrusive");
+}
+
+///////////////////////////////////
+
+static void BenchNonnullCopies()
+{
+	const size_t kHandles = 1 << 20;
+	const int    kReps    = 50;
+
+	// the same object handed out a million times over, used, and let go again
+	Settings              settings = { 1, 1.0 };
+	ptr<Settings>         counted  = new Settings(settings);
+	nonnull_ptr<Settings> nonnull(counted);
+
+	{
+		ptr_vector< ptr<Settings> > handles;
+		handles.reserve(kHandles);
+		Stopwatch sw;
+		int sum = 0;
+		for (int r=0;r<kReps;++r)
+		{
+			for (size_t i=0;i<kHandles;++i)
+			{
+				handles.push_back(counted);
+			}
+			for (size_t i=0;i<kHandles;++i)
+			{
+				sum += handles[i]->verbosity;
+			}
+			handles.clear();
+		}
+		Consume(sum);
+		printf("  ptr<>         copy + use + destroy: %6.2f ns\n",sw.Seconds()*1e9/(double(kHandles)*kReps));
+	}
+
+	{
+		ptr_vector< nonnull_ptr<Settings> > handles;
+		handles.reserve(kHandles);
+		Stopwatch sw;
+		int sum = 0;
+		for (int r=0;r<kReps;++r)
+		{
+			for (size_t i=0;i<kHandles;++i)
+			{
+				handles.push_back(nonnull);
+			}
+			for (size_t i=0;i<kHandles;++i)
+			{
+				sum += handles[i]->verbosity;
+			}
+			handles.clear();
+		}
+		Consume(sum);
+		printf("  nonnull_ptr<> copy + use + destroy: %6.2f ns\n",sw.Seconds()*1e9/(double(kHandles)*kReps));
+	}
+}
+
+///////////////////////////////////
+
+struct MapObject
+{
+	explicit MapObject(int v) : value(v) { /* empty */ };
+	int value;
+};
+
+typedef basic_ptr<MapObject,ptr_synchronized> MapObjectPtr;
+
+// the way it's usually done
+struct LockedMap
+{
+	MapObjectPtr find(int key)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::map<int,MapObjectPtr>::const_iterator it = objects.find(key);
+		return it == objects.end() ? MapObjectPtr() : it->second;
+	}
+	void assign(int key, const MapObjectPtr& value)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		objects[key] = value;
+	}
+	std::mutex                 lock;
+	std::map<int,MapObjectPtr> objects;
+};
+
+// ops on each of threads, writes out of every 100 of them assign, the rest
+// find, returns the seconds taken
+template <typename Map>
+static double MapOnThreads(Map& map, int keys, unsigned threads, int ops, int writes)
+{
+	std::atomic<bool>        go(false);
+	std::vector<std::thread> workers;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers.push_back(std::thread([&,t]()
+		{
+			while ( !go ) { }
+			uint32_t x   = 12345 + t;
+			int      sum = 0;
+			for (int i=0;i<ops;++i)
+			{
+				x = x * 1664525 + 1013904223;
+				const int key = int((x >> 8) % unsigned(keys));
+				if ( int((x >> 4) % 100) < writes )
+				{
+					map.assign(key,new MapObject(key));
+				}
+				else
+				{
+					MapObjectPtr o = map.find(key);
+					sum += o ? o->value : 0;
+				}
+			}
+			Consume(sum);
+		}));
+	}
+
+	Stopwatch sw;
+	go = true;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers[t].join();
+	}
+	return sw.Seconds();
+}
+
+static void BenchConcurrentMap()
+{
+	const int kKeys = 1 << 16;
+	const int kOps  = 2000000;
+	const int kWrites[] = { 0, 5, 50 };
+
+	LockedMap             locked;
+	ptr_map<int,MapObject> lockless;
+	for (int k=0;k<kKeys;++k)
+	{
+		locked.assign(k,new MapObject(k));
+		lockless.assign(k,new MapObject(k));
+	}
+
+	// the same number of ops per thread, so perfect scaling is a flat line
+	const unsigned hardware = std::thread::hardware_concurrency();
+	for (size_t w=0;w<sizeof(kWrites)/sizeof(kWrites[0]);++w)
+	{
+		for (unsigned k=1;k<=(hardware ? hardware : 1);k*=2)
+		{
+			double one  = MapOnThreads(locked,kKeys,k,kOps,kWrites[w]);
+			double many = MapOnThreads(lockless,kKeys,k,kOps,kWrites[w]);
+			printf("  %2d%% writes, %3u threads: std::map + mutex %6.1f ns/op   ptr_map %6.1f ns/op\n",kWrites[w],k,one*1e9/kOps,many*1e9/kOps);
+		}
+	}
+}
+
+///////////////////////////////////
+
+struct WorkItem
+{
+	int payload[4];
+};
+
+// the way it's usually done, a copy in and a copy out
+template <typename T>
+struct LockedQueue
+{
+	bool push(T& value)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		items.push_back(value);
+		value = T();
+		return true;
+	}
+	bool pop(T& value)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if ( items.empty() )
+		{
+			return false;
+		}
+		value = items.front();
+		items.pop_front();
+		return true;
+	}
+	bool steal(T& value)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if ( items.empty() )
+		{
+			return false;
+		}
+		value = items.back();
+		items.pop_back();
+		return true;
+	}
+	std::mutex    lock;
+	std::deque<T> items;
+};
+
+// items handed from producers to consumers, returns seconds per item
+template <typename Queue>
+static double HandOff(Queue& queue, unsigned pairs, int items)
+{
+	std::vector< ptr_vector< ptr<WorkItem> > > made(pairs), got(pairs);
+	for (unsigned t=0;t<pairs;++t)
+	{
+		made[t].reserve(items);
+		got[t].reserve(items);
+		for (int i=0;i<items;++i)
+		{
+			made[t].push_back(new WorkItem);
+		}
+	}
+
+	std::atomic<bool>        go(false);
+	std::vector<std::thread> workers;
+	for (unsigned t=0;t<pairs;++t)
+	{
+		workers.push_back(std::thread([&,t]()
+		{
+			while ( !go ) { }
+			for (int i=0;i<items;++i)
+			{
+				while ( !queue.push(made[t][i]) )
+				{
+					std::this_thread::yield();
+				}
+			}
+		}));
+		workers.push_back(std::thread([&,t]()
+		{
+			while ( !go ) { }
+			ptr<WorkItem> item;
+			for (int i=0;i<items;++i)
+			{
+				while ( !queue.pop(item) )
+				{
+					std::this_thread::yield();
+				}
+				got[t].push_back(item);
+			}
+		}));
+	}
+
+	Stopwatch sw;
+	go = true;
+	for (size_t t=0;t<workers.size();++t)
+	{
+		workers[t].join();
+	}
+	return sw.Seconds() / (double(items) * pairs);
+}
+
+// one item bounced back and forth, returns seconds per one-way trip
+template <typename Queue>
+static double PingPong(Queue& there, Queue& back, int trips)
+{
+	std::thread echo([&]()
+	{
+		ptr<WorkItem> item;
+		for (int i=0;i<trips;++i)
+		{
+			while ( !there.pop(item) )
+			{
+				std::this_thread::yield();
+			}
+			back.push(item);
+		}
+	});
+
+	Stopwatch     sw;
+	ptr<WorkItem> item = new WorkItem;
+	for (int i=0;i<trips;++i)
+	{
+		there.push(item);
+		while ( !back.pop(item) )
+		{
+			std::this_thread::yield();
+		}
+	}
+	const double seconds = sw.Seconds();
+	echo.join();
+	return seconds / (2.0 * trips);
+}
+
+// the owner pushes and pops, with a thief stealing all the while if asked,
+// returns seconds per item and how many were stolen
+template <typename Deque>
+static double OwnerAndThief(Deque& deque, bool thief, int items, int& stolen)
+{
+	ptr_vector< ptr<WorkItem> > made;
+	made.reserve(items);
+	for (int i=0;i<items;++i)
+	{
+		made.push_back(new WorkItem);
+	}
+
+	std::atomic<bool> done(false);
+	std::atomic<int>  taken(0);
+	std::thread       robber;
+	if ( thief )
+	{
+		robber = std::thread([&]()
+		{
+			ptr<WorkItem> item;
+			while ( !done )
+			{
+				if ( deque.steal(item) )
+				{
+					taken++;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	// push a batch, work through it
+	ptr_vector< ptr<WorkItem> > finished;
+	finished.reserve(items);
+	Stopwatch     sw;
+	ptr<WorkItem> item;
+	for (int i=0;i<items;i+=64)
+	{
+		for (int j=i;j<i+64 && j<items;++j)
+		{
+			deque.push(made[j]);
+		}
+		while ( deque.pop(item) )
+		{
+			finished.push_back(item);
+		}
+	}
+	const double seconds = sw.Seconds();
+	done = true;
+	if ( thief )
+	{
+		robber.join();
+	}
+	stolen = taken;
+	return seconds / items;
+}
+
+static void BenchQueueHandoff()
+{
+	const int kItems = 1 << 20;
+	const int kTrips = 20000;
+
+	for (unsigned pairs=1;pairs<=2;++pairs)
+	{
+		LockedQueue< ptr<WorkItem> > locked;
+		ptr_queue< ptr<WorkItem> >   lockless(1024);
+		double one  = HandOff(locked,pairs,kItems/pairs);
+		double many = HandOff(lockless,pairs,kItems/pairs);
+		printf("  %u producer(s) -> %u consumer(s):  deque + mutex %6.1f ns/item   ptr_queue %6.1f ns/item\n",pairs,pairs,one*1e9,many*1e9);
+	}
+
+	{
+		LockedQueue< ptr<WorkItem> > there_locked, back_locked;
+		ptr_queue< ptr<WorkItem> >   there(16), back(16);
+		double one  = PingPong(there_locked,back_locked,kTrips);
+		double many = PingPong(there,back,kTrips);
+		printf("  one-way latency:                deque + mutex %6.1f ns        ptr_queue %6.1f ns\n",one*1e9,many*1e9);
+	}
+
+	for (int thief=0;thief<2;++thief)
+	{
+		LockedQueue< ptr<WorkItem> > locked;
+		ptr_deque< ptr<WorkItem> >   lockless(1024);
+		int stolen_locked = 0, stolen = 0;
+		double one  = OwnerAndThief(locked,thief != 0,kItems,stolen_locked);
+		double many = OwnerAndThief(lockless,thief != 0,kItems,stolen);
+		printf("  owner push + pop, %-9s:    deque + mutex %6.1f ns/item   ptr_deque %6.1f ns/item (%d, %d stolen)\n",thief ? "one thief" : "no thief",one*1e9,many*1e9,stolen_locked,stolen);
+	}
+}
+
+///////////////////////////////////
+
+struct TreeNode
+{
+	int           value;
+	ptr<TreeNode> left, right;
+};
+
+void ptr_detach(TreeNode& n, ptr_teardown& t)
+{
+	t.take(n.left);
+	t.take(n.right);
+}
+
+// a complete binary tree of n nodes, built without recursing
+static ptr<TreeNode> MakeTree(size_t n)
+{
+	ptr_vector< ptr<TreeNode> > nodes;
+	nodes.reserve(n);
+	for (size_t i=0;i<n;++i)
+	{
+		nodes.push_back(new TreeNode);
+		nodes[i]->value = int(i);
+	}
+	for (size_t i=n-1;i>0;--i)
+	{
+		ptr<TreeNode>& parent = nodes[(i-1)/2];
+		(i & 1 ? parent->left : parent->right) = nodes[i];
+	}
+	return nodes[0];
+}
+
+// a list of n nodes, linked through left
+static ptr<TreeNode> MakeList(size_t n)
+{
+	ptr<TreeNode> head;
+	for (size_t i=0;i<n;++i)
+	{
+		ptr<TreeNode> node = new TreeNode;
+		node->left = head;
+		head = node;
+	}
+	return head;
+}
+
+static void BenchTeardown()
+{
+	const size_t kNodes = 10000000;
+
+	{
+		ptr<TreeNode> root = MakeTree(kNodes);
+		Stopwatch sw;
+		root = 0;
+		printf("  %zuM node tree, recursive destructors:   %6.3f s\n",kNodes/1000000,sw.Seconds());
+	}
+
+	{
+		ptr<TreeNode> root = MakeTree(kNodes);
+		Stopwatch sw;
+		teardown(root);
+		printf("  %zuM node tree, teardown():              %6.3f s\n",kNodes/1000000,sw.Seconds());
+	}
+
+	{
+		work_pool&    pool = work_pool::shared();
+		ptr<TreeNode> root = MakeTree(kNodes);
+		Stopwatch sw;
+		teardown(root,pool);
+		printf("  %zuM node tree, teardown(), %2u thread(s):%6.3f s\n",kNodes/1000000,pool.threads()+1,sw.Seconds());
+	}
+
+	{
+		// (far too deep to let go of recursively)
+		ptr<TreeNode> head = MakeList(kNodes);
+		Stopwatch sw;
+		teardown(head);
+		printf("  %zuM node list, teardown():              %6.3f s\n",kNodes/1000000,sw.Seconds());
+	}
+}
+
+///////////////////////////////////
+
+// stands for kCachedBytes of something expensive to make
+struct CachedResult
+{
+	enum { kCachedBytes = 1024 };
+	CachedResult()  { s_live += kCachedBytes; }
+	~CachedResult() { s_live -= kCachedBytes; }
+	static std::atomic<size_t> s_live;
+};
+
+std::atomic<size_t> CachedResult::s_live(0);
+
+typedef basic_ptr<CachedResult,ptr_synchronized> CachedResultPtr;
+
+// the way it's usually done, the least recently used goes whoever else has it
+struct PlainLru
+{
+	explicit PlainLru(size_t budget) : budget(budget), bytes(0), evicted(0), reclaimed(0) { /* empty */ };
+	CachedResultPtr get(int key)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::unordered_map<int,std::list< std::pair<int,CachedResultPtr> >::iterator>::iterator it = index.find(key);
+		if ( it == index.end() )
+		{
+			return CachedResultPtr();
+		}
+		order.splice(order.begin(),order,it->second);
+		return it->second->second;
+	}
+	void put(int key, const CachedResultPtr& value, size_t size)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		while ( bytes + size > budget && !order.empty() )
+		{
+			evicted   += size;
+			reclaimed += order.back().second.unique() ? size : 0;
+			index.erase(order.back().first);
+			order.pop_back();
+			bytes -= size;
+		}
+		order.push_front(std::make_pair(key,value));
+		index[key] = order.begin();
+		bytes += size;
+	}
+	std::mutex                                                                    lock;
+	std::list< std::pair<int,CachedResultPtr> >                                   order;
+	std::unordered_map<int,std::list< std::pair<int,CachedResultPtr> >::iterator> index;
+	size_t                                                                        budget, bytes, evicted, reclaimed;
+};
+
+// skewed lookups, each thread holding on to every fourth result it got for
+// longer than the cache would, returns seconds per lookup and the hit rate
+template <typename Cache>
+static double CacheOnThreads(Cache& cache, unsigned threads, int lookups, int keys, double& hit_rate, size_t& peak)
+{
+	std::atomic<bool>        go(false);
+	std::atomic<int>         hits(0);
+	std::atomic<size_t>      highest(0);
+	std::vector<std::thread> workers;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers.push_back(std::thread([&,t]()
+		{
+			while ( !go ) { }
+			const int       kHeld = 2048;
+			CachedResultPtr held[kHeld];
+			uint32_t        x = 99 + t;
+			int             found = 0;
+			for (int i=0;i<lookups;++i)
+			{
+				x = x * 1664525 + 1013904223;
+				const double u   = double(x >> 8) / double(1 << 24);
+				const int    key = int(u * u * u * keys);
+				CachedResultPtr r = cache.get(key);
+				if ( r )
+				{
+					found++;
+				}
+				else
+				{
+					r = new CachedResult;
+					cache.put(key,r,CachedResult::kCachedBytes);
+				}
+				if ( (i & 3) == 0 )
+				{
+					held[(i / 4) % kHeld] = r;
+				}
+				if ( (i & 1023) == 0 )
+				{
+					size_t live = CachedResult::s_live, h = highest;
+					while ( live > h && !highest.compare_exchange_weak(h,live) ) { }
+				}
+			}
+			hits += found;
+		}));
+	}
+
+	Stopwatch sw;
+	go = true;
+	for (unsigned t=0;t<threads;++t)
+	{
+		workers[t].join();
+	}
+	const double seconds = sw.Seconds();
+	hit_rate = double(hits) / (double(lookups) * threads);
+	peak     = highest;
+	return seconds / (double(lookups) * threads);
+}
+
+static void BenchBudgetedCache()
+{
+	const int    kLookups = 2000000;
+	const int    kKeys    = 100000;
+	const size_t kBudget  = 4096 * CachedResult::kCachedBytes;
+
+	const unsigned hardware = std::thread::hardware_concurrency();
+	for (unsigned k=1;k<=(hardware ? hardware : 1);k*=2)
+	{
+		double rate;
+		size_t peak;
+		{
+			PlainLru plain(kBudget);
+			double seconds = CacheOnThreads(plain,k,kLookups/k,kKeys,rate,peak);
+			printf("  %u thread(s) plain LRU:  %5.1f%% hits, %6.1f ns/lookup, %5.1f%% of evicted bytes freed, peak %5.1f MB live\n",k,rate*100.0,seconds*1e9,plain.evicted ? 100.0*plain.reclaimed/plain.evicted : 0.0,peak/1048576.0);
+		}
+		{
+			ptr_cache<int,CachedResult> cache(kBudget);
+			double seconds = CacheOnThreads(cache,k,kLookups/k,kKeys,rate,peak);
+			ptr_cache_stats s = cache.stats();
+			printf("  %u thread(s) ptr_cache:  %5.1f%% hits, %6.1f ns/lookup, %5.1f%% of evicted bytes freed, peak %5.1f MB live\n",k,rate*100.0,seconds*1e9,s.evicted ? 100.0*s.reclaimed/s.evicted : 0.0,peak/1048576.0);
+		}
+	}
+}
+
+///////////////////////////////////
+
+static void BenchBufferPool()
+{
+	const size_t kSizes[] = { 4096, 65536, 1 << 20 };
+	const size_t kInFlight = 8;
+	const int    kOps      = 200000;
+
+	// an I/O path's worth of buffers: a few out at once, each written to,
+	// then let go of in the order they came
+	for (size_t k=0;k<sizeof(kSizes)/sizeof(kSizes[0]);++k)
+	{
+		const size_t n = kSizes[k];
+		printf("  %7zu byte buffers\n",n);
+
+		{
+			array_ptr<char> ring[kInFlight];
+			Stopwatch sw;
+			for (int i=0;i<kOps;++i)
+			{
+				array_ptr<char>& b = ring[i % kInFlight];
+				b = new char[n];
+				b[0] = b[n / 2] = char(i);
+				Consume(b[0]);
+			}
+			printf("    new[]/delete[]:      %7.1f ns/buffer\n",sw.Seconds()*1e9/kOps);
+		}
+
+		{
+			buffer_pool pool(4 << 20);
+			array_ptr<char> ring[kInFlight];
+			Stopwatch sw;
+			for (int i=0;i<kOps;++i)
+			{
+				array_ptr<char>& b = ring[i % kInFlight];
+				b = pool.make(n);
+				b[0] = b[n / 2] = char(i);
+				Consume(b[0]);
+			}
+			const double seconds = sw.Seconds();
+			printf("    buffer_pool:         %7.1f ns/buffer, %5.1f%% from the cache\n",seconds*1e9/kOps,pool.stats().hit_rate*100.0);
+		}
+	}
+}
+
+///////////////////////////////////
+
+struct Benchmark
+{
+	const char* name;
+	void (*run)();
+};
+
+static const Benchmark s_benchmarks[] =
+{
+	{ "Relocation", BenchRelocation },
+	{ "HugePageScan", BenchHugePageScan },
+	{ "MappedFile", BenchMappedFile },
+	{ "AllocateAndFill", BenchAllocateAndFill },
+	{ "ArrayKernels", BenchArrayKernels },
+	{ "ParallelScaling", BenchParallelScaling },
+	{ "SharedMemoryHandoff", BenchSharedMemoryHandoff },
+	{ "BufferParsing", BenchBufferParsing },
+	{ "ShardedCopies", BenchShardedCopies },
+	{ "ImmortalCopies", BenchImmortalCopies },
+	{ "Snapshot", BenchSnapshot },
+	{ "LazyStartup", BenchLazyStartup },
+	{ "PmrArena", BenchPmrArena },
+	{ "PolicyCopies", BenchPolicyCopies },
+	{ "NonnullCopies", BenchNonnullCopies },
+	{ "ConcurrentMap", BenchConcurrentMap },
+	{ "QueueHandoff", BenchQueueHandoff },
+	{ "Teardown", BenchTeardown },
+	{ "BudgetedCache", BenchBudgetedCache },
+	{ "BufferPool", BenchBufferPool },
+};
+
+int main(int argc, char** argv)
+{
+	for (size_t i=0;i<sizeof(s_benchmarks)/sizeof(s_benchmarks[0]);++i)
+	{
+		bool selected = (argc < 2);
+		for (int a=1;a<argc;++a)
+		{
+			selected = selected || (strcmp(argv[a],s_benchmarks[i].name) == 0);
+		}
+
+		if ( selected )
+		{
+			printf("%s\n",s_benchmarks[i].name);
+			s_benchmarks[i].run();
+		}
+	}
+	return 0;
+}
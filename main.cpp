@@ -1,655 +1,3033 @@
-#include <vector>
-#include <list>
-#include <map>
-
-#include "UnitTest++/src/UnitTest++.h"
-
-#include "ptr.h"
-
-// a simple class that reference counts itself
-class RefCounter
-{
-	public:
-		RefCounter() { s_instances++; }
-		virtual ~RefCounter() { s_instances--; }
-
-		virtual signed Get(signed x) { return x; }
-
-		static signed s_instances;
-};
-
-signed RefCounter::s_instances = 0;
-
-// and a derived class off of RefCounter (for testing list of base pointers)
-class RefCounterDerived: public RefCounter
-{
-	public:
-		virtual signed Get(signed x) { return x*2; }
-};
-
-
-// a test fixture we need for setup/teardown of each test
-struct InstanceFixture
-{
-	InstanceFixture()
-	{
-		RefCounter::s_instances = 0;
-	}
-	~InstanceFixture()
-	{
-		// empty
-	}
-};
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,AutoDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	{
-		ptr<RefCounter> a(new RefCounter);
-		CHECK_EQUAL(1,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,AssignZeroForDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	ptr<RefCounter> a = new RefCounter;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayAutoDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	{
-		array_ptr<RefCounter> a(new RefCounter[20]);
-		CHECK_EQUAL(20,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayAssignZeroForDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	array_ptr<RefCounter> a = new RefCounter[20];
-	CHECK_EQUAL(20,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,AssignNewPointerForDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	ptr<RefCounter> a = new RefCounter;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	a = new RefCounter;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayAssignNewPointerForDeletion)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	array_ptr<RefCounter> a = new RefCounter[37];
-	CHECK_EQUAL(37,RefCounter::s_instances);
-	a = new RefCounter[10];
-	CHECK_EQUAL(10,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,CopyToAnotherSmartPointer)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	ptr<RefCounter> a = new RefCounter;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	ptr<RefCounter> b(a);
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	b = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayCopyToAnotherSmartPointer)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	array_ptr<RefCounter> a = new RefCounter[3];
-	CHECK_EQUAL(3,RefCounter::s_instances);
-	array_ptr<RefCounter> b(a);
-	CHECK_EQUAL(3,RefCounter::s_instances);
-	a = 0;
-	CHECK_EQUAL(3,RefCounter::s_instances);
-	b = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,StlVector)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	
-	std::vector< ptr<RefCounter> > va,vb;
-	{
-		{
-			std::vector< ptr<RefCounter> > vc;
-			vc.push_back(new RefCounter);
-			CHECK_EQUAL(1,RefCounter::s_instances);
-			vc.push_back(new RefCounter);
-			CHECK_EQUAL(2,RefCounter::s_instances);
-			vc.push_back(new RefCounter);
-			CHECK_EQUAL(3,RefCounter::s_instances);
-			vb = vc;
-			CHECK_EQUAL(3,RefCounter::s_instances);
-		}
-		CHECK_EQUAL(3,RefCounter::s_instances);
-		va.push_back(vb[0]);
-		CHECK_EQUAL(3,RefCounter::s_instances);
-		vb.clear();
-		CHECK_EQUAL(1,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	va.clear();
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayStlVector)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	
-	std::vector< array_ptr<RefCounter> > va,vb;
-	{
-		{
-			std::vector< array_ptr<RefCounter> > vc;
-			vc.push_back(new RefCounter[5]);
-			CHECK_EQUAL(5,RefCounter::s_instances);
-			vc.push_back(new RefCounter[3]);
-			CHECK_EQUAL(8,RefCounter::s_instances);
-			vc.push_back(new RefCounter[7]);
-			CHECK_EQUAL(15,RefCounter::s_instances);
-			vb = vc;
-			CHECK_EQUAL(15,RefCounter::s_instances);
-		}
-		CHECK_EQUAL(15,RefCounter::s_instances);
-		va.push_back(vb[0]);
-		CHECK_EQUAL(15,RefCounter::s_instances);
-		vb.clear();
-		CHECK_EQUAL(5,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(5,RefCounter::s_instances);
-	va.clear();
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,StlList)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	
-	std::list< ptr<RefCounter> > la,lb;
-	{
-		{
-			std::list< ptr<RefCounter> > lc;
-			lc.push_back(new RefCounter);
-			CHECK_EQUAL(1,RefCounter::s_instances);
-			lc.push_back(new RefCounter);
-			CHECK_EQUAL(2,RefCounter::s_instances);
-			lc.push_back(new RefCounter);
-			CHECK_EQUAL(3,RefCounter::s_instances);
-			lb = lc;
-			CHECK_EQUAL(3,RefCounter::s_instances);
-		}
-		CHECK_EQUAL(3,RefCounter::s_instances);
-		la.push_back(lb.front());
-		CHECK_EQUAL(3,RefCounter::s_instances);
-		lb.clear();
-		CHECK_EQUAL(1,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	la.clear();
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayStlList)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	
-	std::list< array_ptr<RefCounter> > la,lb;
-	{
-		{
-			std::list< array_ptr<RefCounter> > lc;
-			lc.push_back(new RefCounter[7]);
-			CHECK_EQUAL(7,RefCounter::s_instances);
-			lc.push_back(new RefCounter[8]);
-			CHECK_EQUAL(15,RefCounter::s_instances);
-			lc.push_back(new RefCounter[80]);
-			CHECK_EQUAL(95,RefCounter::s_instances);
-			lb = lc;
-			CHECK_EQUAL(95,RefCounter::s_instances);
-		}
-		CHECK_EQUAL(95,RefCounter::s_instances);
-		la.push_back(lb.front());
-		CHECK_EQUAL(95,RefCounter::s_instances);
-		lb.clear();
-		CHECK_EQUAL(7,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(7,RefCounter::s_instances);
-	la.clear();
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,EqualityOperators)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	RefCounter* xa = new RefCounter;
-	RefCounter* xb = new RefCounter;
-	ptr<RefCounter> pa,pb;
-	if ( xa < xb )
-	{
-		pa = xa;
-		pb = xb;
-	}
-	else
-	{
-		pa = xb;
-		pb = xa;
-	}
-	CHECK_EQUAL(2,RefCounter::s_instances);
-
-	CHECK(pa<pb);
-	CHECK(pb>pa);
-	CHECK(pa<=pa);
-	CHECK(pb>=pb);
-	CHECK(pa<=pa);
-	CHECK(pb>=pb);
-	CHECK(pa==pa);
-	CHECK(pb==pb);
-	CHECK(pa!=pb);
-
-	pa = 0;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	pb = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayEqualityOperators)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	RefCounter* xa = new RefCounter[4];
-	RefCounter* xb = new RefCounter[6];
-	array_ptr<RefCounter> pa,pb;
-	if ( xa < xb )
-	{
-		pa = xa;
-		pb = xb;
-	}
-	else
-	{
-		pa = xb;
-		pb = xa;
-	}
-	CHECK_EQUAL(10,RefCounter::s_instances);
-
-	CHECK(pa<pb);
-	CHECK(pb>pa);
-	CHECK(pa<=pa);
-	CHECK(pb>=pb);
-	CHECK(pa<=pa);
-	CHECK(pb>=pb);
-	CHECK(pa==pa);
-	CHECK(pb==pb);
-	CHECK(pa!=pb);
-
-	pa = 0;
-	CHECK_EQUAL(6,RefCounter::s_instances);
-	pb = 0;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,AccessPointer)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	ptr<RefCounter> a = new RefCounter;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-
-	CHECK_EQUAL(5,(*a).Get(5));
-	CHECK_EQUAL(5,a->Get(5));
-
-	a = 0;
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayAccessPointer)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	array_ptr<RefCounter> a = new RefCounter[6];
-	CHECK_EQUAL(6,RefCounter::s_instances);
-
-	CHECK_EQUAL(5,(*a).Get(5));
-	CHECK_EQUAL(5,a->Get(5));
-	CHECK_EQUAL(5,a[0].Get(5));
-
-	a = 0;
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,BasicInheritance)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	ptr<RefCounter> a = new RefCounterDerived;
-	CHECK_EQUAL(1,RefCounter::s_instances);
-
-	CHECK_EQUAL(10,(*a).Get(5));
-	CHECK_EQUAL(10,a->Get(5));
-
-	a = 0;
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayBasicInheritance)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	array_ptr<RefCounter> a = new RefCounterDerived[2];
-	CHECK_EQUAL(2,RefCounter::s_instances);
-
-	CHECK_EQUAL(10,(*a).Get(5));
-	CHECK_EQUAL(10,a->Get(5));
-
-	a = 0;
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ListOfBasePointers)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	std::vector< ptr<RefCounter> > v;
-
-	v.push_back(new RefCounter);
-	CHECK_EQUAL(1,RefCounter::s_instances);
-
-	v.push_back(new RefCounterDerived);
-	CHECK_EQUAL(2,RefCounter::s_instances);
-
-	v.clear();
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayListOfBasePointers)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	std::vector< array_ptr<RefCounter> > v;
-
-	v.push_back(new RefCounter[5]);
-	CHECK_EQUAL(5,RefCounter::s_instances);
-
-	v.push_back(new RefCounterDerived[2]);
-	CHECK_EQUAL(7,RefCounter::s_instances);
-
-	v.clear();
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,CopyInvalidPointers)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	ptr<RefCounter> a;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	CHECK(!a.valid());
-	ptr<RefCounter> b(a);
-	CHECK(!a.valid());
-	CHECK(!b.valid());
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	b = new RefCounter;
-	CHECK(!a.valid());
-	CHECK(b.valid());
-	CHECK_EQUAL(1,RefCounter::s_instances);
-	b = a;
-	CHECK(!a.valid());
-	CHECK(!b.valid());
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayCopyInvalidPointers)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	array_ptr<RefCounter> a;
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	CHECK(!a.valid());
-	array_ptr<RefCounter> b(a);
-	CHECK(!a.valid());
-	CHECK(!b.valid());
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	b = new RefCounter[3];
-	CHECK(!a.valid());
-	CHECK(b.valid());
-	CHECK_EQUAL(3,RefCounter::s_instances);
-	b = a;
-	CHECK(!a.valid());
-	CHECK(!b.valid());
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,BoolValidityCheck)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	{
-		ptr<RefCounter> a, b(new RefCounter), c;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(!a);
-		CHECK(!a.valid());
-		CHECK(!c);
-		CHECK(!c.valid());
-		CHECK(b);
-		CHECK(b.valid());
-		CHECK(a || b || c);
-		a = b;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(a);
-		CHECK(a.valid());
-		CHECK(b);
-		CHECK(b.valid());
-		CHECK(a || b);
-		CHECK(a && b);
-		b = 0;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(a);
-		CHECK(a.valid());
-		CHECK(!b);
-		CHECK(!b.valid());
-
-		c = new RefCounterDerived;
-		CHECK_EQUAL(2,RefCounter::s_instances);
-		CHECK(c);
-		CHECK(c.valid());
-	}
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayBoolValidityCheck)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-
-	{
-		array_ptr<RefCounter> a, b(new RefCounter[1]), c;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(!a);
-		CHECK(!a.valid());
-		CHECK(!c);
-		CHECK(!c.valid());
-		CHECK(b);
-		CHECK(b.valid());
-		CHECK(a || b || c);
-		a = b;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(a);
-		CHECK(a.valid());
-		CHECK(b);
-		CHECK(b.valid());
-		CHECK(a || b);
-		CHECK(a && b);
-		b = 0;
-		CHECK_EQUAL(1,RefCounter::s_instances);
-		CHECK(a);
-		CHECK(a.valid());
-		CHECK(!b);
-		CHECK(!b.valid());
-
-		c = new RefCounterDerived[1];
-		CHECK_EQUAL(2,RefCounter::s_instances);
-		CHECK(c);
-		CHECK(c.valid());
-	}
-
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,MapMadness)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	{
-		std::map< ptr<RefCounter>, ptr<RefCounter> > m,m1,m2,m3,m4;
-		CHECK_EQUAL(0,RefCounter::s_instances);
-
-		for (int i=0;i<1000;++i)
-		{
-			m[ new RefCounter ] = new RefCounterDerived;
-			CHECK_EQUAL((i+1)*2,RefCounter::s_instances);
-		}
-
-		m1 = m2 = m3 = m4 = m;
-		CHECK_EQUAL(2000,RefCounter::s_instances);
-		m.clear();
-		CHECK_EQUAL(2000,RefCounter::s_instances);
-		m2.clear();
-		CHECK_EQUAL(2000,RefCounter::s_instances);
-		m3.clear();
-		CHECK_EQUAL(2000,RefCounter::s_instances);
-		m4.clear();
-		CHECK_EQUAL(2000,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayMapMadness)
-{
-	CHECK_EQUAL(0,RefCounter::s_instances);
-	{
-		std::map< array_ptr<RefCounter>, array_ptr<RefCounter> > m,m1,m2,m3,m4;
-		CHECK_EQUAL(0,RefCounter::s_instances);
-
-		for (int i=0;i<1000;++i)
-		{
-			m[ new RefCounter[2] ] = new RefCounterDerived[2];
-			CHECK_EQUAL((i+1)*4,RefCounter::s_instances);
-		}
-
-		m1 = m2 = m3 = m4 = m;
-		CHECK_EQUAL(4000,RefCounter::s_instances);
-		m.clear();
-		CHECK_EQUAL(4000,RefCounter::s_instances);
-		m2.clear();
-		CHECK_EQUAL(4000,RefCounter::s_instances);
-		m3.clear();
-		CHECK_EQUAL(4000,RefCounter::s_instances);
-		m4.clear();
-		CHECK_EQUAL(4000,RefCounter::s_instances);
-	}
-	CHECK_EQUAL(0,RefCounter::s_instances);
-}
-
-///////////////////////////////////
-
-TEST_FIXTURE(InstanceFixture,ArrayIndexing)
-{
-	int* p = new int[10];
-	for (int i=0;i<10;++i)
-	{
-		p[i] = i;
-	}
-	array_ptr<int> q = p;
-	for (int i=0;i<10;++i)
-	{
-		CHECK_EQUAL(i,q[i]);
-		CHECK_EQUAL(&(p[i]),&(q[i]));
-	}
-}
-
-///////////////////////////////////
-
-
-int main(int argc, char** argv)
-{
-	return UnitTest::RunAllTests();
-}
-
+// these are the tests of the default build, main_instrumented.cpp builds them
+// again with the optional instrumentation compiled in (and its own tests with
+// it), build and run both
+
+#include <vector>
+#include <list>
+#include <map>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <csignal>
+
+#include "UnitTest++/src/UnitTest++.h"
+
+#include "ptr.h"
+#include "ptr_vector.h"
+#include "ptr_numa.h"
+#include "ptr_hugepage.h"
+#include "ptr_mmap.h"
+#include "ptr_aligned.h"
+#include "ptr_uninitialized.h"
+#include "ptr_simd.h"
+#include "ptr_parallel.h"
+#include "ptr_shm.h"
+#include "ptr_buffer.h"
+#include "ptr_sharded.h"
+#include "ptr_snapshot.h"
+#include "ptr_lazy.h"
+#include "ptr_pmr.h"
+#include "ptr_nonnull.h"
+#include "ptr_map.h"
+#include "ptr_queue.h"
+#include "ptr_teardown.h"
+#include "ptr_cache.h"
+#include "ptr_pool.h"
+
+// a simple class that reference counts itself
+class RefCounter
+{
+	public:
+		RefCounter() { s_instances++; }
+		virtual ~RefCounter() { s_instances--; }
+
+		virtual signed Get(signed x) { return x; }
+
+		static signed s_instances;
+};
+
+signed RefCounter::s_instances = 0;
+
+// and a derived class off of RefCounter (for testing list of base pointers)
+class RefCounterDerived: public RefCounter
+{
+	public:
+		virtual signed Get(signed x) { return x*2; }
+};
+
+
+// a test fixture we need for setup/teardown of each test
+struct InstanceFixture
+{
+	InstanceFixture()
+	{
+		RefCounter::s_instances = 0;
+	}
+	~InstanceFixture()
+	{
+		// empty
+	}
+};
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,AutoDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		ptr<RefCounter> a(new RefCounter);
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,AssignZeroForDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	ptr<RefCounter> a = new RefCounter;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayAutoDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		array_ptr<RefCounter> a(new RefCounter[20]);
+		CHECK_EQUAL(20,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayAssignZeroForDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	array_ptr<RefCounter> a = new RefCounter[20];
+	CHECK_EQUAL(20,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,AssignNewPointerForDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	ptr<RefCounter> a = new RefCounter;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	a = new RefCounter;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayAssignNewPointerForDeletion)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	array_ptr<RefCounter> a = new RefCounter[37];
+	CHECK_EQUAL(37,RefCounter::s_instances);
+	a = new RefCounter[10];
+	CHECK_EQUAL(10,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,CopyToAnotherSmartPointer)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	ptr<RefCounter> a = new RefCounter;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	ptr<RefCounter> b(a);
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	b = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayCopyToAnotherSmartPointer)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	array_ptr<RefCounter> a = new RefCounter[3];
+	CHECK_EQUAL(3,RefCounter::s_instances);
+	array_ptr<RefCounter> b(a);
+	CHECK_EQUAL(3,RefCounter::s_instances);
+	a = 0;
+	CHECK_EQUAL(3,RefCounter::s_instances);
+	b = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,StlVector)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	
+	std::vector< ptr<RefCounter> > va,vb;
+	{
+		{
+			std::vector< ptr<RefCounter> > vc;
+			vc.push_back(new RefCounter);
+			CHECK_EQUAL(1,RefCounter::s_instances);
+			vc.push_back(new RefCounter);
+			CHECK_EQUAL(2,RefCounter::s_instances);
+			vc.push_back(new RefCounter);
+			CHECK_EQUAL(3,RefCounter::s_instances);
+			vb = vc;
+			CHECK_EQUAL(3,RefCounter::s_instances);
+		}
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		va.push_back(vb[0]);
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		vb.clear();
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	va.clear();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayStlVector)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	
+	std::vector< array_ptr<RefCounter> > va,vb;
+	{
+		{
+			std::vector< array_ptr<RefCounter> > vc;
+			vc.push_back(new RefCounter[5]);
+			CHECK_EQUAL(5,RefCounter::s_instances);
+			vc.push_back(new RefCounter[3]);
+			CHECK_EQUAL(8,RefCounter::s_instances);
+			vc.push_back(new RefCounter[7]);
+			CHECK_EQUAL(15,RefCounter::s_instances);
+			vb = vc;
+			CHECK_EQUAL(15,RefCounter::s_instances);
+		}
+		CHECK_EQUAL(15,RefCounter::s_instances);
+		va.push_back(vb[0]);
+		CHECK_EQUAL(15,RefCounter::s_instances);
+		vb.clear();
+		CHECK_EQUAL(5,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(5,RefCounter::s_instances);
+	va.clear();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,StlList)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	
+	std::list< ptr<RefCounter> > la,lb;
+	{
+		{
+			std::list< ptr<RefCounter> > lc;
+			lc.push_back(new RefCounter);
+			CHECK_EQUAL(1,RefCounter::s_instances);
+			lc.push_back(new RefCounter);
+			CHECK_EQUAL(2,RefCounter::s_instances);
+			lc.push_back(new RefCounter);
+			CHECK_EQUAL(3,RefCounter::s_instances);
+			lb = lc;
+			CHECK_EQUAL(3,RefCounter::s_instances);
+		}
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		la.push_back(lb.front());
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		lb.clear();
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	la.clear();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayStlList)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	
+	std::list< array_ptr<RefCounter> > la,lb;
+	{
+		{
+			std::list< array_ptr<RefCounter> > lc;
+			lc.push_back(new RefCounter[7]);
+			CHECK_EQUAL(7,RefCounter::s_instances);
+			lc.push_back(new RefCounter[8]);
+			CHECK_EQUAL(15,RefCounter::s_instances);
+			lc.push_back(new RefCounter[80]);
+			CHECK_EQUAL(95,RefCounter::s_instances);
+			lb = lc;
+			CHECK_EQUAL(95,RefCounter::s_instances);
+		}
+		CHECK_EQUAL(95,RefCounter::s_instances);
+		la.push_back(lb.front());
+		CHECK_EQUAL(95,RefCounter::s_instances);
+		lb.clear();
+		CHECK_EQUAL(7,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(7,RefCounter::s_instances);
+	la.clear();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,EqualityOperators)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	RefCounter* xa = new RefCounter;
+	RefCounter* xb = new RefCounter;
+	ptr<RefCounter> pa,pb;
+	if ( xa < xb )
+	{
+		pa = xa;
+		pb = xb;
+	}
+	else
+	{
+		pa = xb;
+		pb = xa;
+	}
+	CHECK_EQUAL(2,RefCounter::s_instances);
+
+	CHECK(pa<pb);
+	CHECK(pb>pa);
+	CHECK(pa<=pa);
+	CHECK(pb>=pb);
+	CHECK(pa<=pa);
+	CHECK(pb>=pb);
+	CHECK(pa==pa);
+	CHECK(pb==pb);
+	CHECK(pa!=pb);
+
+	pa = 0;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	pb = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayEqualityOperators)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	RefCounter* xa = new RefCounter[4];
+	RefCounter* xb = new RefCounter[6];
+	array_ptr<RefCounter> pa,pb;
+	if ( xa < xb )
+	{
+		pa = xa;
+		pb = xb;
+	}
+	else
+	{
+		pa = xb;
+		pb = xa;
+	}
+	CHECK_EQUAL(10,RefCounter::s_instances);
+
+	CHECK(pa<pb);
+	CHECK(pb>pa);
+	CHECK(pa<=pa);
+	CHECK(pb>=pb);
+	CHECK(pa<=pa);
+	CHECK(pb>=pb);
+	CHECK(pa==pa);
+	CHECK(pb==pb);
+	CHECK(pa!=pb);
+
+	pa = 0;
+	CHECK_EQUAL(6,RefCounter::s_instances);
+	pb = 0;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,AccessPointer)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	ptr<RefCounter> a = new RefCounter;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	CHECK_EQUAL(5,(*a).Get(5));
+	CHECK_EQUAL(5,a->Get(5));
+
+	a = 0;
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayAccessPointer)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	array_ptr<RefCounter> a = new RefCounter[6];
+	CHECK_EQUAL(6,RefCounter::s_instances);
+
+	CHECK_EQUAL(5,(*a).Get(5));
+	CHECK_EQUAL(5,a->Get(5));
+	CHECK_EQUAL(5,a[0].Get(5));
+
+	a = 0;
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,BasicInheritance)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	ptr<RefCounter> a = new RefCounterDerived;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	CHECK_EQUAL(10,(*a).Get(5));
+	CHECK_EQUAL(10,a->Get(5));
+
+	a = 0;
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayBasicInheritance)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	array_ptr<RefCounter> a = new RefCounterDerived[2];
+	CHECK_EQUAL(2,RefCounter::s_instances);
+
+	CHECK_EQUAL(10,(*a).Get(5));
+	CHECK_EQUAL(10,a->Get(5));
+
+	a = 0;
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ListOfBasePointers)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	std::vector< ptr<RefCounter> > v;
+
+	v.push_back(new RefCounter);
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	v.push_back(new RefCounterDerived);
+	CHECK_EQUAL(2,RefCounter::s_instances);
+
+	v.clear();
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayListOfBasePointers)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	std::vector< array_ptr<RefCounter> > v;
+
+	v.push_back(new RefCounter[5]);
+	CHECK_EQUAL(5,RefCounter::s_instances);
+
+	v.push_back(new RefCounterDerived[2]);
+	CHECK_EQUAL(7,RefCounter::s_instances);
+
+	v.clear();
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,CopyInvalidPointers)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	ptr<RefCounter> a;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	CHECK(!a.valid());
+	ptr<RefCounter> b(a);
+	CHECK(!a.valid());
+	CHECK(!b.valid());
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	b = new RefCounter;
+	CHECK(!a.valid());
+	CHECK(b.valid());
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	b = a;
+	CHECK(!a.valid());
+	CHECK(!b.valid());
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayCopyInvalidPointers)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	array_ptr<RefCounter> a;
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	CHECK(!a.valid());
+	array_ptr<RefCounter> b(a);
+	CHECK(!a.valid());
+	CHECK(!b.valid());
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	b = new RefCounter[3];
+	CHECK(!a.valid());
+	CHECK(b.valid());
+	CHECK_EQUAL(3,RefCounter::s_instances);
+	b = a;
+	CHECK(!a.valid());
+	CHECK(!b.valid());
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,BoolValidityCheck)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	{
+		ptr<RefCounter> a, b(new RefCounter), c;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(!a);
+		CHECK(!a.valid());
+		CHECK(!c);
+		CHECK(!c.valid());
+		CHECK(b);
+		CHECK(b.valid());
+		CHECK(a || b || c);
+		a = b;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(a);
+		CHECK(a.valid());
+		CHECK(b);
+		CHECK(b.valid());
+		CHECK(a || b);
+		CHECK(a && b);
+		b = 0;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(a);
+		CHECK(a.valid());
+		CHECK(!b);
+		CHECK(!b.valid());
+
+		c = new RefCounterDerived;
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		CHECK(c);
+		CHECK(c.valid());
+	}
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayBoolValidityCheck)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	{
+		array_ptr<RefCounter> a, b(new RefCounter[1]), c;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(!a);
+		CHECK(!a.valid());
+		CHECK(!c);
+		CHECK(!c.valid());
+		CHECK(b);
+		CHECK(b.valid());
+		CHECK(a || b || c);
+		a = b;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(a);
+		CHECK(a.valid());
+		CHECK(b);
+		CHECK(b.valid());
+		CHECK(a || b);
+		CHECK(a && b);
+		b = 0;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK(a);
+		CHECK(a.valid());
+		CHECK(!b);
+		CHECK(!b.valid());
+
+		c = new RefCounterDerived[1];
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		CHECK(c);
+		CHECK(c.valid());
+	}
+
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,MapMadness)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		std::map< ptr<RefCounter>, ptr<RefCounter> > m,m1,m2,m3,m4;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		for (int i=0;i<1000;++i)
+		{
+			m[ new RefCounter ] = new RefCounterDerived;
+			CHECK_EQUAL((i+1)*2,RefCounter::s_instances);
+		}
+
+		m1 = m2 = m3 = m4 = m;
+		CHECK_EQUAL(2000,RefCounter::s_instances);
+		m.clear();
+		CHECK_EQUAL(2000,RefCounter::s_instances);
+		m2.clear();
+		CHECK_EQUAL(2000,RefCounter::s_instances);
+		m3.clear();
+		CHECK_EQUAL(2000,RefCounter::s_instances);
+		m4.clear();
+		CHECK_EQUAL(2000,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayMapMadness)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		std::map< array_ptr<RefCounter>, array_ptr<RefCounter> > m,m1,m2,m3,m4;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		for (int i=0;i<1000;++i)
+		{
+			m[ new RefCounter[2] ] = new RefCounterDerived[2];
+			CHECK_EQUAL((i+1)*4,RefCounter::s_instances);
+		}
+
+		m1 = m2 = m3 = m4 = m;
+		CHECK_EQUAL(4000,RefCounter::s_instances);
+		m.clear();
+		CHECK_EQUAL(4000,RefCounter::s_instances);
+		m2.clear();
+		CHECK_EQUAL(4000,RefCounter::s_instances);
+		m3.clear();
+		CHECK_EQUAL(4000,RefCounter::s_instances);
+		m4.clear();
+		CHECK_EQUAL(4000,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayIndexing)
+{
+	int* p = new int[10];
+	for (int i=0;i<10;++i)
+	{
+		p[i] = i;
+	}
+	array_ptr<int> q = p;
+	for (int i=0;i<10;++i)
+	{
+		CHECK_EQUAL(i,q[i]);
+		CHECK_EQUAL(&(p[i]),&(q[i]));
+	}
+}
+
+///////////////////////////////////
+
+// copies fine, until it's told how many more copies it gets
+struct CopyThrower
+{
+	CopyThrower() { ++s_live; }
+	CopyThrower(const CopyThrower&)
+	{
+		if ( s_copies-- == 0 )
+		{
+			throw std::runtime_error("no more copies");
+		}
+		++s_live;
+	}
+	~CopyThrower() { --s_live; }
+
+	static int s_live;
+	static int s_copies;
+};
+int CopyThrower::s_live   = 0;
+int CopyThrower::s_copies = 1 << 30;
+
+// made fine, until it's told how many more of it can be made
+struct MakeThrower
+{
+	MakeThrower()
+	{
+		if ( s_makes-- == 0 )
+		{
+			throw std::runtime_error("no more");
+		}
+		++s_live;
+	}
+	~MakeThrower() { --s_live; }
+
+	static std::atomic<int> s_live;
+	static std::atomic<int> s_makes;
+};
+std::atomic<int> MakeThrower::s_live(0);
+std::atomic<int> MakeThrower::s_makes(1 << 30);
+
+TEST_FIXTURE(InstanceFixture,PtrVectorRelocation)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		CHECK(ptr_relocatable< ptr<RefCounter> >::value);
+
+		ptr<RefCounter> first;
+		ptr_vector< ptr<RefCounter> > v;
+		for (int i=0;i<1000;++i)
+		{
+			v.push_back(new RefCounter);
+			CHECK_EQUAL(i+1,RefCounter::s_instances);
+			if ( i == 0 )
+			{
+				first = v[0];
+			}
+		}
+		CHECK(v.capacity() >= 1000);
+		CHECK_EQUAL(1000u,(unsigned)v.size());
+		CHECK(first == v[0]);
+
+		// pushing one of our own elements while growing must still work
+		v.reserve(v.size());
+		v.push_back(v[0]);
+		CHECK_EQUAL(1000,RefCounter::s_instances);
+		CHECK(v.back() == first);
+
+		v.clear();
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		first = 0;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		// anything not marked relocatable takes the copy + destroy path
+		ptr_vector<int> ints;
+		for (int i=0;i<100;++i)
+		{
+			ints.push_back(i);
+		}
+		for (int i=0;i<100;++i)
+		{
+			CHECK_EQUAL(i,ints[i]);
+		}
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// copies that throw, growing or copying the whole vector, leave nothing
+	// behind (and the vector as it was, or holding what it got through)
+	{
+		ptr_vector<CopyThrower> v;
+		for (int i=0;i<4;++i)
+		{
+			v.push_back(CopyThrower());
+		}
+		CHECK_EQUAL(4u,(unsigned)v.capacity());
+		CHECK_EQUAL(4,CopyThrower::s_live);
+
+		CopyThrower::s_copies = 0;
+		CHECK_THROW(v.push_back(CopyThrower()),std::runtime_error);
+		CHECK_EQUAL(4u,(unsigned)v.size());
+		CHECK_EQUAL(4,CopyThrower::s_live);
+
+		ptr_vector<CopyThrower> w;
+		CopyThrower::s_copies = 2;
+		CHECK_THROW(w = v,std::runtime_error);
+		CHECK_EQUAL(2u,(unsigned)w.size());
+		CHECK_EQUAL(6,CopyThrower::s_live);
+
+		CopyThrower::s_copies = 3;
+		CHECK_THROW((void)ptr_vector<CopyThrower>(v),std::runtime_error);
+		CHECK_EQUAL(6,CopyThrower::s_live);
+
+		// and moving the old elements over while growing, or reserving
+		CopyThrower::s_copies = 3;
+		CHECK_THROW(v.push_back(CopyThrower()),std::runtime_error);
+		CHECK_EQUAL(4u,(unsigned)v.size());
+		CHECK_EQUAL(4u,(unsigned)v.capacity());
+		CHECK_EQUAL(6,CopyThrower::s_live);
+		CopyThrower::s_copies = 2;
+		CHECK_THROW(v.reserve(100),std::runtime_error);
+		CHECK_EQUAL(4u,(unsigned)v.capacity());
+		CHECK_EQUAL(6,CopyThrower::s_live);
+		CopyThrower::s_copies = 1 << 30;
+		v.reserve(100);
+		CHECK_EQUAL(4u,(unsigned)v.size());
+		CHECK_EQUAL(6,CopyThrower::s_live);
+	}
+	CHECK_EQUAL(0,CopyThrower::s_live);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArrayPtrVectorRelocation)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		CHECK(ptr_relocatable< array_ptr<RefCounter> >::value);
+
+		ptr_vector< array_ptr<RefCounter> > va,vb;
+		for (int i=0;i<100;++i)
+		{
+			va.push_back(new RefCounter[3]);
+			CHECK_EQUAL((i+1)*3,RefCounter::s_instances);
+		}
+		vb = va;
+		CHECK_EQUAL(300,RefCounter::s_instances);
+		va.clear();
+		CHECK_EQUAL(300,RefCounter::s_instances);
+		va.swap(vb);
+		CHECK_EQUAL(100u,(unsigned)va.size());
+		CHECK(vb.empty());
+		va.pop_back();
+		CHECK_EQUAL(297,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ArraySizeUnknown)
+{
+	array_ptr<int> a;
+	CHECK_EQUAL(0u,(unsigned)a.size());
+	a = new int[10];
+	CHECK_EQUAL(0u,(unsigned)a.size());
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,NumaArrayPlacement)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	CHECK(ptr_numa_nodes() >= 1);
+
+	const numa_placement placements[] = { numa_local, numa_interleave, numa_partition };
+	for (int i=0;i<3;++i)
+	{
+		// (one thread, RefCounter's constructor bumps an unguarded count)
+		array_ptr<RefCounter> a = make_numa_array<RefCounter>(5000,placements[i],1);
+		CHECK(a.valid());
+		CHECK_EQUAL(5000u,(unsigned)a.size());
+		CHECK_EQUAL(5000,RefCounter::s_instances);
+		CHECK_EQUAL(5,a[4999].Get(5));
+
+		array_ptr<RefCounter> b(a);
+		a = 0;
+		CHECK_EQUAL(5000,RefCounter::s_instances);
+		b = 0;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+	}
+
+	// spans several pages and leaves a partial page on the end
+	array_ptr<double> d = make_numa_array<double>(100000,numa_partition,3);
+	CHECK_EQUAL(100000u,(unsigned)d.size());
+	double sum = 0;
+	for (int i=0;i<100000;++i)
+	{
+		sum += d[i];
+		d[i] = i;
+	}
+	CHECK_EQUAL(0.0,sum);
+	CHECK_EQUAL(99999.0,d[99999]);
+
+	CHECK(!make_numa_array<double>(0).valid());
+
+	// too many to address, and elements that throw part way through, on
+	// whichever thread
+	CHECK(!make_numa_array<int>(SIZE_MAX / 2).valid());
+	for (int first=0;first<=60000;first+=30000)
+	{
+		MakeThrower::s_makes = first;
+		CHECK_THROW(make_numa_array<MakeThrower>(100000,numa_partition,4),std::runtime_error);
+		CHECK_EQUAL(0,MakeThrower::s_live.load());
+	}
+	MakeThrower::s_makes = 1 << 30;
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,HugePageArray)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	const huge_pages modes[] = { huge_none, huge_transparent, huge_explicit };
+	for (int i=0;i<3;++i)
+	{
+		array_ptr<RefCounter> a = make_huge_array<RefCounter>(1000,modes[i]);
+		CHECK(a.valid());
+		CHECK_EQUAL(1000u,(unsigned)a.size());
+		CHECK_EQUAL(1000,RefCounter::s_instances);
+		a = 0;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+	}
+
+	// bigger than one huge page, and aligned to one
+	const size_t n = ptr_huge_page_size() / sizeof(int) + 3;
+	array_ptr<int> b = make_huge_array<int>(n);
+	CHECK_EQUAL(0u,(unsigned)(reinterpret_cast<size_t>(&b[0]) % ptr_huge_page_size()));
+	CHECK_EQUAL(0,b[n-1]);
+	b[n-1] = 7;
+	CHECK_EQUAL(7,b[n-1]);
+
+	CHECK(!make_huge_array<int>(0).valid());
+
+	// too many to address, and elements that throw part way through
+	CHECK(!make_huge_array<int>(SIZE_MAX / 2).valid());
+	MakeThrower::s_makes = 3;
+	CHECK_THROW(make_huge_array<MakeThrower>(10),std::runtime_error);
+	CHECK_EQUAL(0,MakeThrower::s_live.load());
+	MakeThrower::s_makes = 1 << 30;
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,MappedFile)
+{
+	// a file of 1000 ints, plus a couple of stray bytes on the end
+	char path[] = "/tmp/ptr_mmap_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	FILE* f = fdopen(fd,"wb");
+	for (int i=0;i<1000;++i)
+	{
+		fwrite(&i,sizeof(i),1,f);
+	}
+	fwrite("xy",2,1,f);
+	fclose(f);
+
+	{
+		array_ptr<const int> a = map_file<int>(path,map_sequential,true);
+		CHECK(a.valid());
+		CHECK_EQUAL(1000u,(unsigned)a.size());
+		for (int i=0;i<1000;++i)
+		{
+			CHECK_EQUAL(i,a[i]);
+		}
+
+		// copy-on-write, the file itself never changes
+		array_ptr<int> b = map_file_private<int>(path,map_random);
+		CHECK_EQUAL(1000u,(unsigned)b.size());
+		b[10] = -1;
+		CHECK_EQUAL(-1,b[10]);
+		CHECK_EQUAL(10,a[10]);
+		array_ptr<int> c = b;
+		b = 0;
+		CHECK_EQUAL(-1,c[10]);
+	}
+	CHECK_EQUAL(10,map_file<int>(path)[10]);
+
+	unlink(path);
+	CHECK(!map_file<int>(path).valid());
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,AlignedArray)
+{
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	{
+		aligned_array_ptr<RefCounter,ptr_cacheline_alignment> a = make_aligned_array<RefCounter,ptr_cacheline_alignment>(10);
+		CHECK_EQUAL(10,RefCounter::s_instances);
+		CHECK_EQUAL(10u,(unsigned)a.size());
+		CHECK_EQUAL(0u,(unsigned)(reinterpret_cast<size_t>(a.data()) % 64));
+		CHECK_EQUAL(5,a[9].Get(5));
+
+		// still an array_ptr<> as far as anyone else is concerned
+		array_ptr<RefCounter> b = a;
+		a = aligned_array_ptr<RefCounter,ptr_cacheline_alignment>();
+		CHECK(!a.data());
+		CHECK_EQUAL(10,RefCounter::s_instances);
+		b = 0;
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		typedef aligned_array_ptr<double,ptr_page_alignment> page_aligned;
+		page_aligned c = make_aligned_array<double,ptr_page_alignment>(3);
+		CHECK_EQUAL(0u,(unsigned)(reinterpret_cast<size_t>(c.data()) % 4096));
+		CHECK_EQUAL(0.0,c[2]);
+		CHECK_EQUAL(4096,(int)page_aligned::alignment);
+
+		c = make_aligned_array<double,ptr_page_alignment>(0);
+		CHECK(!c.valid());
+
+		// too many to address, and elements that throw part way through
+		c = make_aligned_array<double,ptr_page_alignment>(SIZE_MAX / 4);
+		CHECK(!c.valid());
+		MakeThrower::s_makes = 3;
+		CHECK_THROW((make_aligned_array<MakeThrower,64>(10)),std::runtime_error);
+		CHECK_EQUAL(0,MakeThrower::s_live.load());
+		MakeThrower::s_makes = 1 << 30;
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,UninitializedArray)
+{
+	array_ptr<double> a = make_uninitialized_array<double>(1000);
+	CHECK(a.valid());
+	CHECK_EQUAL(1000u,(unsigned)a.size());
+	for (int i=0;i<1000;++i)
+	{
+		a[i] = i;
+	}
+	array_ptr<double> b = a;
+	a = 0;
+	CHECK_EQUAL(999.0,b[999]);
+
+	CHECK(!make_uninitialized_array<double>(0).valid());
+
+	// a size that would wrap around to a few bytes
+	CHECK(!make_uninitialized_array<double>(SIZE_MAX / sizeof(double) + 2).valid());
+	CHECK(!make_zeroed_array<double>(SIZE_MAX / sizeof(double) + 2).valid());
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ZeroedArray)
+{
+	// one from calloc(), one mapped
+	const size_t sizes[] = { 100, 1 << 20 };
+	for (int i=0;i<2;++i)
+	{
+		array_ptr<unsigned> a = make_zeroed_array<unsigned>(sizes[i]);
+		CHECK(a.valid());
+		CHECK_EQUAL((unsigned)sizes[i],(unsigned)a.size());
+		CHECK_EQUAL(0u,a[0]);
+		CHECK_EQUAL(0u,a[sizes[i]-1]);
+		a[sizes[i]-1] = 3;
+		CHECK_EQUAL(3u,a[sizes[i]-1]);
+	}
+
+	CHECK(!make_zeroed_array<unsigned>(0).valid());
+}
+
+///////////////////////////////////
+
+// CHECK()s need the running test's results and details, hence the odd names
+template <typename T>
+static void CheckArrayKernels(UnitTest::TestResults& testResults_, UnitTest::TestDetails const& m_details, size_t n)
+{
+	array_ptr<T> a = make_aligned_array<T,64>(n);
+	array_ptr<T> b = make_uninitialized_array<T>(n);
+
+	array_fill(a,T(3));
+	for (size_t i=0;i<n;++i)
+	{
+		CHECK_EQUAL(T(3),a[i]);
+	}
+
+	array_copy(b,a);
+	CHECK(array_equal(a,b));
+	if ( n )
+	{
+		b[n-1] = T(4);
+		CHECK(!array_equal(a,b));
+		CHECK_EQUAL(n-1,array_find(b,T(4)));
+		b[n/2] = T(4);
+		CHECK_EQUAL(n/2,array_find(b,T(4)));
+	}
+	if ( n >= 3 )
+	{
+		b[n/3] = T(1);
+		CHECK_EQUAL(T(1),array_min(b));
+		CHECK_EQUAL(T(4),array_max(b));
+	}
+	CHECK_EQUAL(n,array_find(a,T(4)));
+	CHECK(!array_equal(a,make_uninitialized_array<T>(n+1)));
+
+	T expected = T(0);
+	array_transform(a,a,[](T x) { return T(x + 1); });
+	for (size_t i=0;i<n;++i)
+	{
+		CHECK_EQUAL(T(4),a[i]);
+		expected += a[i];
+	}
+	CHECK_EQUAL(expected,array_sum(a));
+}
+
+TEST_FIXTURE(InstanceFixture,ArrayKernels)
+{
+	CHECK(array_simd_isa() == simd_generic || array_simd_isa() >= simd_sse2);
+
+	// sizes either side of the vector width, and with tails
+	const size_t sizes[] = { 0, 1, 7, 8, 15, 16, 63, 64, 65, 1000, 4099 };
+	for (size_t i=0;i<sizeof(sizes)/sizeof(sizes[0]);++i)
+	{
+		CheckArrayKernels<unsigned char>(testResults_,m_details,sizes[i]);
+		CheckArrayKernels<short>(testResults_,m_details,sizes[i]);
+		CheckArrayKernels<int>(testResults_,m_details,sizes[i]);
+		CheckArrayKernels<long long>(testResults_,m_details,sizes[i]);
+		CheckArrayKernels<float>(testResults_,m_details,sizes[i]);
+		CheckArrayKernels<double>(testResults_,m_details,sizes[i]);
+	}
+
+	// nothing to see in an array of unknown size
+	array_ptr<int> raw = new int[10];
+	CHECK_EQUAL(0,array_sum(raw));
+
+	// what's only read may be read-only, a mapped file say
+	array_ptr<int> w = make_aligned_array<int,64>(100);
+	array_fill(w,3);
+	char path[] = "/tmp/ptr_simd_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	FILE* f = fdopen(fd,"wb");
+	fwrite(&w[0],sizeof(int),100,f);
+	fclose(f);
+	array_ptr<const int> r = map_file<int>(path);
+	unlink(path);
+	CHECK_EQUAL(300,array_sum(r));
+	CHECK_EQUAL(3,array_min(r));
+	CHECK_EQUAL(3,array_max(r));
+	CHECK_EQUAL(100u,(unsigned)array_find(r,4));
+	CHECK(array_equal(r,w) && array_equal(w,r));
+	array_ptr<int> d = make_aligned_array<int,64>(100);
+	array_copy(d,r);
+	CHECK(array_equal(d,r));
+	array_transform(d,r,[](int x) { return x + 1; });
+	CHECK_EQUAL(400,array_sum(d));
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,ParallelAlgorithms)
+{
+	work_pool pool(3);
+	CHECK_EQUAL(3u,pool.threads());
+
+	const size_t n = 100003;
+	array_ptr<long long> a = make_uninitialized_array<long long>(n);
+	array_ptr<long long> b = make_uninitialized_array<long long>(n);
+
+	// every element exactly once
+	array_fill(a,0LL);
+	parallel_for(a,[](long long& x) { x += 1; },pool);
+	CHECK_EQUAL((long long)n,array_sum(a));
+
+	parallel_transform(b,a,[](long long x) { return x * 3; },pool);
+	CHECK_EQUAL((long long)n*3,parallel_reduce(b,0LL,[](long long s, long long x) { return s + x; },pool));
+
+	// a scrambled permutation sorts back into order
+	for (size_t i=0;i<n;++i)
+	{
+		a[i] = (long long)((i * 7919) % n);
+	}
+	parallel_sort(a,std::less<long long>(),pool);
+	bool sorted = true;
+	for (size_t i=0;i<n;++i)
+	{
+		sorted = sorted && (a[i] == (long long)i);
+	}
+	CHECK(sorted);
+	parallel_sort(a,std::greater<long long>());
+	CHECK_EQUAL((long long)n-1,a[0]);
+
+	// nested jobs make progress too
+	array_ptr<int> outer = make_zeroed_array<int>(64*1024);
+	parallel_for(outer,[&](int& x)
+	{
+		if ( &x == &outer[0] )
+		{
+			x = (int)parallel_reduce(b,0LL,[](long long s, long long v) { return s + v; },pool) / 3;
+		}
+	},pool);
+	CHECK_EQUAL((int)n,outer[0]);
+
+	// the job's reference keeps the buffer alive, and it's gone afterward
+	{
+		array_ptr<RefCounter> r = make_aligned_array<RefCounter,64>(5000);
+		std::atomic<int> total(0);
+		parallel_for(r,[&](RefCounter& x) { total += x.Get(1); },pool);
+		CHECK_EQUAL(5000,total.load());
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// unknown size is empty
+	CHECK_EQUAL(7,parallel_reduce(array_ptr<int>(new int[4]),7,[](int s, int x) { return s + x; }));
+}
+
+///////////////////////////////////
+
+TEST_FIXTURE(InstanceFixture,SharedMemoryArray)
+{
+	char name[64];
+	snprintf(name,sizeof(name),"/ptr_test_%d",(int)getpid());
+
+	{
+		array_ptr<int> a = make_shm_array<int>(name,1000);
+		CHECK(a);
+		CHECK_EQUAL(1000u,a.size());
+		CHECK_EQUAL(0,a[999]);
+
+		// names are taken until the segment is gone
+		CHECK(!make_shm_array<int>(name,10));
+
+		// wrong element size
+		CHECK(!open_shm_array<double>(name));
+
+		// a second mapping sees the same memory, at another address
+		array_ptr<int> b = open_shm_array<int>(name);
+		CHECK(b);
+		CHECK_EQUAL(1000u,b.size());
+		CHECK(&a[0] != &b[0]);
+		a[10] = 42;
+		CHECK_EQUAL(42,b[10]);
+
+		// another process writes, and we see it
+		pid_t child = fork();
+		if ( child == 0 )
+		{
+			array_ptr<int> c = open_shm_array<int>(name);
+			const bool     opened = c;
+			if ( opened )
+			{
+				c[20] = c[10] + 1;
+			}
+			c = 0;
+			_exit(opened ? 0 : 1);
+		}
+		int status = -1;
+		waitpid(child,&status,0);
+		CHECK_EQUAL(0,status);
+		CHECK_EQUAL(43,a[20]);
+
+		// dropping one of ours keeps it open
+		a = 0;
+		array_ptr<int> d = open_shm_array<int>(name);
+		CHECK(d);
+		CHECK_EQUAL(43,d[20]);
+	}
+
+	// last one out unlinked it
+	CHECK(!open_shm_array<int>(name));
+	CHECK(make_shm_array<int>(name,1));
+	CHECK(!open_shm_array<int>(name));
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,ByteBufferSlicing)
+{
+	const char* text = "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n";
+	array_ptr<char> raw = make_uninitialized_array<char>(256);
+	memcpy(&raw[0],text,strlen(text));
+
+	byte_buffer message(raw,strlen(text));
+	CHECK_EQUAL(strlen(text),message.size());
+	CHECK(message.starts_with("GET "));
+	CHECK(&raw[0] == message.data());
+
+	// slices point into the same bytes
+	byte_buffer line = message.split("\r\n");
+	CHECK(line == "GET /index.html HTTP/1.1");
+	CHECK(line.shares(message));
+	CHECK(&raw[0] == line.data());
+	CHECK(message.starts_with("Host:"));
+
+	byte_buffer method  = line.split(' ');
+	byte_buffer path    = line.split(' ');
+	byte_buffer version = line.split(' ');
+	CHECK(method == "GET");
+	CHECK(path == "/index.html");
+	CHECK(version == "HTTP/1.1");
+	CHECK(line.empty());
+	CHECK(&raw[4] == path.data());
+
+	// searching
+	CHECK_EQUAL(4u,message.find(':'));
+	CHECK_EQUAL(6u,message.find("example"));
+	CHECK_EQUAL(byte_buffer::npos,message.find("example",7));
+	CHECK_EQUAL(byte_buffer::npos,message.find('x',1000));
+	CHECK_EQUAL(byte_buffer::npos,message.find("\r\n\r\n\r\n"));
+	CHECK_EQUAL(message.find(byte_buffer("com")),message.find("com"));
+
+	// substr clamps, and the rest narrows
+	byte_buffer host = message.substr(6,11);
+	CHECK(host == "example.com");
+	CHECK(host.substr(8) == "com");
+	CHECK(host.substr(8,100) == "com");
+	CHECK(host.substr(11).empty());
+	host.remove_prefix(1);
+	host.remove_suffix(4);
+	CHECK(host == "xample");
+	CHECK_EQUAL('x',host[0]);
+	CHECK_EQUAL(std::string("xample"),host.str());
+
+	// slices outlive everything they came from
+	raw     = 0;
+	message = byte_buffer();
+	CHECK(path == "/index.html");
+	CHECK(method != path);
+
+	// copies have buffers of their own
+	byte_buffer copy("/index.html");
+	CHECK(copy == path);
+	CHECK(!copy.shares(path));
+	CHECK(byte_buffer().empty());
+	CHECK(byte_buffer() == "");
+	CHECK(byte_buffer("").empty());
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,ShardedPtr)
+{
+	sharded_ptr<RefCounter> global(new RefCounter);
+	CHECK(global);
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	// lots of copies on lots of threads, none of them the last
+	std::vector<std::thread> threads;
+	for (int t=0;t<4;++t)
+	{
+		threads.push_back(std::thread([&]()
+		{
+			for (int i=0;i<10000;++i)
+			{
+				sharded_ptr<RefCounter> a = global;
+				sharded_ptr<RefCounter> b;
+				b = a;
+				a = sharded_ptr<RefCounter>();
+				b->Get(i);
+			}
+		}));
+	}
+	for (size_t t=0;t<threads.size();++t)
+	{
+		threads[t].join();
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	// every handle gone, but not retired, so it's still there
+	sharded_ptr<RefCounter> keep = global;
+	global = sharded_ptr<RefCounter>();
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	// retired while another thread still has a copy, which goes last
+	std::atomic<bool> go(false);
+	sharded_ptr<RefCounter> other = keep;
+	std::thread holder([&go](sharded_ptr<RefCounter> mine)
+	{
+		while ( !go )
+		{
+			std::this_thread::yield();
+		}
+		sharded_ptr<RefCounter> copy = mine;
+		mine = sharded_ptr<RefCounter>();
+		copy->Get(1);
+	},other);
+	other = sharded_ptr<RefCounter>();
+
+	CHECK(keep == keep);
+	keep.retire();
+	CHECK(!keep);
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	go = true;
+	holder.join();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// retired straight away, the only handle goes with it
+	sharded_ptr<RefCounter> once(new RefCounter);
+	sharded_ptr<RefCounter> twice = once;
+	once.retire();
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	twice.retire();
+	CHECK_EQUAL(0,RefCounter::s_instances);
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,ImmortalPtr)
+{
+	RefCounter forever;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	{
+		ptr<RefCounter> p = make_immortal(&forever);
+		CHECK(p);
+		CHECK(p.valid());
+		CHECK_EQUAL(2,p->Get(2));
+
+		// copies come and go, nobody deletes it
+		std::vector< ptr<RefCounter> > copies(100,p);
+		ptr<RefCounter> q = p;
+		CHECK(q == p);
+		q = 0;
+		CHECK(!q);
+		copies.clear();
+		CHECK_EQUAL(1,RefCounter::s_instances);
+
+		// an ordinary pointer assigned over an immortal one (and back) counts
+		// as usual
+		q = make_immortal(&forever);
+		q = new RefCounter;
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		q = p;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+	static int table[4] = { 1, 2, 3, 4 };
+	array_ptr<int> a = make_immortal_array(table);
+	array_ptr<int> b = a;
+	CHECK_EQUAL(3,b[2]);
+	CHECK_EQUAL(0u,b.size());
+	a = 0;
+	b = 0;
+	CHECK_EQUAL(4,table[3]);
+
+	// null stays null
+	CHECK(!make_immortal((RefCounter*)0));
+}
+
+///////////////////////////////////
+
+
+// a graph node for the snapshot tests
+struct SnapshotNode
+{
+	SnapshotNode() : id(0) { }
+
+	int                   id;
+	ptr<SnapshotNode>     left;
+	ptr<SnapshotNode>     right;
+	array_ptr<double>     weights;
+	ptr<RefCounter>       counter;
+};
+
+void ptr_snapshot(ptr_writer& w, const SnapshotNode& n)
+{
+	w.write(n.id);
+	w.write(n.left);
+	w.write(n.right);
+	w.write(n.weights);
+	w.write(n.counter ? n.counter->Get(1) : 0);
+}
+
+void ptr_restore(ptr_reader& r, SnapshotNode& n)
+{
+	int counter = 0;
+	r.read(n.id);
+	r.read(n.left);
+	r.read(n.right);
+	r.read(n.weights);
+	r.read(counter);
+	if ( counter )
+	{
+		n.counter = new RefCounter;
+	}
+}
+
+// an object reached through two of its bases, which sit at different addresses
+struct SnapshotLeft
+{
+	SnapshotLeft() : left(0) { }
+	virtual ~SnapshotLeft() { }
+	int left;
+};
+
+struct SnapshotRight
+{
+	SnapshotRight() : right(0) { }
+	virtual ~SnapshotRight() { }
+	int right;
+};
+
+struct SnapshotBoth: public SnapshotLeft, public SnapshotRight
+{
+};
+
+void ptr_snapshot(ptr_writer& w, const SnapshotRight& n)
+{
+	w.write(n.right);
+}
+
+void ptr_restore(ptr_reader& r, SnapshotRight& n)
+{
+	r.read(n.right);
+}
+
+void ptr_snapshot(ptr_writer& w, const SnapshotBoth& n)
+{
+	w.write(n.left);
+	w.write(n.right);
+}
+
+void ptr_restore(ptr_reader& r, SnapshotBoth& n)
+{
+	r.read(n.left);
+	r.read(n.right);
+}
+
+TEST_FIXTURE(InstanceFixture,SnapshotRestore)
+{
+	std::stringstream stream;
+
+	{
+		// a diamond: root -> a, b, both pointing at shared, which shares its
+		// weights with root
+		ptr<SnapshotNode> shared = new SnapshotNode;
+		shared->id      = 3;
+		shared->weights = make_uninitialized_array<double>(1000);
+		shared->counter = new RefCounter;
+		for (size_t i=0;i<1000;++i)
+		{
+			shared->weights[i] = double(i) * 0.5;
+		}
+
+		ptr<SnapshotNode> root = new SnapshotNode;
+		root->id          = 0;
+		root->left        = new SnapshotNode;
+		root->left->id    = 1;
+		root->left->left  = shared;
+		root->right       = new SnapshotNode;
+		root->right->id   = 2;
+		root->right->left = shared;
+		root->weights     = shared->weights;
+
+		// the same array of pointers twice, and a plain value
+		array_ptr< ptr<SnapshotNode> > sized = make_aligned_array<ptr<SnapshotNode>,64>(3);
+		sized[0] = root;
+		sized[1] = shared;
+
+		ptr_writer w(stream);
+		w.write(root);
+		w.write(sized);
+		w.write(sized);
+		w.write(42);
+		CHECK(w.good());
+		CHECK_EQUAL(6u,w.objects());
+
+		// unknown size can't be written
+		std::stringstream other;
+		ptr_writer bad(other);
+		bad.write(array_ptr<int>(new int[3]));
+		CHECK(!bad.good());
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	{
+		ptr_reader r(stream);
+		ptr<SnapshotNode>              root;
+		array_ptr< ptr<SnapshotNode> > first, second;
+		int                            value = 0;
+		r.read(root);
+		r.read(first);
+		r.read(second);
+		r.read(value);
+		CHECK(r.good());
+		CHECK_EQUAL(6u,r.objects());
+		CHECK_EQUAL(42,value);
+
+		// the same shape, sharing and all
+		CHECK_EQUAL(1,root->left->id);
+		CHECK_EQUAL(2,root->right->id);
+		CHECK(root->left->left == root->right->left);
+		CHECK(!root->left->right);
+		ptr<SnapshotNode> shared = root->left->left;
+		CHECK_EQUAL(3,shared->id);
+		CHECK(shared->weights == root->weights);
+		CHECK_EQUAL(1000u,shared->weights.size());
+		CHECK_EQUAL(499.5,shared->weights[999]);
+		CHECK_EQUAL(1,RefCounter::s_instances);
+
+		CHECK(first == second);
+		CHECK_EQUAL(3u,first.size());
+		CHECK(first[0] == root);
+		CHECK(first[1] == shared);
+		CHECK(!first[2]);
+
+		// nothing more to read
+		int more = 0;
+		r.read(more);
+		CHECK(!r.good());
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// reading back as something else fails
+	{
+		std::stringstream again;
+		ptr<int> one = new int(7);
+		ptr_writer w(again);
+		w.write(one);
+		w.write(one);
+		w.flush();
+
+		ptr_reader r(again);
+		ptr<int>   a;
+		ptr<float> b;
+		r.read(a);
+		CHECK_EQUAL(7,*a);
+		r.read(b);
+		CHECK(!b);
+		CHECK(!r.good());
+	}
+
+	// one object through two of its bases is still one object
+	{
+		std::stringstream again;
+		{
+			ptr<SnapshotBoth> both = new SnapshotBoth;
+			both->left  = 1;
+			both->right = 2;
+			ptr<SnapshotRight> right(static_cast<SnapshotRight*>(both.operator->()), both.counter());
+			CHECK(static_cast<void*>(right.operator->()) != static_cast<void*>(both.operator->()));
+
+			ptr_writer w(again);
+			w.write(both);
+			w.write(right);
+			w.write(right);
+			CHECK(w.good());
+			CHECK_EQUAL(1u,w.objects());
+		}
+
+		ptr<SnapshotRight> right;
+		{
+			ptr_reader         r(again);
+			ptr<SnapshotBoth>  both;
+			ptr<SnapshotRight> second;
+			r.read(both);
+			r.read(right);
+			r.read(second);
+			CHECK(r.good());
+			CHECK_EQUAL(1u,r.objects());
+			CHECK(right == second);
+			CHECK(right.counter() == both.counter());
+			CHECK(right.operator->() == static_cast<SnapshotRight*>(both.operator->()));
+			CHECK_EQUAL(1,both->left);
+			CHECK_EQUAL(2,right->right);
+		}
+
+		// the last one left is the base, the whole object goes with it
+		CHECK_EQUAL(2,right->right);
+		right = 0;
+
+		// but a base can't be read back as what it's part of
+		std::stringstream other;
+		{
+			ptr<SnapshotRight> alone = new SnapshotRight;
+			ptr_writer w(other);
+			w.write(alone);
+			w.write(alone);
+		}
+		ptr_reader         r(other);
+		ptr<SnapshotRight> alone;
+		ptr<SnapshotBoth>  both;
+		r.read(alone);
+		r.read(both);
+		CHECK(alone);
+		CHECK(!both);
+		CHECK(!r.good());
+	}
+
+	// a corrupt array length fails rather than allocating it
+	{
+		const uint64_t lengths[] = { uint64_t(1) << 40, uint64_t(SIZE_MAX / sizeof(double)) + 1, UINT64_MAX };
+		for (size_t i=0;i<3;++i)
+		{
+			std::stringstream corrupt;
+			{
+				ptr_writer w(corrupt);
+				w.write(uint8_t(2));
+				w.write(lengths[i]);
+				w.write(1.0);
+			}
+			ptr_reader        r(corrupt);
+			array_ptr<double> a;
+			r.read(a);
+			CHECK(!a);
+			CHECK(!r.good());
+			CHECK_EQUAL(0u,r.objects());
+		}
+
+		std::stringstream corrupt;
+		{
+			ptr_writer w(corrupt);
+			w.write(uint8_t(2));
+			w.write(UINT64_MAX);
+		}
+		ptr_reader                     r(corrupt);
+		array_ptr< ptr<SnapshotNode> > a;
+		r.read(a);
+		CHECK(!a);
+		CHECK(!r.good());
+	}
+
+	// the stream is left just past the snapshot
+	{
+		std::stringstream mixed;
+		{
+			ptr_writer w(mixed);
+			w.write(ptr<int>(new int(5)));
+		}
+		mixed << "after";
+		{
+			ptr_reader r(mixed);
+			ptr<int>   five;
+			r.read(five);
+			CHECK_EQUAL(5,*five);
+		}
+		std::string rest;
+		mixed >> rest;
+		CHECK_EQUAL(std::string("after"),rest);
+	}
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,LazyPtr)
+{
+	std::atomic<int> builds(0);
+
+	{
+		lazy_ptr<RefCounter> lazy([&builds]() -> ptr<RefCounter>
+		{
+			builds++;
+			return new RefCounterDerived;
+		});
+		CHECK(!lazy.built());
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		// lots of threads all get there at once, only one builds it
+		std::atomic<int>         total(0);
+		std::vector<std::thread> threads;
+		for (int t=0;t<4;++t)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				for (int i=0;i<1000;++i)
+				{
+					total += lazy->Get(1);
+				}
+			}));
+		}
+		for (size_t t=0;t<threads.size();++t)
+		{
+			threads[t].join();
+		}
+		CHECK(lazy.built());
+		CHECK_EQUAL(1,builds.load());
+		CHECK_EQUAL(8000,total.load());
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK_EQUAL(4,(*lazy).Get(2));
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// a factory that throws gets another go
+	int attempts = 0;
+	lazy_ptr<int> flaky([&attempts]() -> ptr<int>
+	{
+		if ( ++attempts == 1 )
+		{
+			throw std::runtime_error("not yet");
+		}
+		return new int(42);
+	});
+	bool threw = false;
+	try
+	{
+		*flaky;
+	}
+	catch ( const std::runtime_error& )
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	CHECK(!flaky.built());
+	CHECK_EQUAL(42,*flaky);
+	CHECK_EQUAL(2,attempts);
+	CHECK_EQUAL(42,*flaky);
+	CHECK_EQUAL(2,attempts);
+
+	// the factory may hand back any sort of ptr<>
+	static int s_fixed = 7;
+	lazy_ptr<int> fixed([]() { return make_immortal(&s_fixed); });
+	CHECK(!fixed.built());
+	CHECK_EQUAL(7,*fixed);
+	CHECK(fixed.operator->() == &s_fixed);
+}
+
+///////////////////////////////////
+
+
+// a memory resource that counts what goes through it
+class CountingResource : public std::pmr::memory_resource
+{
+	public:
+		CountingResource() : allocations(0), deallocations(0), outstanding(0) {}
+
+		int    allocations;
+		int    deallocations;
+		size_t outstanding;
+
+	private:
+		virtual void* do_allocate(size_t bytes, size_t alignment)
+		{
+			allocations++;
+			outstanding += bytes;
+			return std::pmr::new_delete_resource()->allocate(bytes,alignment);
+		}
+		virtual void do_deallocate(void* p, size_t bytes, size_t alignment)
+		{
+			deallocations++;
+			outstanding -= bytes;
+			std::pmr::new_delete_resource()->deallocate(p,bytes,alignment);
+		}
+		virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+		{
+			return this == &other;
+		}
+};
+
+struct alignas(64) WideAligned
+{
+	WideAligned() : x(3) {}
+	int x;
+};
+
+struct ThrowsOnThird
+{
+	ThrowsOnThird()
+	{
+		if ( ++s_built == 3 )
+		{
+			throw std::runtime_error("third");
+		}
+		s_alive++;
+	}
+	~ThrowsOnThird() { s_alive--; }
+
+	static int s_built;
+	static int s_alive;
+};
+
+int ThrowsOnThird::s_built = 0;
+int ThrowsOnThird::s_alive = 0;
+
+TEST_FIXTURE(InstanceFixture,PmrFactories)
+{
+	CountingResource resource;
+
+	{
+		// one allocation for the object and its counter, given back on the last drop
+		ptr<RefCounterDerived> a = make_pmr<RefCounterDerived>(&resource);
+		CHECK_EQUAL(1,resource.allocations);
+		CHECK_EQUAL(0u,a.size());
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		CHECK_EQUAL(4,a->Get(2));
+
+		ptr<RefCounterDerived> b = a;
+		a = 0;
+		CHECK_EQUAL(0,resource.deallocations);
+		b = 0;
+		CHECK_EQUAL(1,resource.deallocations);
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		// constructor arguments are passed along
+		ptr<std::string> s = make_pmr<std::string>(&resource,5,'x');
+		CHECK(*s == "xxxxx");
+
+		// arrays know their size, and are value-initialized
+		array_ptr<int> ints = make_pmr_array<int>(&resource,100);
+		CHECK_EQUAL(100u,ints.size());
+		for (int i=0;i<100;++i)
+		{
+			CHECK_EQUAL(0,ints[i]);
+		}
+		array_ptr<RefCounter> objects = make_pmr_array<RefCounter>(&resource,10);
+		CHECK_EQUAL(10,RefCounter::s_instances);
+		CHECK_EQUAL(4,resource.allocations);
+
+		// over-aligned types keep their alignment
+		ptr<WideAligned>       w  = make_pmr<WideAligned>(&resource);
+		array_ptr<WideAligned> ws = make_pmr_array<WideAligned>(&resource,3);
+		CHECK_EQUAL(0u,uintptr_t(w.operator->()) % 64);
+		CHECK_EQUAL(0u,uintptr_t(&ws[0]) % 64);
+		CHECK_EQUAL(3,ws[2].x);
+
+		// empty arrays don't allocate
+		CHECK(!make_pmr_array<int>(&resource,0));
+		CHECK_EQUAL(6,resource.allocations);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	CHECK_EQUAL(resource.allocations,resource.deallocations);
+	CHECK_EQUAL(0u,resource.outstanding);
+
+	// a throwing constructor gives its memory back
+	bool threw = false;
+	try
+	{
+		make_pmr_array<ThrowsOnThird>(&resource,5);
+	}
+	catch ( const std::runtime_error& )
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	CHECK_EQUAL(0,ThrowsOnThird::s_alive);
+	CHECK_EQUAL(resource.allocations,resource.deallocations);
+
+	// a per-request arena
+	{
+		char                                buffer[4096];
+		std::pmr::monotonic_buffer_resource arena(buffer,sizeof(buffer),&resource);
+		{
+			ptr<RefCounter>  r = make_pmr<RefCounter>(&arena);
+			array_ptr<char>  c = make_pmr_array<char>(&arena,100);
+			CHECK(uintptr_t(r.operator->()) >= uintptr_t(buffer) && uintptr_t(r.operator->()) < uintptr_t(buffer + sizeof(buffer)));
+			CHECK_EQUAL(1,RefCounter::s_instances);
+		}
+		CHECK_EQUAL(0,RefCounter::s_instances);
+		CHECK_EQUAL(0u,resource.outstanding);
+	}
+
+	// and a pool, which recycles what's given back
+	{
+		std::pmr::unsynchronized_pool_resource pool(&resource);
+		void* first = make_pmr<int>(&pool,1).operator->();
+		void* again = make_pmr<int>(&pool,2).operator->();
+		CHECK(first == again);
+	}
+	CHECK_EQUAL(0u,resource.outstanding);
+
+	// null means the default resource
+	std::pmr::memory_resource* previous = std::pmr::set_default_resource(&resource);
+	const int before = resource.allocations;
+	{
+		ptr<int> d = make_pmr<int>(0,9);
+		CHECK_EQUAL(9,*d);
+		CHECK_EQUAL(before + 1,resource.allocations);
+	}
+	std::pmr::set_default_resource(previous);
+	CHECK_EQUAL(0u,resource.outstanding);
+}
+
+///////////////////////////////////
+
+
+#if defined(PTR_PROFILE)
+static __attribute__((noinline)) array_ptr<double> ProfiledAllocation(size_t n)
+{
+	return make_zeroed_array<double>(n);
+}
+
+TEST_FIXTURE(InstanceFixture,HeapProfile)
+{
+	const size_t previous     = ptr_profile_rate();
+	const size_t before       = ptr_profile_live_samples();
+	const size_t bytes_before = ptr_profile_live_bytes();
+
+	// sample (just about) every byte
+	ptr_profile_set_rate(1);
+	CHECK_EQUAL(1u,ptr_profile_rate());
+	{
+		std::vector< array_ptr<double> > arrays;
+		for (int i=0;i<2;++i)
+		{
+			arrays.push_back(ProfiledAllocation(4096));
+		}
+		CHECK_EQUAL(before + 2,ptr_profile_live_samples());
+		CHECK_EQUAL(bytes_before + 2 * 4096 * sizeof(double),ptr_profile_live_bytes());
+
+		// copies aren't new objects
+		array_ptr<double> copy = arrays[0];
+		CHECK_EQUAL(before + 2,ptr_profile_live_samples());
+
+		// other threads sample too
+		array_ptr<double> theirs;
+		std::thread t([&theirs]() { theirs = ProfiledAllocation(1024); });
+		t.join();
+		CHECK_EQUAL(before + 3,ptr_profile_live_samples());
+
+		std::ostringstream text;
+		ptr_profile_write_text(text);
+		CHECK_EQUAL(0u,text.str().find("ptr<> heap profile: "));
+		CHECK(text.str().find("\n8192 bytes in 1 objects (1 samples) of double\n") != std::string::npos);
+
+		std::ostringstream pprof;
+		ptr_profile_write_pprof(pprof);
+		CHECK_EQUAL(0u,pprof.str().find("heap profile: "));
+		CHECK(pprof.str().find("@ heap_v2/1\n") != std::string::npos);
+		CHECK(pprof.str().find("\n1: 8192 [1: 8192] @ 0x") != std::string::npos);
+		CHECK(pprof.str().find("\nMAPPED_LIBRARIES:\n") != std::string::npos);
+	}
+	CHECK_EQUAL(before,ptr_profile_live_samples());
+
+	// turned off, nothing's sampled
+	ptr_profile_set_rate(0);
+	{
+		array_ptr<double> a = ProfiledAllocation(4096);
+		CHECK_EQUAL(before,ptr_profile_live_samples());
+	}
+
+	ptr_profile_set_rate(previous);
+}
+#endif // defined(PTR_PROFILE)
+
+///////////////////////////////////
+
+
+#if defined(PTR_LIFETIMES)
+struct ShortLived { int x; };
+struct LongLived  { int x; };
+
+static const ptr_lifetime_stats* FindLifetimes(const std::vector<ptr_lifetime_stats>& all, const std::type_info& type)
+{
+	for (size_t i=0;i<all.size();++i)
+	{
+		if ( *all[i].type == type )
+		{
+			return &all[i];
+		}
+	}
+	return 0;
+}
+
+TEST_FIXTURE(InstanceFixture,ObjectLifetimes)
+{
+	ptr_lifetimes_reset();
+
+	for (int i=0;i<1000;++i)
+	{
+		ptr<ShortLived> p(new ShortLived);
+		ptr<ShortLived> copy = p; // only the last release counts
+	}
+	{
+		array_ptr<LongLived> a(new LongLived[4]);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	// immortal pointers are never released, so never counted
+	static LongLived s_forever;
+	make_immortal(&s_forever);
+
+	std::vector<ptr_lifetime_stats> all = ptr_lifetimes();
+	const ptr_lifetime_stats* shorter = FindLifetimes(all,typeid(ShortLived));
+	const ptr_lifetime_stats* longer  = FindLifetimes(all,typeid(LongLived));
+	CHECK(shorter && longer);
+	if ( shorter && longer )
+	{
+		CHECK_EQUAL(1000u,shorter->released);
+		CHECK(shorter->mean < 0.001);
+		uint64_t total = 0;
+		for (size_t i=0;i<ptr_lifetime_buckets;++i)
+		{
+			total += shorter->buckets[i];
+		}
+		CHECK_EQUAL(1000u,total);
+
+		// the long one is in the bucket that holds 20ms (give or take the
+		// clock's timing)
+		CHECK_EQUAL(1u,longer->released);
+		CHECK(longer->mean >= 0.015 && longer->mean < 1.0);
+		for (size_t i=0;i<ptr_lifetime_buckets;++i)
+		{
+			if ( longer->buckets[i] )
+			{
+				CHECK(ptr_lifetime_bucket(i) <= longer->mean && longer->mean < ptr_lifetime_bucket(i + 1));
+			}
+		}
+	}
+
+	std::ostringstream text;
+	ptr_lifetimes_write(text);
+	CHECK(text.str().find("\nShortLived: 1000 released, mean ") != std::string::npos);
+	CHECK(text.str().find("\nLongLived: 1 released, mean ") != std::string::npos);
+
+	ptr_lifetimes_reset();
+	all     = ptr_lifetimes();
+	shorter = FindLifetimes(all,typeid(ShortLived));
+	CHECK(shorter && shorter->released == 0);
+}
+#endif // defined(PTR_LIFETIMES)
+
+///////////////////////////////////
+
+
+#if defined(PTR_CONTENTION)
+TEST_FIXTURE(InstanceFixture,ContentionDetector)
+{
+	ptr_contention_reset();
+
+	ptr<RefCounter> hot(new RefCounter);
+	ptr<int>        cold(new int(1));
+
+	// handed back and forth, each turn it's counted by the other thread and
+	// then by this one again
+	for (int i=0;i<5;++i)
+	{
+		std::thread t([&hot]() { ptr<RefCounter> theirs = hot; });
+		t.join();
+		ptr<RefCounter> mine = hot;
+	}
+	{
+		ptr<int> copy = cold;
+	}
+
+	std::vector<ptr_contention_object> top = ptr_contention_top(10);
+	CHECK_EQUAL(1u,top.size());
+	if ( !top.empty() )
+	{
+		CHECK(top[0].type && *top[0].type == typeid(RefCounter));
+		CHECK_EQUAL(10u,top[0].migrations);
+	}
+
+	std::ostringstream text;
+	ptr_contention_write(text);
+	CHECK(text.str().find("          10  ") != std::string::npos);
+	CHECK(text.str().find("RefCounter\n") != std::string::npos);
+	CHECK(text.str().find(" int\n") == std::string::npos);
+
+	// released, it's still in its type's totals
+	hot = 0;
+	CHECK(ptr_contention_top(10).empty());
+	std::vector<ptr_contention_type> types = ptr_contention_types();
+	CHECK_EQUAL(1u,types.size());
+	if ( !types.empty() )
+	{
+		CHECK(types[0].type && *types[0].type == typeid(RefCounter));
+		CHECK_EQUAL(1u,types[0].objects);
+		CHECK_EQUAL(10u,types[0].migrations);
+	}
+
+	ptr_contention_reset();
+	CHECK(ptr_contention_types().empty());
+}
+#endif // defined(PTR_CONTENTION)
+
+///////////////////////////////////
+
+
+// an object that carries its own count
+class IntrusiveCounter : public ptr_intrusive_base
+{
+	public:
+		IntrusiveCounter() : value(0) { s_instances++; }
+		IntrusiveCounter(const IntrusiveCounter& other) : ptr_intrusive_base(other), value(other.value) { s_instances++; }
+		~IntrusiveCounter() { s_instances--; }
+
+		int value;
+
+		static int s_instances;
+};
+
+int IntrusiveCounter::s_instances = 0;
+
+TEST_FIXTURE(InstanceFixture,PolicyPtr)
+{
+	// ptr<> and array_ptr<> are basic_ptr<>s
+	CHECK((std::is_same< ptr<int>, basic_ptr<int,ptr_unsynchronized,ptr_delete,ptr_separate> >::value));
+	CHECK((std::is_same< array_ptr<int>, basic_ptr<int,ptr_unsynchronized,ptr_delete_array,ptr_separate> >::value));
+	CHECK_EQUAL(2*sizeof(void*),sizeof(ptr<int>));
+
+	// intrusive ones are a single pointer, with the count in the object
+	typedef basic_ptr<IntrusiveCounter,ptr_unsynchronized,ptr_delete,ptr_intrusive> intrusive;
+	CHECK_EQUAL(sizeof(void*),sizeof(intrusive));
+	CHECK(ptr_relocatable<intrusive>::value);
+	{
+		IntrusiveCounter* raw = new IntrusiveCounter;
+		intrusive a = raw;
+		intrusive b = a;
+		intrusive c = raw; // the count's in the object, so this is just another reference
+		CHECK_EQUAL(1,IntrusiveCounter::s_instances);
+		CHECK(a == c);
+		a = 0;
+		b = 0;
+		CHECK_EQUAL(1,IntrusiveCounter::s_instances);
+
+		// a copy of the object is a new object, counted separately
+		intrusive d = new IntrusiveCounter(*c);
+		CHECK_EQUAL(2,IntrusiveCounter::s_instances);
+		c = 0;
+		CHECK_EQUAL(1,IntrusiveCounter::s_instances);
+
+		// and const objects work too
+		basic_ptr<const IntrusiveCounter,ptr_unsynchronized,ptr_delete,ptr_intrusive> e = new IntrusiveCounter;
+		CHECK_EQUAL(0,e->value);
+	}
+	CHECK_EQUAL(0,IntrusiveCounter::s_instances);
+
+	// synchronized ones may be copied by several threads at once
+	typedef basic_ptr<RefCounter,ptr_synchronized> synchronized;
+	{
+		synchronized             shared = new RefCounterDerived;
+		std::atomic<int>         total(0);
+		std::vector<std::thread> threads;
+		for (int t=0;t<4;++t)
+		{
+			threads.push_back(std::thread([&shared,&total]()
+			{
+				for (int i=0;i<10000;++i)
+				{
+					synchronized copy = shared;
+					total += copy->Get(1);
+				}
+			}));
+		}
+		for (size_t t=0;t<threads.size();++t)
+		{
+			threads[t].join();
+		}
+		CHECK_EQUAL(80000,total.load());
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// and any combination is there for the asking
+	{
+		basic_ptr<RefCounter,ptr_synchronized,ptr_delete_array> a = new RefCounter[5];
+		basic_ptr<RefCounter,ptr_synchronized,ptr_delete_array> b = a;
+		basic_ptr<IntrusiveCounter,ptr_synchronized,ptr_delete,ptr_intrusive> c = new IntrusiveCounter;
+		CHECK_EQUAL(5,RefCounter::s_instances);
+		CHECK_EQUAL(1,IntrusiveCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+	CHECK_EQUAL(0,IntrusiveCounter::s_instances);
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,NonnullPtr)
+{
+	CHECK_EQUAL(sizeof(ptr<int>),sizeof(nonnull_ptr<int>));
+	CHECK(ptr_relocatable< nonnull_ptr<int> >::value);
+
+	{
+		// from the factory
+		nonnull_ptr<std::string> s = make_nonnull<std::string>(3,'a');
+		CHECK(*s == "aaa");
+		CHECK_EQUAL(3u,s->size());
+
+		// from an ordinary ptr<>, sharing its count
+		ptr<RefCounter> p = new RefCounterDerived;
+		nonnull_ptr<RefCounter> n(p);
+		CHECK(n.get() == p.operator->());
+		CHECK_EQUAL(4,n->Get(2));
+		p = 0;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+
+		// copies and assignment, to itself as well
+		nonnull_ptr<RefCounter> m = n;
+		nonnull_ptr<RefCounter> o = make_nonnull<RefCounter>();
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		CHECK(m == n);
+		CHECK(m != o);
+		o = m;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+		o = o;
+		CHECK_EQUAL(4,(*o).Get(2));
+
+		// and back to an ordinary ptr<>, which keeps it alive on its own
+		p = n;
+		CHECK(p == ptr<RefCounter>(m));
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	{
+		ptr<RefCounter> p = nonnull_ptr<RefCounter>(ptr<RefCounter>(new RefCounter));
+		CHECK_EQUAL(1,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// immortal objects are left alone, whichever handle goes last
+	static RefCounter s_forever;
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	{
+		nonnull_ptr<RefCounter> n(make_immortal(&s_forever));
+		ptr<RefCounter>         p = n;
+		CHECK(n.get() == &s_forever);
+	}
+	{
+		ptr<RefCounter> p;
+		{
+			nonnull_ptr<RefCounter> n(make_immortal(&s_forever));
+			p = n;
+		}
+		CHECK(p.operator->() == &s_forever);
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+
+#if !defined(NDEBUG)
+	// and one can't be made from nothing
+	pid_t child = fork();
+	if ( child == 0 )
+	{
+		freopen("/dev/null","w",stderr);
+		nonnull_ptr<RefCounter> n((ptr<RefCounter>()));
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child,&status,0);
+	CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+#endif
+
+	// kept in a container
+	{
+		ptr_vector< nonnull_ptr<RefCounter> > v;
+		nonnull_ptr<RefCounter> n = make_nonnull<RefCounter>();
+		for (int i=0;i<100;++i)
+		{
+			v.push_back(n);
+		}
+		CHECK_EQUAL(2,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(1,RefCounter::s_instances);
+	RefCounter::s_instances = 0;
+}
+
+///////////////////////////////////
+
+
+// a value that knows its key, and counts itself from any thread
+struct MapValue
+{
+	explicit MapValue(int k) : key(k) { s_live++; }
+	~MapValue() { s_live--; }
+	int key;
+	static std::atomic<int> s_live;
+};
+
+std::atomic<int> MapValue::s_live(0);
+
+TEST_FIXTURE(InstanceFixture,ConcurrentMap)
+{
+	typedef ptr_map<int,RefCounter>::value_ptr value_ptr;
+	{
+		ptr_map<int,RefCounter> m;
+		CHECK(m.insert(1,new RefCounter));
+		CHECK(m.insert(2,new RefCounterDerived));
+		CHECK(!m.insert(2,new RefCounter)); // already there, the new one's let go
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		CHECK_EQUAL(2u,m.size());
+		CHECK_EQUAL(20,m.find(2)->Get(10));
+		CHECK(!m.find(3));
+		CHECK(m.contains(1));
+
+		// a value found stays alive through being replaced and erased
+		value_ptr kept = m.find(1);
+		m.assign(1,new RefCounterDerived);
+		CHECK_EQUAL(2u,m.size());
+		CHECK_EQUAL(20,m.find(1)->Get(10));
+		CHECK_EQUAL(10,kept->Get(10));
+		value_ptr erased = m.erase(2);
+		CHECK_EQUAL(20,erased->Get(10));
+		CHECK(!m.erase(2));
+		CHECK(!m.contains(2));
+		CHECK_EQUAL(1u,m.size());
+
+		// retired nodes are gone once reclaimed, values go with the last handle
+		m.reclaim();
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		kept   = 0;
+		erased = 0;
+		CHECK_EQUAL(1,RefCounter::s_instances);
+
+		// growing keeps everything
+		for (int i=0;i<1000;++i)
+		{
+			m.assign(i,new RefCounter);
+		}
+		CHECK_EQUAL(1000u,m.size());
+		int found = 0;
+		m.for_each([&](const int& key, const value_ptr& value) { found += (value && key >= 0 && key < 1000); });
+		CHECK_EQUAL(1000,found);
+		CHECK(m.contains(999));
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// readers never see a value under the wrong key, or a deleted one
+	{
+		ptr_map<int,MapValue> m(16);
+		std::atomic<bool>     done(false);
+		std::atomic<int>      wrong(0);
+		std::atomic<long>     hits(0);
+		std::vector<std::thread> readers;
+		for (int t=0;t<3;++t)
+		{
+			readers.push_back(std::thread([&]()
+			{
+				while ( !done )
+				{
+					for (int k=0;k<256;++k)
+					{
+						ptr_map<int,MapValue>::value_ptr v = m.find(k);
+						if ( v )
+						{
+							wrong += (v->key != k);
+							hits++;
+						}
+					}
+				}
+			}));
+		}
+		for (int i=0;i<200000;++i)
+		{
+			const int k = (i * 7919) % 256;
+			switch ( i % 3 )
+			{
+				case 0: m.insert(k,new MapValue(k)); break;
+				case 1: m.assign(k,new MapValue(k)); break;
+				case 2: m.erase(k); break;
+			}
+		}
+		done = true;
+		for (size_t t=0;t<readers.size();++t)
+		{
+			readers[t].join();
+		}
+		CHECK_EQUAL(0,wrong.load());
+		CHECK(hits.load() > 0);
+		m.reclaim();
+		CHECK_EQUAL(int(m.size()),MapValue::s_live.load());
+	}
+	CHECK_EQUAL(0,MapValue::s_live.load());
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,QueueHandoff)
+{
+	// pushing moves the handle in, popping moves it out, the count never changes
+	{
+		ptr_queue< ptr<RefCounter> > q(3);
+		CHECK_EQUAL(4u,q.capacity());
+
+		ptr<RefCounter> a = new RefCounterDerived;
+		ptr_counter*    counter = a.counter();
+		CHECK(q.push(a));
+		CHECK(!a);
+		CHECK_EQUAL(1u,q.size());
+		CHECK_EQUAL(1u,counter->_count);
+
+		ptr<RefCounter> b = new RefCounter;
+		ptr<RefCounter> out = new RefCounter; // let go when something's popped into it
+		CHECK_EQUAL(3,RefCounter::s_instances);
+		CHECK(q.pop(out));
+		CHECK_EQUAL(2,RefCounter::s_instances);
+		CHECK_EQUAL(20,out->Get(10));
+		CHECK(out.counter() == counter);
+		CHECK_EQUAL(1u,counter->_count);
+		CHECK(!q.pop(out));
+		CHECK(out); // untouched
+
+		// full, and then what's left is let go with the queue
+		for (int i=0;i<4;++i)
+		{
+			ptr<RefCounter> p = new RefCounter;
+			CHECK(q.push(p));
+		}
+		CHECK(!q.push(b));
+		CHECK(b);
+		CHECK_EQUAL(6,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// every item gets through exactly once
+	{
+		const int                kItems = 100000;
+		ptr_queue< ptr<int> >    q(64);
+		std::atomic<long long>   sum(0);
+		std::atomic<int>         received(0);
+		std::vector<std::thread> threads;
+		for (int t=0;t<2;++t)
+		{
+			threads.push_back(std::thread([&,t]()
+			{
+				for (int i=t;i<kItems;i+=2)
+				{
+					ptr<int> item = new int(i);
+					while ( !q.push(item) )
+					{
+						std::this_thread::yield();
+					}
+				}
+			}));
+			threads.push_back(std::thread([&]()
+			{
+				ptr<int> item;
+				while ( received < kItems )
+				{
+					if ( q.pop(item) )
+					{
+						sum += *item;
+						received++;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			}));
+		}
+		for (size_t t=0;t<threads.size();++t)
+		{
+			threads[t].join();
+		}
+		CHECK_EQUAL(kItems,received.load());
+		CHECK_EQUAL((long long)kItems*(kItems-1)/2,sum.load());
+	}
+
+	// the owner works from the bottom, thieves from the top
+	{
+		ptr_deque< ptr<RefCounter> > d(8);
+		for (int i=0;i<3;++i)
+		{
+			ptr<RefCounter> p = (i == 2) ? new RefCounterDerived : new RefCounter;
+			CHECK(d.push(p));
+			CHECK(!p);
+		}
+		ptr<RefCounter> p;
+		CHECK(d.pop(p));
+		CHECK_EQUAL(20,p->Get(10));
+		CHECK(d.steal(p));
+		CHECK_EQUAL(10,p->Get(10));
+		CHECK_EQUAL(1u,d.size());
+		CHECK_EQUAL(2,RefCounter::s_instances);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	{
+		const int                kItems = 100000;
+		ptr_deque< ptr<int> >    d(256);
+		std::atomic<bool>        done(false);
+		std::atomic<long long>   sum(0);
+		std::atomic<int>         received(0);
+		std::vector<std::thread> thieves;
+		for (int t=0;t<3;++t)
+		{
+			thieves.push_back(std::thread([&]()
+			{
+				ptr<int> item;
+				while ( !done )
+				{
+					if ( d.steal(item) )
+					{
+						sum += *item;
+						received++;
+					}
+				}
+			}));
+		}
+		ptr<int> item;
+		for (int i=0;i<kItems;++i)
+		{
+			ptr<int> p = new int(i);
+			while ( !d.push(p) )
+			{
+				if ( d.pop(item) )
+				{
+					sum += *item;
+					received++;
+				}
+			}
+			if ( i % 3 == 0 && d.pop(item) )
+			{
+				sum += *item;
+				received++;
+			}
+		}
+		while ( d.pop(item) )
+		{
+			sum += *item;
+			received++;
+		}
+		done = true;
+		for (size_t t=0;t<thieves.size();++t)
+		{
+			thieves[t].join();
+		}
+		CHECK_EQUAL(kItems,received.load());
+		CHECK_EQUAL((long long)kItems*(kItems-1)/2,sum.load());
+	}
+}
+
+///////////////////////////////////
+
+
+// a node in a list or a tree, counted from whichever thread deletes it
+struct TeardownNode
+{
+	TeardownNode() { s_live++; }
+	~TeardownNode() { s_live--; }
+	ptr<TeardownNode> left, right;
+	static std::atomic<int> s_live;
+};
+
+std::atomic<int> TeardownNode::s_live(0);
+
+void ptr_detach(TeardownNode& n, ptr_teardown& t)
+{
+	t.take(n.left);
+	t.take(n.right);
+}
+
+// a node with any number of children, in an array of handles
+struct TeardownBranch
+{
+	TeardownBranch() { s_live++; }
+	~TeardownBranch() { s_live--; }
+	array_ptr< ptr<TeardownBranch> > children;
+	static std::atomic<int> s_live;
+};
+
+std::atomic<int> TeardownBranch::s_live(0);
+
+void ptr_detach(TeardownBranch& n, ptr_teardown& t)
+{
+	t.take(n.children);
+}
+
+static ptr<TeardownNode> MakeTeardownTree(int depth)
+{
+	ptr<TeardownNode> n = new TeardownNode;
+	if ( depth > 1 )
+	{
+		n->left  = MakeTeardownTree(depth - 1);
+		n->right = MakeTeardownTree(depth - 1);
+	}
+	return n;
+}
+
+TEST_FIXTURE(InstanceFixture,Teardown)
+{
+	// a list far too long to delete recursively
+	{
+		ptr<TeardownNode> head;
+		for (int i=0;i<1000000;++i)
+		{
+			ptr<TeardownNode> n = new TeardownNode;
+			n->left = head;
+			head = n;
+		}
+		CHECK_EQUAL(1000000,TeardownNode::s_live.load());
+		teardown(head);
+		CHECK(!head);
+		CHECK_EQUAL(0,TeardownNode::s_live.load());
+	}
+
+	// and as deep, through arrays of child handles
+	{
+		ptr<TeardownBranch> root;
+		for (int i=0;i<1000000;++i)
+		{
+			ptr<TeardownBranch> n = new TeardownBranch;
+			n->children = make_pmr_array< ptr<TeardownBranch> >(0,(i % 2) ? 2 : 1);
+			n->children[0] = root;
+			if ( i % 2 )
+			{
+				n->children[1] = new TeardownBranch;
+			}
+			root = n;
+		}
+		CHECK_EQUAL(1500000,TeardownBranch::s_live.load());
+		teardown(root);
+		CHECK(!root);
+		CHECK_EQUAL(0,TeardownBranch::s_live.load());
+	}
+
+	// arrays of nodes have each element's children detached, other types have
+	// none and are simply let go
+	{
+		array_ptr<TeardownNode> a = make_pmr_array<TeardownNode>(0,3);
+		array_ptr<TeardownNode> none;
+		ptr<RefCounter>         r = new RefCounterDerived;
+		for (size_t e=0;e<a.size();++e)
+		{
+			for (int i=0;i<1000;++i)
+			{
+				ptr<TeardownNode> n = new TeardownNode;
+				n->left = a[e].right;
+				a[e].right = n;
+			}
+		}
+		CHECK_EQUAL(3003,TeardownNode::s_live.load());
+		{
+			ptr_teardown t;
+			t.take(a);
+			t.take(r);
+			t.take(none);
+			CHECK_EQUAL(2u,t.size()); // nothing to do for a null one
+		}
+		CHECK(!a && !r);
+		CHECK_EQUAL(0,RefCounter::s_instances);
+		CHECK_EQUAL(0,TeardownNode::s_live.load());
+	}
+
+	// spread over a pool
+	{
+		work_pool pool(3);
+		ptr<TeardownNode> root = MakeTeardownTree(16);
+		CHECK_EQUAL(65535,TeardownNode::s_live.load());
+		teardown(root,pool);
+		CHECK(!root);
+		CHECK_EQUAL(0,TeardownNode::s_live.load());
+	}
+
+	// anything referenced from elsewhere survives, along with what's below it,
+	// and immortal objects are left alone
+	{
+		static TeardownNode s_forever;
+		const int before = TeardownNode::s_live;
+
+		ptr<TeardownNode> root = MakeTeardownTree(4);
+		ptr<TeardownNode> kept = root->left->right;
+		root->right->right->left = make_immortal(&s_forever); // in place of a leaf
+		CHECK_EQUAL(before+14,TeardownNode::s_live.load());
+
+		ptr_teardown t;
+		t.take(root);
+		CHECK(!root);
+		CHECK_EQUAL(1u,t.size());
+		t.run();
+		CHECK_EQUAL(0u,t.size());
+		CHECK_EQUAL(before+3,TeardownNode::s_live.load());
+		CHECK(kept->left && kept->right);
+
+		kept = 0;
+		CHECK_EQUAL(before,TeardownNode::s_live.load());
+	}
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,BudgetedCache)
+{
+	typedef ptr_cache<int,RefCounter>::value_ptr value_ptr;
+	{
+		ptr_cache<int,RefCounter> cache(100,1);
+		value_ptr one = new RefCounter;
+		for (int k=0;k<10;++k)
+		{
+			CHECK(cache.put(k,k == 1 ? one : value_ptr(new RefCounter),10));
+		}
+		CHECK_EQUAL(10,RefCounter::s_instances);
+		CHECK_EQUAL(100u,cache.stats().bytes);
+
+		// 0 was used lately, 1 is held elsewhere, so 2 is the one to go
+		CHECK(cache.get(0));
+		CHECK(cache.put(10,new RefCounter,10));
+		CHECK(!cache.get(2));
+		CHECK(cache.get(0) && cache.get(1) && cache.get(3));
+		CHECK_EQUAL(10,RefCounter::s_instances);
+
+		ptr_cache_stats s = cache.stats();
+		CHECK_EQUAL(11u,s.puts);
+		CHECK_EQUAL(4u,s.hits);
+		CHECK_EQUAL(1u,s.misses);
+		CHECK_CLOSE(0.8,s.hit_rate,1e-9);
+		CHECK_EQUAL(1u,s.evictions);
+		CHECK_EQUAL(10u,s.evicted);
+		CHECK_EQUAL(10u,s.reclaimed);
+		CHECK_EQUAL(10u,s.entries);
+		CHECK_EQUAL(100u,s.bytes);
+
+		// with everything held elsewhere something still has to go, but
+		// nothing's freed by it
+		std::vector<value_ptr> held;
+		for (int k=0;k<11;++k)
+		{
+			value_ptr v = cache.get(k);
+			if ( v )
+			{
+				held.push_back(v);
+			}
+		}
+		cache.reset_stats();
+		CHECK(cache.put(11,new RefCounter,20));
+		s = cache.stats();
+		CHECK_EQUAL(2u,s.evictions);
+		CHECK_EQUAL(20u,s.evicted);
+		CHECK_EQUAL(0u,s.reclaimed);
+		CHECK_EQUAL(100u,s.bytes);
+		CHECK_EQUAL(11,RefCounter::s_instances);
+		held.clear();
+		one = 0;
+		CHECK_EQUAL(9,RefCounter::s_instances);
+
+		// too big to ever fit, and what was there goes
+		CHECK(!cache.put(11,new RefCounter,101));
+		CHECK(!cache.get(11));
+		CHECK_EQUAL(8,RefCounter::s_instances);
+
+		// replacing, erasing and clearing
+		CHECK(cache.put(3,new RefCounterDerived,5));
+		CHECK_EQUAL(20,cache.get(3)->Get(10));
+		value_ptr erased = cache.erase(3);
+		CHECK(erased && !cache.get(3) && !cache.erase(3));
+		erased = 0;
+		cache.clear();
+		CHECK_EQUAL(0u,cache.stats().entries);
+		CHECK_EQUAL(0u,cache.stats().bytes);
+		CHECK_EQUAL(0,RefCounter::s_instances);
+
+		cache.put(1,new RefCounter,1);
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// an entry bigger than a shard's share borrows room from the others
+	{
+		ptr_cache<int,RefCounter> cache(100,4);
+		for (int k=0;k<10;++k)
+		{
+			CHECK(cache.put(k,new RefCounter,10));
+		}
+		CHECK(cache.put(10,new RefCounter,90));
+		CHECK(cache.get(10));
+		ptr_cache_stats s = cache.stats();
+		CHECK(s.bytes <= 100u);
+		CHECK_EQUAL(s.entries,unsigned(RefCounter::s_instances));
+		CHECK(!cache.put(11,new RefCounter,101));
+	}
+	CHECK_EQUAL(0,RefCounter::s_instances);
+
+	// gets and puts from all over, never over budget
+	{
+		ptr_cache<int,MapValue> cache(64*100,8);
+		std::vector<std::thread> threads;
+		std::atomic<int>         wrong(0);
+		for (int t=0;t<4;++t)
+		{
+			threads.push_back(std::thread([&,t]()
+			{
+				uint32_t x = 77 + t;
+				for (int i=0;i<20000;++i)
+				{
+					x = x * 1664525 + 1013904223;
+					const int k = int((x >> 8) % 1000);
+					ptr_cache<int,MapValue>::value_ptr v = cache.get(k);
+					if ( !v )
+					{
+						cache.put(k,new MapValue(k),100);
+					}
+					else
+					{
+						wrong += (v->key != k);
+					}
+				}
+			}));
+		}
+		for (size_t t=0;t<threads.size();++t)
+		{
+			threads[t].join();
+		}
+		ptr_cache_stats s = cache.stats();
+		CHECK_EQUAL(0,wrong.load());
+		CHECK(s.bytes <= 6400u);
+		CHECK_EQUAL(80000u,s.hits+s.misses);
+		CHECK_EQUAL(s.reclaimed,s.evicted); // nothing was held onto
+		CHECK_EQUAL(int(s.entries),MapValue::s_live.load());
+	}
+	CHECK_EQUAL(0,MapValue::s_live.load());
+}
+
+///////////////////////////////////
+
+
+TEST_FIXTURE(InstanceFixture,PooledBuffers)
+{
+	{
+		buffer_pool pool(4096);
+
+		// sized as asked, aligned, and writable end to end
+		array_ptr<char> a = pool.make(1000);
+		CHECK_EQUAL(1000u,a.size());
+		CHECK_EQUAL(0u,reinterpret_cast<uintptr_t>(&a[0]) % 64);
+		memset(&a[0],0x5a,a.size());
+		CHECK(!pool.make(0));
+
+		// once let go of, the same memory comes back for anything its size
+		char* first = &a[0];
+		a = 0;
+		array_ptr<char> b = pool.make(600);
+		CHECK(&b[0] == first);
+		CHECK_EQUAL(600u,b.size());
+
+		buffer_pool_stats s = pool.stats();
+		CHECK_EQUAL(size_t(buffer_pool::classes),s.classes.size());
+		CHECK_EQUAL(1024u,s.classes[4].bytes);
+		CHECK_EQUAL(2u,s.classes[4].made);
+		CHECK_EQUAL(1u,s.classes[4].reused);
+		CHECK_EQUAL(1u,s.classes[4].in_use);
+		CHECK_EQUAL(0u,s.classes[4].cached);
+		CHECK_EQUAL(1024u,s.bytes_in_use);
+		CHECK_CLOSE(0.5,s.hit_rate,1e-9);
+
+		// it's the last copy that gives it back
+		array_ptr<char> c = b;
+		b = 0;
+		CHECK_EQUAL(1u,pool.stats().classes[4].in_use);
+		c = 0;
+		s = pool.stats();
+		CHECK_EQUAL(0u,s.classes[4].in_use);
+		CHECK_EQUAL(1u,s.classes[4].cached);
+		CHECK_EQUAL(1024u,s.bytes_cached);
+
+		// a slot keeps 4 of these, beyond that half go to the shared list,
+		// and come back from there when the slot runs out
+		std::vector<array_ptr<char> > held;
+		for (int i=0;i<6;++i)
+		{
+			held.push_back(pool.make(1024));
+		}
+		held.clear();
+		CHECK_EQUAL(6u,pool.stats().classes[4].cached);
+		for (int i=0;i<6;++i)
+		{
+			held.push_back(pool.make(1024));
+		}
+		s = pool.stats();
+		CHECK_EQUAL(14u,s.classes[4].made);
+		CHECK_EQUAL(8u,s.classes[4].reused);
+		CHECK_EQUAL(0u,s.classes[4].cached);
+		held.clear();
+
+		// the first trim only starts the clock, what's unused until the next
+		// one goes then
+		pool.trim();
+		CHECK_EQUAL(6u,pool.stats().classes[4].cached);
+		pool.make(1024);
+		pool.trim();
+		s = pool.stats();
+		CHECK_EQUAL(1u,s.classes[4].cached);
+		CHECK_EQUAL(5u,s.classes[4].trimmed);
+		pool.purge();
+		s = pool.stats();
+		CHECK_EQUAL(0u,s.classes[4].cached);
+		CHECK_EQUAL(6u,s.classes[4].trimmed);
+		CHECK_EQUAL(0u,s.bytes_cached);
+
+		// too big for any class, made and freed there and then
+		const size_t huge = (size_t(16) << 20) + 1;
+		array_ptr<char> e = pool.make(huge);
+		CHECK_EQUAL(huge,e.size());
+		e[0] = e[huge - 1] = 1;
+		e = 0;
+		CHECK_EQUAL(0u,pool.stats().bytes_cached);
+
+		// made on some threads, let go of on others
+		std::atomic<int> wrong(0);
+		std::vector<array_ptr<char> > handed(400);
+		std::vector<std::thread> makers;
+		for (int t=0;t<4;++t)
+		{
+			makers.push_back(std::thread([&,t]
+			{
+				for (int i=0;i<100;++i)
+				{
+					const size_t n = size_t(64) << (i % 8);
+					array_ptr<char> mine = pool.make(n);
+					memset(&mine[0],t,n);
+					handed[t * 100 + i] = pool.make(n);
+					memset(&handed[t * 100 + i][0],t,n);
+					if ( mine[n - 1] != char(t) )
+					{
+						wrong++;
+					}
+				}
+			}));
+		}
+		for (size_t t=0;t<makers.size();++t)
+		{
+			makers[t].join();
+		}
+		std::vector<std::thread> releasers;
+		for (int t=0;t<4;++t)
+		{
+			releasers.push_back(std::thread([&,t]
+			{
+				for (int i=0;i<100;++i)
+				{
+					array_ptr<char>& h = handed[((t + 1) % 4) * 100 + i];
+					if ( h[h.size() - 1] != char((t + 1) % 4) )
+					{
+						wrong++;
+					}
+					h = 0;
+				}
+				pool.trim();
+			}));
+		}
+		for (size_t t=0;t<releasers.size();++t)
+		{
+			releasers[t].join();
+		}
+		CHECK_EQUAL(0,wrong.load());
+		s = pool.stats();
+		CHECK_EQUAL(0u,s.bytes_in_use);
+	}
+
+	// and the shared pool
+	array_ptr<char> f = make_pooled_buffer(100);
+	CHECK_EQUAL(100u,f.size());
+	f[99] = 1;
+}
+
+///////////////////////////////////
+
+
+int main(int argc, char** argv)
+{
+	return UnitTest::RunAllTests();
+}
+
@@ -0,0 +1,8 @@
+// the same tests, with all of the optional instrumentation compiled in, so
+// everything else is tested with it in place too (it has to be defined for
+// the whole program, see ptr_profile.h and friends)
+#define PTR_PROFILE
+#define PTR_LIFETIMES
+#define PTR_CONTENTION
+
+#include "main.cpp"
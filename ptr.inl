@@ -1,527 +1,572 @@
-#if !defined(__ptr_inl_include__)
-#error "ptr.inl may only be included from ptr.h"
-#endif // !defined(__ptr_inl_include__)
-
-
-
-#ifndef __ptr_inl__
-#define __ptr_inl__
-
-
-
-#include <cassert>
-
-
-
-struct ptr_counter
-{
-	ptr_counter() : _count(0) { /* empty */ };
-	void inc() { _count++; }
-	void dec() { _count--; }
-	unsigned _count;
-};
-
-
-
-//
-// default construction
-//
-template <typename X>
-inline ptr<X>::ptr() : _ptr(0), _counter(0)
-{
-	// empty
-}
-
-
-
-//
-// copying
-//
-template <typename X>
-inline ptr<X>::ptr(const ptr<X>& other) : _ptr(0), _counter(0)
-{
-	// defer to copy assignment operator
-	*this = other;
-}
-
-template <typename X>
-inline ptr<X>& ptr<X>::operator=(const ptr<X>& other)
-{
-	// make certain it's not trying to copy assign itself to itself
-	if ( this != &other )
-	{
-		// take the pointer and counter from the other and increment the count
-		// TODO should we check that the other counter is non-zero?
-		grab(other._ptr, other._counter);
-	}
-
-	// send back a reference to this object
-	return *this;
-}
-
-
-
-//
-// copying from a normal pointer
-//
-template <typename X>
-inline ptr<X>::ptr(X* normal_ptr) : _ptr(0), _counter(0)
-{
-	// defer to operator
-	*this = normal_ptr;
-}
-
-template <typename X>
-inline ptr<X>& ptr<X>::operator=(X* normal_ptr)
-{
-	// initialize pointer and create new reference counter
-	grab(normal_ptr, 0);
-
-	// send back a reference to this object
-	return *this;
-}
-
-
-
-//
-// destructor
-//
-template <typename X>
-inline ptr<X>::~ptr()
-{
-	// decrement count and possibly release pointer
-	drop();
-}
-
-
-
-//
-// take a pointer as ours and increment reference count
-//
-template <typename X>
-inline void ptr<X>::grab(X* normal_ptr, ptr_counter* counter)
-{
-	// drop any pointer+counter we may already have
-	drop();
-
-	// if the pointer is 0, we're finished
-	if ( !normal_ptr )
-	{
-		// zeroed out, nothing to do
-		return;
-	}
-
-	// copy pointer
-	_ptr = normal_ptr;
-
-	// copy or create a new counter
-	_counter = counter ? counter : new ptr_counter;
-	assert(_counter);
-
-	// increment reference count
-	_counter->inc();
-}
-
-
-
-//
-// reset our pointer and counter to zero and decrement reference count
-// and, possibly, delete the pointer (if reference count goes to zero)
-//
-template <typename X>
-inline void ptr<X>::drop()
-{
-	// check to see if we have anything to drop
-	if ( valid() )
-	{
-		// decrement the count
-		_counter->dec();
-
-		// check if this is the last reference
-		if ( unreferenced() )
-		{
-			// this is the last reference, delete the pointer and counter
-			delete _ptr;
-			delete _counter;
-		}
-
-		// now reset ("drop") the pointer and the counter
-		_ptr     = 0;
-		_counter = 0;
-	}
-}
-
-
-
-// 
-// comparison
-//
-template <typename X>
-inline bool ptr<X>::operator==(const ptr<X>& other) const
-{
-	return _ptr == other._ptr;
-}
-
-template <typename X>
-inline bool ptr<X>::operator!=(const ptr<X>& other) const
-{
-	return _ptr != other._ptr;
-}
-
-template <typename X>
-inline bool ptr<X>::operator<(const ptr<X>& other) const
-{
-	return _ptr < other._ptr;
-}
-
-template <typename X>
-inline bool ptr<X>::operator<=(const ptr<X>& other) const
-{
-	return _ptr <= other._ptr;
-}
-
-template <typename X>
-inline bool ptr<X>::operator>(const ptr<X>& other) const
-{
-	return _ptr > other._ptr;
-}
-
-template <typename X>
-inline bool ptr<X>::operator>=(const ptr<X>& other) const
-{
-	return _ptr >= other._ptr;
-}
-
-
-
-// 
-// use the pointer
-//
-template <typename X>
-inline X* ptr<X>::operator->() const
-{
-	assert(_ptr);
-	return _ptr;
-}
-
-template <typename X>
-inline X& ptr<X>::operator*() const
-{
-	assert(_ptr);
-	return *_ptr;
-}
-
-template <typename X>
-inline X& ptr<X>::operator[](size_t i)
-{
-	assert(_ptr);
-	return _ptr[i];
-}
-
-template <typename X>
-inline const X& ptr<X>::operator[](size_t i) const
-{
-	assert(_ptr);
-	return _ptr[i];
-}
-
-
-
-//
-// check whether pointer is valid
-//
-template <typename X>
-inline ptr<X>::operator bool() const
-{
-	return valid();
-}
-
-template <typename X>
-inline bool ptr<X>::valid() const
-{
-	return _ptr && _counter;
-}
-
-
-
-//
-// miscellaneous utility methods
-//
-template <typename X>
-inline unsigned ptr<X>::copies() const
-{
-	return valid() ? _counter->_count : 0;
-}
-
-template <typename X>
-inline bool ptr<X>::shared() const
-{
-	return copies() > 1;
-}
-
-template <typename X>
-inline bool ptr<X>::unique() const
-{
-	return copies() == 1;
-}
-
-template <typename X>
-inline bool ptr<X>::unreferenced() const
-{
-	return copies() == 0;
-}
-
-
-
-//
-// default construction
-//
-template <typename X>
-inline array_ptr<X>::array_ptr() : _ptr(0), _counter(0)
-{
-	// empty
-}
-
-
-
-//
-// copying
-//
-template <typename X>
-inline array_ptr<X>::array_ptr(const array_ptr<X>& other) : _ptr(0), _counter(0)
-{
-	// defer to copy assignment operator
-	*this = other;
-}
-
-template <typename X>
-inline array_ptr<X>& array_ptr<X>::operator=(const array_ptr<X>& other)
-{
-	// make certain it's not trying to copy assign itself to itself
-	if ( this != &other )
-	{
-		// take the pointer and counter from the other and increment the count
-		// TODO should we check that the other counter is non-zero?
-		grab(other._ptr, other._counter);
-	}
-
-	// send back a reference to this object
-	return *this;
-}
-
-
-
-//
-// copying from a normal pointer
-//
-template <typename X>
-inline array_ptr<X>::array_ptr(X* normal_ptr) : _ptr(0), _counter(0)
-{
-	// defer to operator
-	*this = normal_ptr;
-}
-
-template <typename X>
-inline array_ptr<X>& array_ptr<X>::operator=(X* normal_ptr)
-{
-	// initialize pointer and create new reference counter
-	grab(normal_ptr, 0);
-
-	// send back a reference to this object
-	return *this;
-}
-
-
-
-//
-// destructor
-//
-template <typename X>
-inline array_ptr<X>::~array_ptr()
-{
-	// decrement count and possibly release pointer
-	drop();
-}
-
-
-
-//
-// take a pointer as ours and increment reference count
-//
-template <typename X>
-inline void array_ptr<X>::grab(X* normal_ptr, ptr_counter* counter)
-{
-	// drop any pointer+counter we may already have
-	drop();
-
-	// if the pointer is 0, we're finished
-	if ( !normal_ptr )
-	{
-		// zeroed out, nothing to do
-		return;
-	}
-
-	// copy pointer
-	_ptr = normal_ptr;
-
-	// copy or create a new counter
-	_counter = counter ? counter : new ptr_counter;
-	assert(_counter);
-
-	// increment reference count
-	_counter->inc();
-}
-
-
-
-//
-// reset our pointer and counter to zero and decrement reference count
-// and, possibly, delete the pointer (if reference count goes to zero)
-//
-template <typename X>
-inline void array_ptr<X>::drop()
-{
-	// check to see if we have anything to drop
-	if ( valid() )
-	{
-		// decrement the count
-		_counter->dec();
-
-		// check if this is the last reference
-		if ( unreferenced() )
-		{
-			// this is the last reference, delete the pointer and counter
-			delete[] _ptr;
-			delete _counter;
-		}
-
-		// now reset ("drop") the pointer and the counter
-		_ptr     = 0;
-		_counter = 0;
-	}
-}
-
-
-
-// 
-// comparison
-//
-template <typename X>
-inline bool array_ptr<X>::operator==(const array_ptr<X>& other) const
-{
-	return _ptr == other._ptr;
-}
-
-template <typename X>
-inline bool array_ptr<X>::operator!=(const array_ptr<X>& other) const
-{
-	return _ptr != other._ptr;
-}
-
-template <typename X>
-inline bool array_ptr<X>::operator<(const array_ptr<X>& other) const
-{
-	return _ptr < other._ptr;
-}
-
-template <typename X>
-inline bool array_ptr<X>::operator<=(const array_ptr<X>& other) const
-{
-	return _ptr <= other._ptr;
-}
-
-template <typename X>
-inline bool array_ptr<X>::operator>(const array_ptr<X>& other) const
-{
-	return _ptr > other._ptr;
-}
-
-template <typename X>
-inline bool array_ptr<X>::operator>=(const array_ptr<X>& other) const
-{
-	return _ptr >= other._ptr;
-}
-
-
-
-// 
-// use the pointer
-//
-template <typename X>
-inline X* array_ptr<X>::operator->() const
-{
-	assert(_ptr);
-	return _ptr;
-}
-
-template <typename X>
-inline X& array_ptr<X>::operator*() const
-{
-	assert(_ptr);
-	return *_ptr;
-}
-
-template <typename X>
-inline X& array_ptr<X>::operator[](size_t i)
-{
-	assert(_ptr);
-	return _ptr[i];
-}
-
-template <typename X>
-inline const X& array_ptr<X>::operator[](size_t i) const
-{
-	assert(_ptr);
-	return _ptr[i];
-}
-
-
-
-//
-// check whether pointer is valid
-//
-template <typename X>
-inline array_ptr<X>::operator bool() const
-{
-	return valid();
-}
-
-template <typename X>
-inline bool array_ptr<X>::valid() const
-{
-	return _ptr && _counter;
-}
-
-
-
-//
-// miscellaneous utility methods
-//
-template <typename X>
-inline unsigned array_ptr<X>::copies() const
-{
-	return valid() ? _counter->_count : 0;
-}
-
-template <typename X>
-inline bool array_ptr<X>::shared() const
-{
-	return copies() > 1;
-}
-
-template <typename X>
-inline bool array_ptr<X>::unique() const
-{
-	return copies() == 1;
-}
-
-template <typename X>
-inline bool array_ptr<X>::unreferenced() const
-{
-	return copies() == 0;
-}
-
-
-
-#endif // __ptr_inl__
-
+#if !defined(__ptr_inl_include__)
+#error "ptr.inl may only be included from ptr.h"
+#endif // !defined(__ptr_inl_include__)
+
+
+
+#ifndef __ptr_inl__
+#define __ptr_inl__
+
+
+
+#include <cassert>
+#include <type_traits>
+
+#include <stdint.h>
+
+#if defined(PTR_PROFILE) || defined(PTR_CONTENTION)
+#include <typeinfo>
+#endif
+#if defined(PTR_CONTENTION)
+#include <atomic>
+#endif
+#if defined(PTR_LIFETIMES)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+
+
+struct ptr_counter
+{
+	// frees storage that didn't come from new/new[], and the counter itself
+	typedef void (*release_func)(void* normal_ptr, ptr_counter* counter);
+
+	ptr_counter() : _count(0), _length(0), _release(0) { /* empty */ };
+	ptr_counter(size_t length, release_func release) : _count(0), _length(length), _release(release) { /* empty */ };
+	void inc() { touch(); _count++; }
+	void dec() { touch(); _count--; }
+	void touch(); // notes which thread is counting, if anyone's asked (see ptr_contention.h)
+	unsigned     _count;
+	size_t       _length;  // element count, 0 if unknown
+	release_func _release; // 0 means plain delete (or delete[])
+
+#if defined(PTR_PROFILE)
+	bool         _sampled = false; // in the heap profile (see ptr_profile.h)
+#endif
+#if defined(PTR_LIFETIMES)
+	uint64_t     _born = 0;        // when it was first owned (see ptr_lifetime.h)
+#endif
+#if defined(PTR_CONTENTION)
+	std::atomic<uintptr_t> _owner{0};      // the last thread to count (see ptr_contention.h)
+	std::atomic<uint32_t>  _migrations{0}; // times that's changed hands
+	const std::type_info*  _type = 0;      // what's being counted
+#endif
+};
+
+// immortal pointers all share this in place of a counter, it's never touched
+inline ptr_counter* ptr_immortal_counter()
+{
+	return reinterpret_cast<ptr_counter*>(1);
+}
+
+// whether there's a real counter to update, one comparison rules out both no
+// counter and the immortal marker
+inline bool ptr_counted(const ptr_counter* counter)
+{
+	return reinterpret_cast<uintptr_t>(counter) > 1;
+}
+
+
+
+//
+// optional instrumentation, none of it is compiled in unless it's asked for
+// (see ptr_profile.h, ptr_lifetime.h and ptr_contention.h)
+//
+#if defined(PTR_PROFILE)
+inline thread_local int64_t ptr_profile_countdown = 0; // bytes until the next sample
+__attribute__((cold)) inline void ptr_profile_sample(ptr_counter* counter, size_t bytes, const std::type_info& type);
+__attribute__((cold)) inline void ptr_profile_forget(ptr_counter* counter);
+#endif
+
+#if defined(PTR_LIFETIMES)
+// the cheapest clock there is, the time stamp counter where there is one
+inline uint64_t ptr_lifetime_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+template <typename X>
+void ptr_lifetime_end(uint64_t ticks);
+#endif
+
+#if defined(PTR_CONTENTION)
+// something unique to each thread, cheaper to get at than its id
+inline thread_local char ptr_contention_thread = 0;
+__attribute__((cold)) inline void ptr_contention_migrated(ptr_counter* counter, uintptr_t thread);
+__attribute__((cold)) inline void ptr_contention_forget(ptr_counter* counter);
+#endif
+
+inline void ptr_counter::touch()
+{
+#if defined(PTR_CONTENTION)
+	const uintptr_t thread = reinterpret_cast<uintptr_t>(&ptr_contention_thread);
+	if ( __builtin_expect(_owner.load(std::memory_order_relaxed) != thread, 0) )
+	{
+		ptr_contention_migrated(this, thread);
+	}
+#endif
+}
+
+// a counter's first reference has just been taken
+template <typename X>
+inline void ptr_adopted(ptr_counter* counter)
+{
+#if defined(PTR_PROFILE)
+	const size_t bytes = sizeof(X) * (counter->_length ? counter->_length : 1);
+	if ( __builtin_expect((ptr_profile_countdown -= int64_t(bytes)) < 0, 0) )
+	{
+		ptr_profile_sample(counter, bytes, typeid(X));
+	}
+#endif
+#if defined(PTR_LIFETIMES)
+	counter->_born = ptr_lifetime_clock();
+#endif
+#if defined(PTR_CONTENTION)
+	counter->_type = &typeid(X);
+#endif
+	(void)counter;
+}
+
+// a counter's last reference is about to be let go
+template <typename X>
+inline void ptr_releasing(ptr_counter* counter)
+{
+#if defined(PTR_PROFILE)
+	if ( counter->_sampled )
+	{
+		ptr_profile_forget(counter);
+	}
+#endif
+#if defined(PTR_LIFETIMES)
+	ptr_lifetime_end<X>(ptr_lifetime_clock() - counter->_born);
+#endif
+#if defined(PTR_CONTENTION)
+	if ( counter->_migrations.load(std::memory_order_relaxed) )
+	{
+		ptr_contention_forget(counter);
+	}
+#endif
+	(void)counter;
+}
+
+
+
+//
+// counting policies, inc() hands back the new count and dec() whether that
+// was the last reference
+//
+struct ptr_unsynchronized
+{
+	static unsigned inc(ptr_counter* counter)          { counter->inc(); return counter->_count; }
+	static bool     dec(ptr_counter* counter)          { counter->dec(); return counter->_count == 0; }
+	static unsigned count(const ptr_counter* counter)  { return counter->_count; }
+};
+
+struct ptr_synchronized
+{
+	static unsigned inc(ptr_counter* counter)          { counter->touch(); return __atomic_add_fetch(&counter->_count, 1, __ATOMIC_RELAXED); }
+	static bool     dec(ptr_counter* counter)          { counter->touch(); return __atomic_sub_fetch(&counter->_count, 1, __ATOMIC_ACQ_REL) == 0; }
+	static unsigned count(const ptr_counter* counter)  { return __atomic_load_n(&counter->_count, __ATOMIC_ACQUIRE); }
+};
+
+
+
+//
+// deletion policies
+//
+struct ptr_delete
+{
+	template <typename T>
+	static void destroy(T* normal_ptr) { delete normal_ptr; }
+};
+
+struct ptr_delete_array
+{
+	template <typename T>
+	static void destroy(T* normal_ptr) { delete[] normal_ptr; }
+};
+
+
+
+//
+// storage policies, each holds the pointer and knows where its counter is
+//
+struct ptr_separate
+{
+	template <typename T>
+	struct holder
+	{
+		holder() : _ptr(0), _counter(0) { /* empty */ };
+
+		T*           get() const     { return _ptr; }
+		ptr_counter* counter() const { return _counter; }
+		void         set(T* normal_ptr, ptr_counter* counter) { _ptr = normal_ptr; _counter = counter; }
+
+		// a new pointer needs a new counter, which goes when the object does
+		static ptr_counter* make_counter(T*)                { return new ptr_counter; }
+		static void         free_counter(ptr_counter* counter) { delete counter; }
+
+		T*           _ptr;
+		ptr_counter* _counter;
+	};
+};
+
+// objects counted by ptr_intrusive pointers derive from this
+struct ptr_intrusive_base : public ptr_counter
+{
+	// copies of the object are new objects, with nothing counting them yet
+	ptr_intrusive_base() { /* empty */ };
+	ptr_intrusive_base(const ptr_intrusive_base&) : ptr_counter() { /* empty */ };
+	ptr_intrusive_base& operator=(const ptr_intrusive_base&) { return *this; }
+};
+
+struct ptr_intrusive
+{
+	template <typename T>
+	struct holder
+	{
+		holder() : _ptr(0) { /* empty */ };
+
+		T*           get() const     { return _ptr; }
+		ptr_counter* counter() const { return to_counter(_ptr); }
+		void         set(T* normal_ptr, ptr_counter* counter) { assert(counter == to_counter(normal_ptr)); (void)counter; _ptr = normal_ptr; }
+
+		// the object is its own counter, and takes it along when it's deleted
+		static ptr_counter* make_counter(T* normal_ptr)     { return to_counter(normal_ptr); }
+		static void         free_counter(ptr_counter*)      { /* empty */ }
+
+		static ptr_counter* to_counter(T* normal_ptr)
+		{
+			return static_cast<ptr_intrusive_base*>(const_cast<typename std::remove_cv<T>::type*>(normal_ptr));
+		}
+
+		T* _ptr;
+	};
+};
+
+
+
+//
+// default construction
+//
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::basic_ptr()
+{
+	// empty
+}
+
+
+
+//
+// copying
+//
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::basic_ptr(const basic_ptr& other)
+{
+	// defer to copy assignment operator
+	*this = other;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>& basic_ptr<X, C, D, S>::operator=(const basic_ptr& other)
+{
+	// make certain it's not trying to copy assign itself to itself
+	if ( this != &other )
+	{
+		// take the pointer and counter from the other and increment the count
+		// TODO should we check that the other counter is non-zero?
+		grab(other._held.get(), other._held.counter());
+	}
+
+	// send back a reference to this object
+	return *this;
+}
+
+
+
+//
+// copying from a normal pointer
+//
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::basic_ptr(X* normal_ptr)
+{
+	// defer to operator
+	*this = normal_ptr;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>& basic_ptr<X, C, D, S>::operator=(X* normal_ptr)
+{
+	// initialize pointer and create new reference counter
+	grab(normal_ptr, 0);
+
+	// send back a reference to this object
+	return *this;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::basic_ptr(X* normal_ptr, ptr_counter* counter)
+{
+	// take the pointer along with its (fresh) counter
+	assert(counter);
+	grab(normal_ptr, counter);
+}
+
+
+
+//
+// destructor
+//
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::~basic_ptr()
+{
+	// decrement count and possibly release pointer
+	drop();
+}
+
+
+
+//
+// take a pointer as ours and increment reference count
+//
+template <typename X, typename C, typename D, typename S>
+inline void basic_ptr<X, C, D, S>::grab(X* normal_ptr, ptr_counter* counter)
+{
+	// drop any pointer+counter we may already have
+	drop();
+
+	// if the pointer is 0, we're finished
+	if ( !normal_ptr )
+	{
+		// zeroed out, nothing to do
+		return;
+	}
+
+	// a new pointer needs a new counter
+	if ( !counter )
+	{
+		counter = S::template holder<X>::make_counter(normal_ptr);
+	}
+
+	// copy pointer and counter
+	_held.set(normal_ptr, counter);
+
+	// an immortal one isn't counted
+	if ( !ptr_counted(counter) )
+	{
+		return;
+	}
+
+	// increment reference count
+	if ( C::inc(counter) == 1 )
+	{
+		ptr_adopted<X>(counter);
+	}
+}
+
+
+
+//
+// reset our pointer and counter to zero and decrement reference count
+// and, possibly, delete the pointer (if reference count goes to zero)
+//
+template <typename X, typename C, typename D, typename S>
+inline void basic_ptr<X, C, D, S>::drop()
+{
+	// check to see if we have anything to drop (immortal pointers have
+	// nothing to count, and nothing to delete), decrement the count, and
+	// check if this is the last reference
+	ptr_counter* counter = _held.counter();
+	if ( ptr_counted(counter) && C::dec(counter) )
+	{
+		release(_held.get(), counter);
+	}
+
+	// now reset ("drop") the pointer and the counter
+	_held.set(0, 0);
+}
+
+// kept out of line, so every copy's destructor is only the decrement and test
+template <typename X, typename C, typename D, typename S>
+__attribute__((noinline, cold)) void basic_ptr<X, C, D, S>::release(X* normal_ptr, ptr_counter* counter)
+{
+	ptr_releasing<X>(counter);
+	if ( counter->_release )
+	{
+		// storage came from somewhere special, let it be returned there
+		counter->_release(const_cast<void*>(static_cast<const void*>(normal_ptr)), counter);
+	}
+	else
+	{
+		// this is the last reference, delete the pointer and counter
+		D::destroy(normal_ptr);
+		S::template holder<X>::free_counter(counter);
+	}
+}
+
+
+
+// 
+// comparison
+//
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator==(const basic_ptr& other) const
+{
+	return _held.get() == other._held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator!=(const basic_ptr& other) const
+{
+	return _held.get() != other._held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator<(const basic_ptr& other) const
+{
+	return _held.get() < other._held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator<=(const basic_ptr& other) const
+{
+	return _held.get() <= other._held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator>(const basic_ptr& other) const
+{
+	return _held.get() > other._held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::operator>=(const basic_ptr& other) const
+{
+	return _held.get() >= other._held.get();
+}
+
+
+
+// 
+// use the pointer
+//
+template <typename X, typename C, typename D, typename S>
+inline X* basic_ptr<X, C, D, S>::operator->() const
+{
+	assert(_held.get());
+	return _held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline X& basic_ptr<X, C, D, S>::operator*() const
+{
+	assert(_held.get());
+	return *_held.get();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline X& basic_ptr<X, C, D, S>::operator[](size_t i)
+{
+	assert(_held.get());
+	return _held.get()[i];
+}
+
+template <typename X, typename C, typename D, typename S>
+inline const X& basic_ptr<X, C, D, S>::operator[](size_t i) const
+{
+	assert(_held.get());
+	return _held.get()[i];
+}
+
+
+
+//
+// check whether pointer is valid
+//
+template <typename X, typename C, typename D, typename S>
+inline basic_ptr<X, C, D, S>::operator bool() const
+{
+	return valid();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::valid() const
+{
+	return _held.get() && _held.counter();
+}
+
+template <typename X, typename C, typename D, typename S>
+inline size_t basic_ptr<X, C, D, S>::size() const
+{
+	return ptr_counted(_held.counter()) ? _held.counter()->_length : 0;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline ptr_counter* basic_ptr<X, C, D, S>::counter() const
+{
+	return _held.counter();
+}
+
+
+
+//
+// miscellaneous utility methods
+//
+template <typename X, typename C, typename D, typename S>
+inline unsigned basic_ptr<X, C, D, S>::copies() const
+{
+	if ( !ptr_counted(_held.counter()) )
+	{
+		// immortal pointers are shared by everyone, forever
+		return valid() ? ~0u : 0;
+	}
+	return C::count(_held.counter());
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::shared() const
+{
+	return copies() > 1;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::unique() const
+{
+	return copies() == 1;
+}
+
+template <typename X, typename C, typename D, typename S>
+inline bool basic_ptr<X, C, D, S>::unreferenced() const
+{
+	return copies() == 0;
+}
+
+
+
+//
+// immortal pointers
+//
+template <typename T>
+inline ptr<T> make_immortal(T* normal_ptr)
+{
+	return ptr<T>(normal_ptr, ptr_immortal_counter());
+}
+
+template <typename X>
+inline array_ptr<X> make_immortal_array(X* normal_ptr)
+{
+	return array_ptr<X>(normal_ptr, ptr_immortal_counter());
+}
+
+
+
+#endif // __ptr_inl__
+
@@ -0,0 +1,97 @@
+#ifndef __ptr_aligned_h__
+#define __ptr_aligned_h__
+
+
+
+//
+//
+//
+// over-aligned array_ptr<> allocation
+//
+//
+// new X[n] only promises alignment suitable for X (16 bytes at best from most
+// allocators), so a buffer of floats can start anywhere within a cache line
+// and SIMD kernels have to use unaligned loads or peel off a prologue.
+//
+// make_aligned_array<>() allocates with whatever alignment you ask for and
+// records it in the type of the handle it gives back:
+//
+//   aligned_array_ptr<float, 64> a = make_aligned_array<float, 64>(n);
+//
+//   float* p = a.data(); // the compiler knows p is 64-byte aligned
+//
+// so a kernel taking an aligned_array_ptr<float, 64> can rely on it without
+// checking.  The handle is an array_ptr<> in every other way, and may be
+// passed anywhere one is expected:
+//
+//   array_ptr<float> plain = a; // shares the same buffer
+//
+// Elements are value-initialized, the array_ptr<> knows its size(), and the
+// storage is handed back to free() on the last release.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+//
+// handy alignments
+//
+enum
+{
+	ptr_cacheline_alignment = 64,
+	ptr_simd_alignment      = 64,   // enough for AVX-512
+	ptr_page_alignment      = 4096
+};
+
+
+
+template <typename X, size_t Align>
+class aligned_array_ptr;
+
+//
+// allocate n elements aligned to Align bytes (a power of two)
+//
+template <typename X, size_t Align>
+aligned_array_ptr<X, Align> make_aligned_array(size_t n);
+
+
+
+//
+// an array_ptr<> whose storage is known to be aligned to Align bytes
+//
+template <typename X, size_t Align>
+class aligned_array_ptr : public array_ptr<X>
+{
+public:
+
+	enum { alignment = Align };
+
+	// default constructor
+	aligned_array_ptr();
+
+	// the elements, with the alignment promised to the compiler (or 0)
+	X* data() const;
+
+private:
+
+	// only make_aligned_array<>() can vouch for the alignment
+	aligned_array_ptr(X* normal_ptr, ptr_counter* counter);
+	friend aligned_array_ptr<X, Align> make_aligned_array<X, Align>(size_t n);
+
+};
+
+
+
+#define __ptr_aligned_inl_include__
+#include "ptr_aligned.inl"
+#undef __ptr_aligned_inl_include__
+
+
+
+#endif // __ptr_aligned_h__
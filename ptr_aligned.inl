@@ -0,0 +1,103 @@
+#if !defined(__ptr_aligned_inl_include__)
+#error "ptr_aligned.inl may only be included from ptr_aligned.h"
+#endif // !defined(__ptr_aligned_inl_include__)
+
+
+
+#ifndef __ptr_aligned_inl__
+#define __ptr_aligned_inl__
+
+
+
+#include <cstdlib>
+#include <new>
+
+#include <stdint.h>
+
+
+
+//
+// construction
+//
+template <typename X, size_t Align>
+inline aligned_array_ptr<X, Align>::aligned_array_ptr() : array_ptr<X>()
+{
+	// empty
+}
+
+template <typename X, size_t Align>
+inline aligned_array_ptr<X, Align>::aligned_array_ptr(X* normal_ptr, ptr_counter* counter) : array_ptr<X>(normal_ptr, counter)
+{
+	// empty
+}
+
+
+
+//
+// use the pointer
+//
+template <typename X, size_t Align>
+inline X* aligned_array_ptr<X, Align>::data() const
+{
+	return this->valid() ? static_cast<X*>(__builtin_assume_aligned(this->operator->(), Align)) : 0;
+}
+
+
+
+//
+// element destruction
+//
+template <typename X>
+inline void ptr_aligned_release(void* normal_ptr, ptr_counter* counter)
+{
+	X* p = static_cast<X*>(normal_ptr);
+	for ( size_t i = 0; i < counter->_length; ++i )
+	{
+		p[i].~X();
+	}
+	free(normal_ptr);
+	delete counter;
+}
+
+
+
+//
+// the factory
+//
+template <typename X, size_t Align>
+inline aligned_array_ptr<X, Align> make_aligned_array(size_t n)
+{
+	static_assert(Align && (Align & (Align - 1)) == 0, "alignment must be a power of two");
+	static_assert(Align >= alignof(X), "alignment must be at least X's own");
+
+	// (more elements than there are bytes to address can't be had either)
+	void* mem = 0;
+	if ( !n || n > SIZE_MAX / sizeof(X) || posix_memalign(&mem, Align < sizeof(void*) ? sizeof(void*) : Align, n * sizeof(X)) != 0 )
+	{
+		return aligned_array_ptr<X, Align>();
+	}
+
+	X*     p           = static_cast<X*>(mem);
+	size_t constructed = 0;
+	try
+	{
+		for ( ; constructed < n; ++constructed )
+		{
+			new (p + constructed) X();
+		}
+		return aligned_array_ptr<X, Align>(p, new ptr_counter(n, ptr_aligned_release<X>));
+	}
+	catch ( ... )
+	{
+		while ( constructed > 0 )
+		{
+			p[--constructed].~X();
+		}
+		free(mem);
+		throw;
+	}
+}
+
+
+
+#endif // __ptr_aligned_inl__
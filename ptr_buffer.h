@@ -0,0 +1,128 @@
+#ifndef __ptr_buffer_h__
+#define __ptr_buffer_h__
+
+
+
+//
+//
+//
+// immutable byte buffers with zero-copy slicing
+//
+//
+// An array_ptr<char> can hand a received message around without copying it,
+// but not a piece of one, so parsers end up copying every field they pull out
+// into a std::string of its own.  A byte_buffer is a read-only view of part
+// of an array_ptr<char>'s bytes that holds a reference to the whole thing.
+// Slicing one makes another view of the same bytes, sharing the same control
+// block, and never allocates:
+//
+//   array_ptr<char> raw = make_uninitialized_array<char>(4096);
+//   size_t          got = read(fd, &raw[0], 4096);
+//
+//   byte_buffer message(raw, got);           // "GET /index.html HTTP/1.1\r\n..."
+//   byte_buffer line   = message.split("\r\n");
+//   byte_buffer method = line.split(' ');    // "GET"
+//   byte_buffer path   = line.split(' ');    // "/index.html"
+//   if ( method == "GET" && path.starts_with("/") )
+//     ...
+//
+// split() hands back everything up to the first delimiter and moves the view
+// it was called on past it (when there's no delimiter you get the lot, and
+// the view is left empty).  The bytes stay alive for as long as any view of
+// them does, so slices may be kept after the message they came from is gone.
+// Keep in mind that a small slice keeps its whole buffer around with it;
+// str() copies a slice out when that matters.
+//
+// Nothing here writes to the bytes, but nothing stops whoever holds the
+// array_ptr<char> from doing so either.  Don't, once you've made views of it.
+// The views themselves are as thread-safe as the array_ptr<> they hold, which
+// is to say copying and dropping them isn't.
+//
+//
+
+
+
+#include <cstddef>
+#include <string>
+
+#include "ptr.h"
+
+
+
+class byte_buffer
+{
+public:
+
+	static constexpr size_t npos = size_t(-1);
+
+	// empty
+	byte_buffer();
+
+	// the first length bytes of storage, or all of them (when its size() is
+	// known), no copying
+	byte_buffer(const array_ptr<char>& storage);
+	byte_buffer(const array_ptr<char>& storage, size_t length);
+
+	// a copy of some bytes, or of a C string, in a buffer of its own
+	byte_buffer(const void* bytes, size_t length);
+	explicit byte_buffer(const char* s);
+
+	// access
+	const char* data() const;
+	size_t size() const;
+	bool empty() const;
+	const char* begin() const;
+	const char* end() const;
+	char operator[](size_t i) const;
+
+	// a view of n bytes from pos on (as many as there are), sharing our bytes
+	byte_buffer substr(size_t pos, size_t n = npos) const;
+
+	// index of the first match at or after pos, npos if there isn't one
+	size_t find(char c, size_t pos = 0) const;
+	size_t find(const char* s, size_t pos = 0) const;
+	size_t find(const byte_buffer& s, size_t pos = 0) const;
+
+	// everything before the first delimiter, and move past the delimiter
+	byte_buffer split(char delim);
+	byte_buffer split(const char* delim);
+
+	// narrow the view
+	void remove_prefix(size_t n);
+	void remove_suffix(size_t n);
+
+	// comparison by contents
+	bool starts_with(const char* s) const;
+	bool operator==(const byte_buffer& other) const;
+	bool operator!=(const byte_buffer& other) const;
+	bool operator==(const char* s) const;
+	bool operator!=(const char* s) const;
+
+	// a copy, for keeping without keeping the whole buffer
+	std::string str() const;
+
+	// whether two views share the same underlying buffer
+	bool shares(const byte_buffer& other) const;
+
+private:
+
+	// the match of n bytes at s, or npos
+	size_t find_bytes(const char* s, size_t n, size_t pos) const;
+	byte_buffer split_at(size_t at, size_t skip);
+
+	// data
+	array_ptr<char> _storage;
+	size_t          _offset;
+	size_t          _length;
+
+};
+
+
+
+#define __ptr_buffer_inl_include__
+#include "ptr_buffer.inl"
+#undef __ptr_buffer_inl_include__
+
+
+
+#endif // __ptr_buffer_h__
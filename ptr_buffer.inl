@@ -0,0 +1,247 @@
+#if !defined(__ptr_buffer_inl_include__)
+#error "ptr_buffer.inl may only be included from ptr_buffer.h"
+#endif // !defined(__ptr_buffer_inl_include__)
+
+
+
+#ifndef __ptr_buffer_inl__
+#define __ptr_buffer_inl__
+
+
+
+#include <cassert>
+#include <cstring>
+
+
+
+//
+// construction
+//
+inline byte_buffer::byte_buffer() : _offset(0), _length(0)
+{
+	// empty
+}
+
+inline byte_buffer::byte_buffer(const array_ptr<char>& storage) : _storage(storage), _offset(0), _length(storage.size())
+{
+	// empty
+}
+
+inline byte_buffer::byte_buffer(const array_ptr<char>& storage, size_t length) : _storage(storage), _offset(0), _length(length)
+{
+	assert(length == 0 || storage.valid());
+	assert(storage.size() == 0 || length <= storage.size());
+}
+
+inline byte_buffer::byte_buffer(const void* bytes, size_t length) : _offset(0), _length(length)
+{
+	if ( length )
+	{
+		char* copy = new char[length];
+		memcpy(copy, bytes, length);
+		_storage = array_ptr<char>(copy, new ptr_counter(length, 0));
+	}
+}
+
+inline byte_buffer::byte_buffer(const char* s) : _offset(0), _length(0)
+{
+	*this = byte_buffer(s, strlen(s));
+}
+
+
+
+//
+// access
+//
+inline const char* byte_buffer::data() const
+{
+	return _length ? _storage.operator->() + _offset : 0;
+}
+
+inline size_t byte_buffer::size() const
+{
+	return _length;
+}
+
+inline bool byte_buffer::empty() const
+{
+	return _length == 0;
+}
+
+inline const char* byte_buffer::begin() const
+{
+	return data();
+}
+
+inline const char* byte_buffer::end() const
+{
+	return data() + _length;
+}
+
+inline char byte_buffer::operator[](size_t i) const
+{
+	assert(i < _length);
+	return data()[i];
+}
+
+
+
+//
+// slicing
+//
+inline byte_buffer byte_buffer::substr(size_t pos, size_t n) const
+{
+	assert(pos <= _length);
+
+	byte_buffer slice(*this);
+	slice._offset += pos;
+	slice._length  = n < _length - pos ? n : _length - pos;
+	return slice;
+}
+
+inline void byte_buffer::remove_prefix(size_t n)
+{
+	assert(n <= _length);
+	_offset += n;
+	_length -= n;
+}
+
+inline void byte_buffer::remove_suffix(size_t n)
+{
+	assert(n <= _length);
+	_length -= n;
+}
+
+inline byte_buffer byte_buffer::split_at(size_t at, size_t skip)
+{
+	if ( at == npos )
+	{
+		// no delimiter, the head is all there is
+		byte_buffer head(*this);
+		_offset += _length;
+		_length  = 0;
+		return head;
+	}
+
+	byte_buffer head = substr(0, at);
+	remove_prefix(at + skip);
+	return head;
+}
+
+inline byte_buffer byte_buffer::split(char delim)
+{
+	return split_at(find(delim), 1);
+}
+
+inline byte_buffer byte_buffer::split(const char* delim)
+{
+	const size_t n = strlen(delim);
+	return split_at(find_bytes(delim, n, 0), n);
+}
+
+
+
+//
+// searching
+//
+inline size_t byte_buffer::find(char c, size_t pos) const
+{
+	if ( pos >= _length )
+	{
+		return npos;
+	}
+
+	const char* p     = data();
+	const void* found = memchr(p + pos, c, _length - pos);
+	return found ? size_t(static_cast<const char*>(found) - p) : npos;
+}
+
+inline size_t byte_buffer::find(const char* s, size_t pos) const
+{
+	return find_bytes(s, strlen(s), pos);
+}
+
+inline size_t byte_buffer::find(const byte_buffer& s, size_t pos) const
+{
+	return find_bytes(s.data(), s.size(), pos);
+}
+
+inline size_t byte_buffer::find_bytes(const char* s, size_t n, size_t pos) const
+{
+	if ( pos > _length || n > _length - pos )
+	{
+		return npos;
+	}
+	if ( n == 0 )
+	{
+		return pos;
+	}
+
+	// let memchr() skip ahead to each candidate first byte
+	const char* p    = data();
+	const char* last = p + _length - n;
+	for ( const char* at = p + pos; at <= last; ++at )
+	{
+		at = static_cast<const char*>(memchr(at, s[0], size_t(last - at) + 1));
+		if ( !at )
+		{
+			break;
+		}
+		if ( memcmp(at + 1, s + 1, n - 1) == 0 )
+		{
+			return size_t(at - p);
+		}
+	}
+	return npos;
+}
+
+
+
+//
+// comparison
+//
+inline bool byte_buffer::starts_with(const char* s) const
+{
+	const size_t n = strlen(s);
+	return n <= _length && (n == 0 || memcmp(data(), s, n) == 0);
+}
+
+inline bool byte_buffer::operator==(const byte_buffer& other) const
+{
+	return _length == other._length && (_length == 0 || memcmp(data(), other.data(), _length) == 0);
+}
+
+inline bool byte_buffer::operator!=(const byte_buffer& other) const
+{
+	return !(*this == other);
+}
+
+inline bool byte_buffer::operator==(const char* s) const
+{
+	const size_t n = strlen(s);
+	return _length == n && (n == 0 || memcmp(data(), s, n) == 0);
+}
+
+inline bool byte_buffer::operator!=(const char* s) const
+{
+	return !(*this == s);
+}
+
+
+
+//
+// everything else
+//
+inline std::string byte_buffer::str() const
+{
+	return _length ? std::string(data(), _length) : std::string();
+}
+
+inline bool byte_buffer::shares(const byte_buffer& other) const
+{
+	return _storage.valid() && _storage == other._storage;
+}
+
+
+
+#endif // __ptr_buffer_inl__
@@ -0,0 +1,174 @@
+#ifndef __ptr_cache_h__
+#define __ptr_cache_h__
+
+
+
+//
+//
+//
+// a cache with a budget, that evicts what only it is holding on to
+//
+//
+// Caching expensive results as ptr<>s has a catch when it comes to staying
+// within a memory budget: evicting an entry that someone else still holds a
+// reference to saves nothing, the object lives on regardless, and meanwhile
+// whatever was evicted has to be computed again next time.  A ptr_cache<>
+// keeps count of the bytes its entries stand for, and when a new one would
+// go over its budget it evicts the least recently used entries whose only
+// reference is its own, so each eviction really does give memory back:
+//
+//   ptr_cache<std::string, Image> thumbnails(64 << 20);  // 64MB
+//
+//   ptr_cache<std::string, Image>::value_ptr t = thumbnails.get(path);
+//   if ( !t )
+//   {
+//     t = render(path);
+//     thumbnails.put(path, t, t->bytes());
+//   }
+//
+//   ptr_cache_stats s = thumbnails.stats();
+//   printf("%.1f%% hits, %llu bytes freed\n", s.hit_rate * 100.0, s.reclaimed);
+//
+// Recency is kept the CLOCK way: every get() sets a bit on its entry, and the
+// hand sweeping the entries for something to evict clears the bits it passes
+// and skips those it had to clear, as well as any that are in use elsewhere
+// (which are left until they aren't).  Only when two full sweeps find nothing
+// are entries in use elsewhere evicted, whichever the hand comes to first,
+// since the cache has to stay within its budget somehow.  Those bytes are
+// counted as evicted, but not as reclaimed.
+//
+// Values are held, and handed back, as basic_ptr<V, ptr_synchronized> (the
+// value_ptr typedef) since any number of threads may get() them at once.  The
+// cache is split into shards by the keys' hashes, each with its own lock, so
+// threads only contend when their keys land in the same shard.  Each shard
+// aims for an equal share of the budget: a put() makes room in its own shard
+// while that's over its share, and whatever more it needs comes from the
+// other shards, those over their share first, so any entry up to the whole
+// budget can be cached.  Evicted values are let go of after the shard is
+// unlocked, so their destructors may use the cache too.
+//
+//
+
+
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// what the cache has been up to, since it was made or last reset
+//
+struct ptr_cache_stats
+{
+	uint64_t hits;
+	uint64_t misses;
+	double   hit_rate;   // hits / (hits + misses), 0 before any get()s
+	uint64_t puts;
+	uint64_t evictions;  // entries
+	uint64_t evicted;    // bytes
+	uint64_t reclaimed;  // bytes actually freed, the evictions of values
+	                     // nobody else was holding
+	uint64_t bytes;      // held right now
+	uint64_t entries;    // held right now
+};
+
+
+
+template <typename K, typename V, typename Hash = std::hash<K> >
+class ptr_cache
+{
+public:
+
+	// what values are held as, and handed back as
+	typedef basic_ptr<V, ptr_synchronized> value_ptr;
+
+	// an empty cache holding at most budget bytes, in shards (a power of two)
+	explicit ptr_cache(size_t budget, unsigned shards = 16);
+	~ptr_cache();
+
+	// the value for key, null if it isn't cached
+	value_ptr get(const K& key);
+
+	// cache value under key, replacing whatever was there, as standing for
+	// that many bytes (returns false if that's more than the whole budget, in
+	// which case nothing is cached under key any more)
+	bool put(const K& key, const value_ptr& value, size_t bytes);
+
+	// stop caching key, returns what was cached (null if nothing was)
+	value_ptr erase(const K& key);
+
+	// stop caching everything
+	void clear();
+
+	// the budget, in bytes
+	size_t budget() const;
+
+	// counts of what's happened so far, and what's there now
+	ptr_cache_stats stats() const;
+	void reset_stats();
+
+private:
+
+	// not copyable
+	ptr_cache(const ptr_cache&);
+	ptr_cache& operator=(const ptr_cache&);
+
+	struct entry
+	{
+		K         _key;
+		value_ptr _value;
+		size_t    _bytes;
+		bool      _referenced; // got since the hand last came by
+		bool      _used;       // or free, for the next put()
+	};
+
+	struct alignas(64) shard
+	{
+		std::mutex                                _lock;
+		std::vector<entry>                        _entries;
+		std::vector<size_t>                       _free;
+		std::unordered_map<K, size_t, Hash>       _index;
+		size_t                                    _hand;
+		size_t                                    _bytes;
+		size_t                                    _budget;   // its share
+		ptr_cache_stats                           _stats;
+	};
+
+	shard& shard_of(const K& key);
+
+	// move the hand on to something to evict, false if two sweeps found
+	// nothing (only evicting what's in use elsewhere if allowed to)
+	bool evict(shard& s, bool in_use, std::vector<value_ptr>& dropped);
+	void remove(shard& s, size_t i, std::vector<value_ptr>& dropped);
+
+	// evict from the shards other than the i'th until the whole cache is
+	// within budget
+	void borrow(size_t i);
+
+	// data
+	shard*              _shards;
+	const size_t        _mask;
+	const size_t        _budget;
+	std::atomic<size_t> _bytes;  // held, across every shard
+	Hash                _hash;
+
+};
+
+
+
+#define __ptr_cache_inl_include__
+#include "ptr_cache.inl"
+#undef __ptr_cache_inl_include__
+
+
+
+#endif // __ptr_cache_h__
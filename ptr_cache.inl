@@ -0,0 +1,305 @@
+#if !defined(__ptr_cache_inl_include__)
+#error "ptr_cache.inl may only be included from ptr_cache.h"
+#endif // !defined(__ptr_cache_inl_include__)
+
+
+
+#ifndef __ptr_cache_inl__
+#define __ptr_cache_inl__
+
+
+
+#include <cstring>
+
+
+
+// a power of two, at least one
+inline size_t ptr_cache_shards(unsigned shards)
+{
+	size_t n = 1;
+	while ( n < shards )
+	{
+		n *= 2;
+	}
+	return n;
+}
+
+
+
+//
+// construction and destruction
+//
+template <typename K, typename V, typename Hash>
+inline ptr_cache<K, V, Hash>::ptr_cache(size_t budget, unsigned shards) : _shards(0), _mask(ptr_cache_shards(shards) - 1), _budget(budget), _bytes(0)
+{
+	_shards = new shard[_mask + 1];
+	for ( size_t i = 0; i <= _mask; ++i )
+	{
+		_shards[i]._hand   = 0;
+		_shards[i]._bytes  = 0;
+		_shards[i]._budget = budget / (_mask + 1);
+		memset(&_shards[i]._stats, 0, sizeof(ptr_cache_stats));
+	}
+}
+
+template <typename K, typename V, typename Hash>
+inline ptr_cache<K, V, Hash>::~ptr_cache()
+{
+	delete[] _shards;
+}
+
+template <typename K, typename V, typename Hash>
+inline typename ptr_cache<K, V, Hash>::shard& ptr_cache<K, V, Hash>::shard_of(const K& key)
+{
+	return _shards[((uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ull) >> 32) & _mask];
+}
+
+
+
+//
+// getting and putting
+//
+template <typename K, typename V, typename Hash>
+inline typename ptr_cache<K, V, Hash>::value_ptr ptr_cache<K, V, Hash>::get(const K& key)
+{
+	shard&                      s = shard_of(key);
+	std::lock_guard<std::mutex> guard(s._lock);
+
+	typename std::unordered_map<K, size_t, Hash>::const_iterator it = s._index.find(key);
+	if ( it == s._index.end() )
+	{
+		s._stats.misses++;
+		return value_ptr();
+	}
+
+	s._stats.hits++;
+	entry& e = s._entries[it->second];
+	e._referenced = true;
+	return e._value;
+}
+
+template <typename K, typename V, typename Hash>
+inline bool ptr_cache<K, V, Hash>::put(const K& key, const value_ptr& value, size_t bytes)
+{
+	shard&                 s = shard_of(key);
+	std::vector<value_ptr> dropped;
+	bool                   cached = false;
+	{
+		std::lock_guard<std::mutex> guard(s._lock);
+		s._stats.puts++;
+
+		// whatever's there already makes way first
+		typename std::unordered_map<K, size_t, Hash>::iterator it = s._index.find(key);
+		if ( it != s._index.end() )
+		{
+			remove(s, it->second, dropped);
+		}
+
+		if ( bytes <= _budget )
+		{
+			// then, while this shard is over its share, the least recently
+			// used that nobody else has, and failing that, the least recently
+			// used
+			while ( _bytes + bytes > _budget && s._bytes + bytes > s._budget && (evict(s, false, dropped) || evict(s, true, dropped)) )
+			{
+				// keep going
+			}
+
+			size_t i;
+			if ( s._free.empty() )
+			{
+				i = s._entries.size();
+				s._entries.push_back(entry());
+			}
+			else
+			{
+				i = s._free.back();
+				s._free.pop_back();
+			}
+
+			entry& e      = s._entries[i];
+			e._key        = key;
+			e._value      = value;
+			e._bytes      = bytes;
+			e._referenced = false;
+			e._used       = true;
+			s._index[key] = i;
+			s._bytes     += bytes;
+			_bytes       += bytes;
+			cached        = true;
+		}
+	}
+
+	// (dropped goes here, with the shard unlocked, and anything more that
+	// has to go comes from the other shards)
+	if ( _bytes > _budget )
+	{
+		borrow(size_t(&s - _shards));
+	}
+	return cached;
+}
+
+template <typename K, typename V, typename Hash>
+inline typename ptr_cache<K, V, Hash>::value_ptr ptr_cache<K, V, Hash>::erase(const K& key)
+{
+	shard&                 s = shard_of(key);
+	std::vector<value_ptr> dropped;
+	{
+		std::lock_guard<std::mutex> guard(s._lock);
+		typename std::unordered_map<K, size_t, Hash>::iterator it = s._index.find(key);
+		if ( it == s._index.end() )
+		{
+			return value_ptr();
+		}
+		remove(s, it->second, dropped);
+	}
+	return dropped.back();
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_cache<K, V, Hash>::clear()
+{
+	for ( size_t i = 0; i <= _mask; ++i )
+	{
+		shard&                 s = _shards[i];
+		std::vector<value_ptr> dropped;
+		{
+			std::lock_guard<std::mutex> guard(s._lock);
+			for ( size_t j = 0; j < s._entries.size(); ++j )
+			{
+				if ( s._entries[j]._used )
+				{
+					remove(s, j, dropped);
+				}
+			}
+		}
+	}
+}
+
+
+
+//
+// eviction
+//
+template <typename K, typename V, typename Hash>
+inline bool ptr_cache<K, V, Hash>::evict(shard& s, bool in_use, std::vector<value_ptr>& dropped)
+{
+	// two sweeps, the first may only be clearing bits
+	const size_t n = s._entries.size();
+	for ( size_t steps = 0; steps < 2 * n; ++steps )
+	{
+		const size_t i = s._hand;
+		entry&       e = s._entries[i];
+		s._hand = (i + 1 < n) ? i + 1 : 0;
+
+		if ( !e._used )
+		{
+			continue;
+		}
+		if ( e._referenced )
+		{
+			e._referenced = false;
+			continue;
+		}
+		if ( !in_use && !e._value.unique() )
+		{
+			continue;
+		}
+
+		// only the cache can hand out copies, and it's locked, so a value
+		// that's unique() now is certain to be freed once it's dropped
+		s._stats.evictions++;
+		s._stats.evicted += e._bytes;
+		if ( e._value.unique() )
+		{
+			s._stats.reclaimed += e._bytes;
+		}
+		remove(s, i, dropped);
+		return true;
+	}
+	return false;
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_cache<K, V, Hash>::borrow(size_t i)
+{
+	// first only from shards over their share, then from any, one shard
+	// locked at a time (the i'th has already made what room it can, and
+	// holds the entry that's being made room for)
+	for ( int round = 0; round < 2 && _bytes > _budget; ++round )
+	{
+		for ( size_t j = 1; j <= _mask && _bytes > _budget; ++j )
+		{
+			shard&                 s = _shards[(i + j) & _mask];
+			std::vector<value_ptr> dropped;
+			{
+				std::lock_guard<std::mutex> guard(s._lock);
+				while ( _bytes > _budget && (round || s._bytes > s._budget) && (evict(s, false, dropped) || evict(s, true, dropped)) )
+				{
+					// keep going
+				}
+			}
+		}
+	}
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_cache<K, V, Hash>::remove(shard& s, size_t i, std::vector<value_ptr>& dropped)
+{
+	entry& e = s._entries[i];
+	s._index.erase(e._key);
+	s._bytes -= e._bytes;
+	_bytes   -= e._bytes;
+	dropped.push_back(e._value);
+	e._value = 0;
+	e._used  = false;
+	s._free.push_back(i);
+}
+
+
+
+//
+// statistics
+//
+template <typename K, typename V, typename Hash>
+inline size_t ptr_cache<K, V, Hash>::budget() const
+{
+	return _budget;
+}
+
+template <typename K, typename V, typename Hash>
+inline ptr_cache_stats ptr_cache<K, V, Hash>::stats() const
+{
+	ptr_cache_stats total;
+	memset(&total, 0, sizeof(total));
+	for ( size_t i = 0; i <= _mask; ++i )
+	{
+		shard&                      s = _shards[i];
+		std::lock_guard<std::mutex> guard(s._lock);
+		total.hits      += s._stats.hits;
+		total.misses    += s._stats.misses;
+		total.puts      += s._stats.puts;
+		total.evictions += s._stats.evictions;
+		total.evicted   += s._stats.evicted;
+		total.reclaimed += s._stats.reclaimed;
+		total.bytes     += s._bytes;
+		total.entries   += s._index.size();
+	}
+	total.hit_rate = (total.hits + total.misses) ? double(total.hits) / double(total.hits + total.misses) : 0.0;
+	return total;
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_cache<K, V, Hash>::reset_stats()
+{
+	for ( size_t i = 0; i <= _mask; ++i )
+	{
+		shard&                      s = _shards[i];
+		std::lock_guard<std::mutex> guard(s._lock);
+		memset(&s._stats, 0, sizeof(ptr_cache_stats));
+	}
+}
+
+
+
+#endif // __ptr_cache_inl__
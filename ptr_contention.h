@@ -0,0 +1,98 @@
+#ifndef __ptr_contention_h__
+#define __ptr_contention_h__
+
+
+
+//
+//
+//
+// finding the counters that more than one thread is counting
+//
+//
+// A ptr<>'s counter is only meant to be counted by one thread at a time.  When
+// copies of it are made and dropped by one thread after another, its cache
+// line follows them around (and, without the handoff being synchronized, the
+// count gets corrupted).  With PTR_CONTENTION defined every control block
+// remembers the last thread to count it, and counts how many times that has
+// changed.  The ones that have moved at all are kept track of, so the worst
+// of them can be reported along with their types:
+//
+//   g++ -DPTR_CONTENTION ...
+//
+//   ...
+//   ptr_contention_write(std::cerr);   // top 20 objects, and every type
+//
+// which is where to look for counters worth sharding (see sharded_ptr<>),
+// making immortal, or not sharing at all.
+//
+// It must be defined for the whole program (it adds fields to the control
+// block), so do it on the command line.  Counting from the thread that last
+// counted costs a thread-local address and a compare, the rest is only paid
+// when a counter changes hands.  Objects are reported by the address of their
+// control block and the type the ptr<> that first owned them was declared
+// with.  Released objects are still counted in their type's totals.
+//
+//
+
+
+
+#if !defined(PTR_CONTENTION)
+#error "contention is only tracked when PTR_CONTENTION is defined (for the whole program)"
+#endif
+
+
+
+#include <cstddef>
+#include <ostream>
+#include <typeinfo>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// objects still alive, those that have changed threads most often first
+//
+struct ptr_contention_object
+{
+	const void*           counter; // its control block
+	const std::type_info* type;    // 0 if unknown
+	uint64_t              migrations;
+};
+
+std::vector<ptr_contention_object> ptr_contention_top(size_t n);
+
+//
+// totals by type, alive or not, busiest first
+//
+struct ptr_contention_type
+{
+	const std::type_info* type;       // 0 if unknown
+	uint64_t              objects;    // that have changed threads at all
+	uint64_t              migrations;
+};
+
+std::vector<ptr_contention_type> ptr_contention_types();
+
+//
+// the top n objects and every type, as text
+//
+void ptr_contention_write(std::ostream& out, size_t n = 20);
+
+//
+// start counting again from nothing
+//
+void ptr_contention_reset();
+
+
+
+#define __ptr_contention_inl_include__
+#include "ptr_contention.inl"
+#undef __ptr_contention_inl_include__
+
+
+
+#endif // __ptr_contention_h__
@@ -0,0 +1,208 @@
+#if !defined(__ptr_contention_inl_include__)
+#error "ptr_contention.inl may only be included from ptr_contention.h"
+#endif // !defined(__ptr_contention_inl_include__)
+
+
+
+#ifndef __ptr_contention_inl__
+#define __ptr_contention_inl__
+
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <cxxabi.h>
+
+
+
+//
+// every counter that's changed threads, and the totals of those released
+//
+struct ptr_contention_entry
+{
+	const std::type_info* _type;
+	uint64_t              _baseline; // migrations as of the last reset
+};
+
+struct ptr_contention_totals
+{
+	ptr_contention_totals() : _objects(0), _migrations(0) { /* empty */ };
+	uint64_t _objects;
+	uint64_t _migrations;
+};
+
+struct ptr_contention_state
+{
+	std::mutex                                                   _lock;
+	std::unordered_map<const ptr_counter*, ptr_contention_entry> _live;
+	std::map<const std::type_info*, ptr_contention_totals>       _released;
+};
+
+// never destroyed, pointers released during static destruction still find it
+inline ptr_contention_state& ptr_contention_instance()
+{
+	static ptr_contention_state* s_state = new ptr_contention_state;
+	return *s_state;
+}
+
+
+
+//
+// the hooks called from ptr.inl
+//
+inline void ptr_contention_migrated(ptr_counter* counter, uintptr_t thread)
+{
+	// the first thread to count it isn't a change
+	const uintptr_t previous = counter->_owner.exchange(thread, std::memory_order_relaxed);
+	if ( !previous || previous == thread )
+	{
+		return;
+	}
+
+	if ( counter->_migrations.fetch_add(1, std::memory_order_relaxed) == 0 )
+	{
+		ptr_contention_state&       state = ptr_contention_instance();
+		std::lock_guard<std::mutex> guard(state._lock);
+		ptr_contention_entry        entry = { counter->_type, 0 };
+		state._live[counter] = entry;
+	}
+}
+
+inline void ptr_contention_forget(ptr_counter* counter)
+{
+	ptr_contention_state&       state = ptr_contention_instance();
+	std::lock_guard<std::mutex> guard(state._lock);
+
+	std::unordered_map<const ptr_counter*, ptr_contention_entry>::iterator it = state._live.find(counter);
+	if ( it != state._live.end() )
+	{
+		const uint64_t migrations = counter->_migrations.load(std::memory_order_relaxed) - it->second._baseline;
+		if ( migrations )
+		{
+			ptr_contention_totals& totals = state._released[it->second._type];
+			totals._objects    += 1;
+			totals._migrations += migrations;
+		}
+		state._live.erase(it);
+	}
+}
+
+
+
+//
+// reporting
+//
+inline bool ptr_contention_worse(const ptr_contention_object& a, const ptr_contention_object& b)
+{
+	return a.migrations > b.migrations;
+}
+
+inline std::vector<ptr_contention_object> ptr_contention_top(size_t n)
+{
+	std::vector<ptr_contention_object> top;
+	{
+		ptr_contention_state&       state = ptr_contention_instance();
+		std::lock_guard<std::mutex> guard(state._lock);
+		for ( std::unordered_map<const ptr_counter*, ptr_contention_entry>::const_iterator it = state._live.begin(); it != state._live.end(); ++it )
+		{
+			ptr_contention_object object = { it->first, it->second._type, it->first->_migrations.load(std::memory_order_relaxed) - it->second._baseline };
+			if ( object.migrations )
+			{
+				top.push_back(object);
+			}
+		}
+	}
+
+	const size_t keep = std::min(n, top.size());
+	std::partial_sort(top.begin(), top.begin() + keep, top.end(), ptr_contention_worse);
+	top.resize(keep);
+	return top;
+}
+
+inline bool ptr_contention_busier(const ptr_contention_type& a, const ptr_contention_type& b)
+{
+	return a.migrations > b.migrations;
+}
+
+inline std::vector<ptr_contention_type> ptr_contention_types()
+{
+	std::map<const std::type_info*, ptr_contention_totals> totals;
+	{
+		ptr_contention_state&       state = ptr_contention_instance();
+		std::lock_guard<std::mutex> guard(state._lock);
+		totals = state._released;
+		for ( std::unordered_map<const ptr_counter*, ptr_contention_entry>::const_iterator it = state._live.begin(); it != state._live.end(); ++it )
+		{
+			const uint64_t migrations = it->first->_migrations.load(std::memory_order_relaxed) - it->second._baseline;
+			if ( migrations )
+			{
+				totals[it->second._type]._objects    += 1;
+				totals[it->second._type]._migrations += migrations;
+			}
+		}
+	}
+
+	std::vector<ptr_contention_type> types;
+	for ( std::map<const std::type_info*, ptr_contention_totals>::const_iterator it = totals.begin(); it != totals.end(); ++it )
+	{
+		ptr_contention_type type = { it->first, it->second._objects, it->second._migrations };
+		types.push_back(type);
+	}
+	std::sort(types.begin(), types.end(), ptr_contention_busier);
+	return types;
+}
+
+inline std::string ptr_contention_type_name(const std::type_info* type)
+{
+	if ( !type )
+	{
+		return "(unknown)";
+	}
+	int         status    = 0;
+	char*       demangled = abi::__cxa_demangle(type->name(), 0, 0, &status);
+	std::string name(status == 0 && demangled ? demangled : type->name());
+	free(demangled);
+	return name;
+}
+
+inline void ptr_contention_write(std::ostream& out, size_t n)
+{
+	const std::vector<ptr_contention_object> top   = ptr_contention_top(n);
+	const std::vector<ptr_contention_type>   types = ptr_contention_types();
+
+	char line[64];
+	out << "ptr<> counters changing threads, most often first\n\n";
+	for ( size_t i = 0; i < top.size(); ++i )
+	{
+		snprintf(line, sizeof(line), "%12llu  %p  ", (unsigned long long)top[i].migrations, top[i].counter);
+		out << line << ptr_contention_type_name(top[i].type) << "\n";
+	}
+
+	out << "\nby type (migrations, objects)\n\n";
+	for ( size_t i = 0; i < types.size(); ++i )
+	{
+		snprintf(line, sizeof(line), "%12llu %10llu  ", (unsigned long long)types[i].migrations, (unsigned long long)types[i].objects);
+		out << line << ptr_contention_type_name(types[i].type) << "\n";
+	}
+}
+
+inline void ptr_contention_reset()
+{
+	ptr_contention_state&       state = ptr_contention_instance();
+	std::lock_guard<std::mutex> guard(state._lock);
+	state._released.clear();
+	for ( std::unordered_map<const ptr_counter*, ptr_contention_entry>::iterator it = state._live.begin(); it != state._live.end(); ++it )
+	{
+		it->second._baseline = it->first->_migrations.load(std::memory_order_relaxed);
+	}
+}
+
+
+
+#endif // __ptr_contention_inl__
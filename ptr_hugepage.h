@@ -0,0 +1,73 @@
+#ifndef __ptr_hugepage_h__
+#define __ptr_hugepage_h__
+
+
+
+//
+//
+//
+// huge page backed array_ptr<> allocation
+//
+//
+// Scanning a multi-gigabyte array in 4KB pages means a TLB miss every 4KB,
+// which quickly dominates once the data itself is streaming in nicely.
+// make_huge_array<>() maps the storage on huge page boundaries and asks the
+// kernel to back it with huge pages (2MB on x86-64), so one TLB entry covers
+// 512 times as much:
+//
+//   // transparent huge pages via madvise(MADV_HUGEPAGE)
+//   array_ptr<float> a = make_huge_array<float>(n);
+//
+//   // explicit MAP_HUGETLB pages from the reserved pool (see
+//   // /proc/sys/vm/nr_hugepages), falling back to transparent ones
+//   array_ptr<float> b = make_huge_array<float>(n, huge_explicit);
+//
+// Every mode degrades gracefully: no reserved pool means transparent huge
+// pages, transparent huge pages turned off means ordinary pages.  You always
+// get a working buffer (unless the mapping fails outright, in which case you
+// get an invalid array_ptr<>).
+//
+// Elements are value-initialized, the array_ptr<> knows its size(), and the
+// mapping is released with munmap() on the last release.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+enum huge_pages
+{
+	huge_none,        // huge page aligned, but ordinary pages (for comparison)
+	huge_transparent, // madvise(MADV_HUGEPAGE)
+	huge_explicit     // MAP_HUGETLB, else transparent
+};
+
+
+
+//
+// allocate n elements backed by huge pages
+//
+template <typename X>
+array_ptr<X> make_huge_array(size_t n, huge_pages mode = huge_transparent);
+
+
+
+//
+// the system's default huge page size (2MB if unknown)
+//
+size_t ptr_huge_page_size();
+
+
+
+#define __ptr_hugepage_inl_include__
+#include "ptr_hugepage.inl"
+#undef __ptr_hugepage_inl_include__
+
+
+
+#endif // __ptr_hugepage_h__
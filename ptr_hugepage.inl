@@ -0,0 +1,169 @@
+#if !defined(__ptr_hugepage_inl_include__)
+#error "ptr_hugepage.inl may only be included from ptr_hugepage.h"
+#endif // !defined(__ptr_hugepage_inl_include__)
+
+
+
+#ifndef __ptr_hugepage_inl__
+#define __ptr_hugepage_inl__
+
+
+
+#include <cstdio>
+#include <new>
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+
+
+//
+// machine configuration
+//
+inline size_t ptr_huge_read_page_size()
+{
+	// "Hugepagesize:       2048 kB"
+	unsigned long kb = 2048;
+	FILE*         f  = fopen("/proc/meminfo", "r");
+	if ( f )
+	{
+		char line[256];
+		while ( fgets(line, sizeof(line), f) )
+		{
+			unsigned long found = 0;
+			if ( sscanf(line, "Hugepagesize: %lu kB", &found) == 1 && found )
+			{
+				kb = found;
+				break;
+			}
+		}
+		fclose(f);
+	}
+	return size_t(kb) * 1024;
+}
+
+inline size_t ptr_huge_page_size()
+{
+	static const size_t size = ptr_huge_read_page_size();
+	return size;
+}
+
+inline size_t ptr_huge_mapping_size(size_t bytes)
+{
+	const size_t huge = ptr_huge_page_size();
+	return (bytes + huge - 1) / huge * huge;
+}
+
+
+
+//
+// mapping
+//
+inline void* ptr_huge_map(size_t bytes, huge_pages mode)
+{
+	const size_t huge = ptr_huge_page_size();
+
+#if defined(MAP_HUGETLB)
+	// the reserved pool, if there's anything in it
+	if ( mode == huge_explicit )
+	{
+		void* mem = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if ( mem != MAP_FAILED )
+		{
+			return mem;
+		}
+	}
+#endif // defined(MAP_HUGETLB)
+
+	// over-map so we can trim to a huge page boundary, the kernel only uses
+	// huge pages for aligned 2MB ranges
+	char* raw = static_cast<char*>(mmap(0, bytes + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if ( raw == MAP_FAILED )
+	{
+		return 0;
+	}
+
+	char*        mem  = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + huge - 1) / huge * huge);
+	const size_t head = size_t(mem - raw);
+	const size_t tail = huge - head;
+	if ( head )
+	{
+		munmap(raw, head);
+	}
+	if ( tail )
+	{
+		munmap(mem + bytes, tail);
+	}
+
+#if defined(MADV_HUGEPAGE)
+	// failure here just means we get ordinary pages
+	if ( mode != huge_none )
+	{
+		madvise(mem, bytes, MADV_HUGEPAGE);
+	}
+#endif // defined(MADV_HUGEPAGE)
+
+	return mem;
+}
+
+
+
+//
+// element destruction
+//
+template <typename X>
+inline void ptr_huge_release(void* normal_ptr, ptr_counter* counter)
+{
+	X* p = static_cast<X*>(normal_ptr);
+	for ( size_t i = 0; i < counter->_length; ++i )
+	{
+		p[i].~X();
+	}
+	munmap(normal_ptr, ptr_huge_mapping_size(counter->_length * sizeof(X)));
+	delete counter;
+}
+
+
+
+//
+// the factory
+//
+template <typename X>
+inline array_ptr<X> make_huge_array(size_t n, huge_pages mode)
+{
+	// (nor can more than there are bytes to address, rounded up to a page)
+	if ( !n || n > (SIZE_MAX - ptr_huge_page_size()) / sizeof(X) )
+	{
+		return array_ptr<X>();
+	}
+
+	const size_t bytes = ptr_huge_mapping_size(n * sizeof(X));
+	X*           p     = static_cast<X*>(ptr_huge_map(bytes, mode));
+	if ( !p )
+	{
+		return array_ptr<X>();
+	}
+
+	size_t constructed = 0;
+	try
+	{
+		for ( ; constructed < n; ++constructed )
+		{
+			new (p + constructed) X();
+		}
+		return array_ptr<X>(p, new ptr_counter(n, ptr_huge_release<X>));
+	}
+	catch ( ... )
+	{
+		while ( constructed > 0 )
+		{
+			p[--constructed].~X();
+		}
+		munmap(p, bytes);
+		throw;
+	}
+}
+
+
+
+#endif // __ptr_hugepage_inl__
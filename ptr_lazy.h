@@ -0,0 +1,88 @@
+#ifndef __ptr_lazy_h__
+#define __ptr_lazy_h__
+
+
+
+//
+//
+//
+// lazily built objects
+//
+//
+// Building every expensive object a program might need at startup makes it
+// slow to start, and plenty of them are never used.  A lazy_ptr<> holds a
+// factory instead, and calls it the first time the object is actually used:
+//
+//   lazy_ptr<Dictionary> g_dictionary([] { return new Dictionary("words.txt"); });
+//
+//   if ( g_dictionary->contains(word) ) // built here, the first time
+//     ...
+//
+// Any number of threads may use it at once.  Exactly one of them builds the
+// object (the others wait for it), and once it's built using it costs a load
+// and a branch.  If the factory throws, the exception goes to whichever
+// thread called it, nothing is built, and the next use tries again.
+//
+// The factory returns a ptr<T>, so it may use any of the factories (or just
+// return a new T, as above), and the lazy_ptr<> holds on to the object until
+// it's destroyed itself.  A factory that returns a null pointer counts as
+// having built it, and using it asserts.
+//
+// lazy_ptr<>s can't be copied: copies of one would each build their own.
+// Handing out ptr<>s to the object isn't offered either, as their counts
+// aren't safe to update from more than one thread.
+//
+//
+
+
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+#include "ptr.h"
+
+
+
+template <typename T>
+class lazy_ptr
+{
+public:
+
+	// hold on to the factory, nothing is built yet
+	explicit lazy_ptr(const std::function<ptr<T>()>& factory);
+
+	// use the object, building it first if need be
+	T* operator->() const;
+	T& operator*() const;
+
+	// whether it has been built yet
+	bool built() const;
+
+private:
+
+	// not copyable
+	lazy_ptr(const lazy_ptr<T>&);
+	lazy_ptr& operator=(const lazy_ptr<T>&);
+
+	// the slow path, the first time through
+	T* build() const;
+
+	// data
+	mutable std::atomic<T*>         _object;
+	mutable std::atomic<bool>       _built;
+	mutable std::mutex              _lock;
+	mutable std::function<ptr<T>()> _factory;
+	mutable ptr<T>                  _held;
+
+};
+
+
+
+#define __ptr_lazy_inl_include__
+#include "ptr_lazy.inl"
+#undef __ptr_lazy_inl_include__
+
+
+
+#endif // __ptr_lazy_h__
@@ -0,0 +1,80 @@
+#if !defined(__ptr_lazy_inl_include__)
+#error "ptr_lazy.inl may only be included from ptr_lazy.h"
+#endif // !defined(__ptr_lazy_inl_include__)
+
+
+
+#ifndef __ptr_lazy_inl__
+#define __ptr_lazy_inl__
+
+
+
+#include <cassert>
+
+
+
+//
+// construction
+//
+template <typename T>
+inline lazy_ptr<T>::lazy_ptr(const std::function<ptr<T>()>& factory) : _object(0), _built(false), _factory(factory)
+{
+	// empty
+}
+
+
+
+//
+// use the object
+//
+template <typename T>
+inline T* lazy_ptr<T>::operator->() const
+{
+	T* object = _object.load(std::memory_order_acquire);
+	if ( __builtin_expect(object == 0, 0) )
+	{
+		object = build();
+	}
+	assert(object);
+	return object;
+}
+
+template <typename T>
+inline T& lazy_ptr<T>::operator*() const
+{
+	return *operator->();
+}
+
+template <typename T>
+inline bool lazy_ptr<T>::built() const
+{
+	return _built.load(std::memory_order_acquire);
+}
+
+
+
+//
+// building it, once
+//
+template <typename T>
+__attribute__((noinline)) T* lazy_ptr<T>::build() const
+{
+	// (a mutex rather than std::call_once(), which some thread libraries
+	// leave stuck when the function throws)
+	std::lock_guard<std::mutex> guard(_lock);
+	if ( !_built.load(std::memory_order_relaxed) )
+	{
+		_held = _factory();
+
+		// the factory (and whatever it captured) isn't needed any more
+		_factory = std::function<ptr<T>()>();
+
+		_object.store(_held ? _held.operator->() : 0, std::memory_order_release);
+		_built.store(true, std::memory_order_release);
+	}
+	return _object.load(std::memory_order_relaxed);
+}
+
+
+
+#endif // __ptr_lazy_inl__
@@ -0,0 +1,98 @@
+#ifndef __ptr_lifetime_h__
+#define __ptr_lifetime_h__
+
+
+
+//
+//
+//
+// how long objects owned by ptr<>s live, by type
+//
+//
+// Whether a type is worth pooling, or belongs in a per-request arena, comes
+// down to how long its objects live: lots of short-lived ones are what pools
+// and arenas are for.  With PTR_LIFETIMES defined every control block is
+// stamped when it takes its first reference, and when the last one goes the
+// object's lifetime lands in a histogram kept for its type (the type the
+// ptr<> or array_ptr<> was declared with, so a ptr<Base> to a Derived counts
+// as a Base).  Histograms have a bucket for each power of two ticks of the
+// time stamp counter, and each thread keeps its own (added together when
+// they're read, or when the thread exits), so recording a lifetime costs a
+// couple of rdtscs and three adds that no other thread is making -- little
+// enough to leave on in canaries.
+//
+// It must be defined for the whole program (it adds a field to the control
+// block), so do it on the command line:
+//
+//   g++ -DPTR_LIFETIMES ...
+//
+//   ...
+//   ptr_lifetimes_write(std::cerr);                   // every type so far
+//
+//   std::vector<ptr_lifetime_stats> all = ptr_lifetimes();
+//   for ( size_t i = 0; i < all.size(); ++i )         // or look for yourself
+//     if ( all[i].released > 1000000 && all[i].mean < 1e-6 )
+//       ...
+//
+// Only objects that have been released are counted, immortal pointers never
+// are.  Ticks are turned into seconds by timing the counter against the
+// steady clock, which assumes the counter runs at a constant rate (true of
+// anything x86 from the last fifteen years).  Elsewhere the steady clock is
+// used directly.
+//
+//
+
+
+
+#if !defined(PTR_LIFETIMES)
+#error "lifetimes are only recorded when PTR_LIFETIMES is defined (for the whole program)"
+#endif
+
+
+
+#include <cstddef>
+#include <ostream>
+#include <typeinfo>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// one type's lifetimes
+//
+enum { ptr_lifetime_buckets = 64 };
+
+struct ptr_lifetime_stats
+{
+	const std::type_info* type;
+	uint64_t              released;                      // objects counted
+	double                mean;                          // in seconds
+	uint64_t              buckets[ptr_lifetime_buckets]; // see ptr_lifetime_bucket()
+};
+
+// every type that's had an object released so far
+std::vector<ptr_lifetime_stats> ptr_lifetimes();
+
+// the shortest lifetime that lands in bucket i, in seconds (each bucket runs
+// up to the next one's)
+double ptr_lifetime_bucket(size_t i);
+
+// a table of every type's histogram
+void ptr_lifetimes_write(std::ostream& out);
+
+// start counting again from nothing
+void ptr_lifetimes_reset();
+
+
+
+#define __ptr_lifetime_inl_include__
+#include "ptr_lifetime.inl"
+#undef __ptr_lifetime_inl_include__
+
+
+
+#endif // __ptr_lifetime_h__
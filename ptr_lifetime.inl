@@ -0,0 +1,352 @@
+#if !defined(__ptr_lifetime_inl_include__)
+#error "ptr_lifetime.inl may only be included from ptr_lifetime.h"
+#endif // !defined(__ptr_lifetime_inl_include__)
+
+
+
+#ifndef __ptr_lifetime_inl__
+#define __ptr_lifetime_inl__
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <cxxabi.h>
+
+
+
+//
+// counts kept by one thread (or merged from many), only ever added to by
+// one thread at a time unless it's with add_shared()
+//
+struct ptr_lifetime_counts
+{
+	ptr_lifetime_counts() : _released(0), _ticks(0)
+	{
+		for ( size_t i = 0; i < ptr_lifetime_buckets; ++i )
+		{
+			_buckets[i] = 0;
+		}
+	}
+
+	static size_t bucket(uint64_t ticks)
+	{
+		return ticks ? 63 - __builtin_clzll(ticks) : 0;
+	}
+
+	// the owning thread, no locked instructions (but others may read along)
+	void add(uint64_t ticks)
+	{
+		std::atomic<uint64_t>& b = _buckets[bucket(ticks)];
+		_released.store(_released.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_ticks.store(_ticks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+		b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// anyone
+	void add_shared(uint64_t ticks)
+	{
+		_released.fetch_add(1, std::memory_order_relaxed);
+		_ticks.fetch_add(ticks, std::memory_order_relaxed);
+		_buckets[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void add_to(ptr_lifetime_counts& total, bool subtract = false) const
+	{
+		const uint64_t sign = subtract ? ~uint64_t(0) : 1; // (unsigned wraparound)
+		total._released.fetch_add(sign * _released.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		total._ticks.fetch_add(sign * _ticks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		for ( size_t i = 0; i < ptr_lifetime_buckets; ++i )
+		{
+			total._buckets[i].fetch_add(sign * _buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+
+	std::atomic<uint64_t> _released;
+	std::atomic<uint64_t> _ticks; // all of them, for the mean
+	std::atomic<uint64_t> _buckets[ptr_lifetime_buckets];
+};
+
+//
+// each type's histogram, registered the first time one of its objects is
+// released, and never freed
+//
+struct ptr_lifetime_histogram
+{
+	explicit ptr_lifetime_histogram(const std::type_info& type) : _type(&type) { /* empty */ };
+	const std::type_info*             _type;
+	std::vector<ptr_lifetime_counts*> _threads;  // each live thread's own
+	ptr_lifetime_counts               _retired;  // merged from threads that have exited
+	ptr_lifetime_counts               _baseline; // totals as of the last reset
+};
+
+struct ptr_lifetime_registry
+{
+	ptr_lifetime_registry() : _start_ticks(ptr_lifetime_clock()), _start_time(std::chrono::steady_clock::now()) { /* empty */ };
+	std::mutex                            _lock;
+	std::vector<ptr_lifetime_histogram*>  _types;
+	uint64_t                              _start_ticks; // for timing the clock
+	std::chrono::steady_clock::time_point _start_time;
+};
+
+inline ptr_lifetime_registry& ptr_lifetime_instance()
+{
+	static ptr_lifetime_registry* s_registry = new ptr_lifetime_registry;
+	return *s_registry;
+}
+
+inline ptr_lifetime_histogram* ptr_lifetime_register(const std::type_info& type)
+{
+	ptr_lifetime_histogram*     histogram = new ptr_lifetime_histogram(type);
+	ptr_lifetime_registry&      registry  = ptr_lifetime_instance();
+	std::lock_guard<std::mutex> guard(registry._lock);
+	registry._types.push_back(histogram);
+	return histogram;
+}
+
+template <typename X>
+inline ptr_lifetime_histogram* ptr_lifetime_type()
+{
+	static ptr_lifetime_histogram* s_histogram = ptr_lifetime_register(typeid(X));
+	return s_histogram;
+}
+
+
+
+//
+// a thread's own counts are merged into the type's when it exits, anything
+// it releases after that (from other thread-locals' destructors, say) goes
+// straight to the type's
+//
+inline thread_local bool ptr_lifetime_thread_exited = false;
+
+struct ptr_lifetime_thread
+{
+	struct owned
+	{
+		ptr_lifetime_histogram* _histogram;
+		ptr_lifetime_counts*    _counts;
+		ptr_lifetime_counts**   _slot; // the thread-local pointing at them
+	};
+
+	~ptr_lifetime_thread()
+	{
+		ptr_lifetime_registry&      registry = ptr_lifetime_instance();
+		std::lock_guard<std::mutex> guard(registry._lock);
+		for ( size_t i = 0; i < _owned.size(); ++i )
+		{
+			std::vector<ptr_lifetime_counts*>& threads = _owned[i]._histogram->_threads;
+			_owned[i]._counts->add_to(_owned[i]._histogram->_retired);
+			threads.erase(std::find(threads.begin(), threads.end(), _owned[i]._counts));
+			delete _owned[i]._counts;
+			*_owned[i]._slot = 0;
+		}
+		ptr_lifetime_thread_exited = true;
+	}
+
+	std::vector<owned> _owned;
+};
+
+// make the calling thread its own counts for a type, false once it's exiting
+__attribute__((cold)) inline bool ptr_lifetime_join(ptr_lifetime_histogram* histogram, ptr_lifetime_counts*& slot)
+{
+	if ( ptr_lifetime_thread_exited )
+	{
+		return false;
+	}
+
+	static thread_local ptr_lifetime_thread s_thread;
+	ptr_lifetime_thread::owned owned = { histogram, new ptr_lifetime_counts, &slot };
+
+	ptr_lifetime_registry&      registry = ptr_lifetime_instance();
+	std::lock_guard<std::mutex> guard(registry._lock);
+	histogram->_threads.push_back(owned._counts);
+	s_thread._owned.push_back(owned);
+	slot = owned._counts;
+	return true;
+}
+
+
+
+//
+// the hook called from ptr.inl
+//
+template <typename X>
+inline void ptr_lifetime_end(uint64_t ticks)
+{
+	static thread_local ptr_lifetime_counts* s_counts = 0;
+	if ( __builtin_expect(!s_counts, 0) && !ptr_lifetime_join(ptr_lifetime_type<X>(), s_counts) )
+	{
+		ptr_lifetime_type<X>()->_retired.add_shared(ticks);
+		return;
+	}
+	s_counts->add(ticks);
+}
+
+
+
+//
+// turning ticks into seconds
+//
+inline double ptr_lifetime_seconds_per_tick()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	// time the counter against the steady clock since the registry was
+	// made, over at least 10ms
+	ptr_lifetime_registry&                      registry = ptr_lifetime_instance();
+	const std::chrono::steady_clock::time_point enough   = registry._start_time + std::chrono::milliseconds(10);
+	if ( std::chrono::steady_clock::now() < enough )
+	{
+		std::this_thread::sleep_until(enough);
+	}
+	const uint64_t ticks   = ptr_lifetime_clock() - registry._start_ticks;
+	const double   seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry._start_time).count();
+	return ticks ? seconds / double(ticks) : 0.0;
+#else
+	return double(std::chrono::steady_clock::period::num) / double(std::chrono::steady_clock::period::den);
+#endif
+}
+
+inline double ptr_lifetime_bucket(size_t i)
+{
+	return i ? std::ldexp(ptr_lifetime_seconds_per_tick(), int(i)) : 0.0;
+}
+
+
+
+//
+// reporting
+//
+inline std::vector<ptr_lifetime_stats> ptr_lifetimes()
+{
+	const double                    seconds_per_tick = ptr_lifetime_seconds_per_tick();
+	std::vector<ptr_lifetime_stats> all;
+
+	ptr_lifetime_registry&      registry = ptr_lifetime_instance();
+	std::lock_guard<std::mutex> guard(registry._lock);
+	for ( size_t t = 0; t < registry._types.size(); ++t )
+	{
+		const ptr_lifetime_histogram& h = *registry._types[t];
+
+		// everything, less what there was at the last reset
+		ptr_lifetime_counts total;
+		h._retired.add_to(total);
+		for ( size_t i = 0; i < h._threads.size(); ++i )
+		{
+			h._threads[i]->add_to(total);
+		}
+		h._baseline.add_to(total, true);
+
+		ptr_lifetime_stats stats;
+		stats.type     = h._type;
+		stats.released = total._released.load(std::memory_order_relaxed);
+		stats.mean     = stats.released ? double(total._ticks.load(std::memory_order_relaxed)) / double(stats.released) * seconds_per_tick : 0.0;
+		for ( size_t i = 0; i < ptr_lifetime_buckets; ++i )
+		{
+			stats.buckets[i] = total._buckets[i].load(std::memory_order_relaxed);
+		}
+		all.push_back(stats);
+	}
+	return all;
+}
+
+inline void ptr_lifetimes_reset()
+{
+	ptr_lifetime_registry&      registry = ptr_lifetime_instance();
+	std::lock_guard<std::mutex> guard(registry._lock);
+	for ( size_t t = 0; t < registry._types.size(); ++t )
+	{
+		// threads' counts are theirs alone to write, so remember where
+		// everything stands instead of clearing them
+		ptr_lifetime_histogram& h = *registry._types[t];
+		h._baseline.add_to(h._baseline, true);
+		h._retired.add_to(h._baseline);
+		for ( size_t i = 0; i < h._threads.size(); ++i )
+		{
+			h._threads[i]->add_to(h._baseline);
+		}
+	}
+}
+
+inline std::string ptr_lifetime_duration(double seconds)
+{
+	char text[32];
+	if ( seconds < 1e-6 )
+	{
+		snprintf(text, sizeof(text), "%.1fns", seconds * 1e9);
+	}
+	else if ( seconds < 1e-3 )
+	{
+		snprintf(text, sizeof(text), "%.1fus", seconds * 1e6);
+	}
+	else if ( seconds < 1.0 )
+	{
+		snprintf(text, sizeof(text), "%.1fms", seconds * 1e3);
+	}
+	else
+	{
+		snprintf(text, sizeof(text), "%.1fs", seconds);
+	}
+	return text;
+}
+
+inline bool ptr_lifetime_busier(const ptr_lifetime_stats& a, const ptr_lifetime_stats& b)
+{
+	return a.released > b.released;
+}
+
+inline void ptr_lifetimes_write(std::ostream& out)
+{
+	std::vector<ptr_lifetime_stats> all = ptr_lifetimes();
+	std::sort(all.begin(), all.end(), ptr_lifetime_busier);
+
+	out << "ptr<> object lifetimes\n";
+	for ( size_t t = 0; t < all.size(); ++t )
+	{
+		const ptr_lifetime_stats& stats = all[t];
+		if ( !stats.released )
+		{
+			continue;
+		}
+
+		int         status    = 0;
+		char*       demangled = abi::__cxa_demangle(stats.type->name(), 0, 0, &status);
+		std::string name(status == 0 && demangled ? demangled : stats.type->name());
+		free(demangled);
+
+		char line[128];
+		snprintf(line, sizeof(line), ": %llu released, mean %s\n", (unsigned long long)stats.released, ptr_lifetime_duration(stats.mean).c_str());
+		out << "\n" << name << line;
+
+		// just the buckets from the first used one to the last
+		size_t   first = ptr_lifetime_buckets, last = 0;
+		uint64_t most  = 0;
+		for ( size_t i = 0; i < ptr_lifetime_buckets; ++i )
+		{
+			if ( stats.buckets[i] )
+			{
+				first = std::min(first, i);
+				last  = i;
+				most  = std::max(most, stats.buckets[i]);
+			}
+		}
+		for ( size_t i = first; i <= last; ++i )
+		{
+			const std::string bar(size_t(40 * stats.buckets[i] / most), '#');
+			snprintf(line, sizeof(line), "  %9s - %9s %12llu %s\n", ptr_lifetime_duration(ptr_lifetime_bucket(i)).c_str(), ptr_lifetime_duration(ptr_lifetime_bucket(i + 1)).c_str(), (unsigned long long)stats.buckets[i], bar.c_str());
+			out << line;
+		}
+	}
+}
+
+
+
+#endif // __ptr_lifetime_inl__
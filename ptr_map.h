@@ -0,0 +1,174 @@
+#ifndef __ptr_map_h__
+#define __ptr_map_h__
+
+
+
+//
+//
+//
+// a concurrent hash map of pointers, read without locking
+//
+//
+// A std::map<int, ptr<Obj> > behind a mutex makes every reader wait on every
+// other reader, and on whichever writer holds the lock, only to copy a
+// pointer out.  A ptr_map<> lets any number of threads look things up at
+// once without taking a lock (or writing anything shared but the count of the
+// value they get back), while writers lock only the part of the table their
+// key hashes to:
+//
+//   ptr_map<int, Obj> objects;
+//
+//   objects.insert(7, new Obj(...));          // only if 7 isn't there yet
+//   objects.assign(7, new Obj(...));          // there or not, replace it
+//
+//   ptr_map<int, Obj>::value_ptr o = objects.find(7); // any thread, no lock
+//   if ( o )
+//     o->frob();                              // still alive, whatever
+//                                             // happens to the map meanwhile
+//   objects.erase(7);
+//
+// Values are held, and handed back, as basic_ptr<V, ptr_synchronized> (the
+// value_ptr typedef): they're shared between threads by definition, so their
+// counts need to be atomic, something an ordinary ptr<> pulled out from under
+// a mutex never really had either.  Keys can be anything copyable that Hash
+// hashes and == compares.
+//
+// Nodes are never changed once they're in the table.  Replacing a value puts
+// a new node in its place and erasing one unlinks it, and either way the old
+// node is retired rather than deleted: readers announce when they're reading
+// by posting the current epoch in a slot of their own, and a retired node is
+// only deleted (letting go of its value) once every reader that might still
+// have been looking at it has finished.  Until then, a reader that found a
+// node can always take a reference to its value, since the node still has
+// one of its own.  Those that come along later never see it at all.
+//
+// The table doubles once there are more values than buckets.  Growing locks
+// every writer out and copies the nodes into the new table, readers carry on
+// in the old one until they next look something up, and it's retired like
+// any node.  Retired nodes are deleted a batch at a time by writers, outside
+// any lock, so a value's destructor may use the map too (reclaim() does it
+// on demand).  for_each() visits every value as of some moment while it's
+// running, without locking, so values inserted or erased meanwhile may or
+// may not be seen.
+//
+// A thread takes a slot the first time it reads, and gives it up for another
+// thread when it exits.  Reading costs that slot's (fenced) store and a load
+// of the epoch, on top of the hashing and the value's atomic increment.  The
+// map itself has to outlive every thread using it.
+//
+//
+
+
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+template <typename K, typename V, typename Hash = std::hash<K> >
+class ptr_map
+{
+public:
+
+	// what values are held as, and handed back as
+	typedef basic_ptr<V, ptr_synchronized> value_ptr;
+
+	// an empty map, with room for roughly that many values before it grows
+	explicit ptr_map(size_t buckets = 64);
+
+	// nothing else may be using it by now
+	~ptr_map();
+
+	// the value for key, null if there isn't one (never locks)
+	value_ptr find(const K& key) const;
+	bool contains(const K& key) const;
+
+	// add a value for key, unless it already has one (returns whether it
+	// was added)
+	bool insert(const K& key, const value_ptr& value);
+
+	// add a value for key, replacing the one it had if any
+	void assign(const K& key, const value_ptr& value);
+
+	// remove the value for key, returns it (null if there wasn't one)
+	value_ptr erase(const K& key);
+
+	// number of values
+	size_t size() const;
+
+	// call f(key, value) for every value (never locks, see above)
+	template <typename F>
+	void for_each(F f) const;
+
+	// delete whatever retired nodes no reader can still be looking at
+	void reclaim();
+
+private:
+
+	// not copyable
+	ptr_map(const ptr_map&);
+	ptr_map& operator=(const ptr_map&);
+
+	struct node;
+	struct table;
+
+	// the table and bucket for a hash
+	static std::atomic<node*>& bucket(table* t, uint64_t hash);
+	uint64_t hash(const K& key) const;
+
+	// the first link pointing at key in its bucket (or at the end of it)
+	static std::atomic<node*>* link(table* t, uint64_t hash, const K& key);
+
+	// make the table twice as big
+	void grow();
+
+	// hand something to be deleted once it's safe (true when it's time to
+	// collect()), and delete what is
+	bool retire(void* p, void (*destroy)(void*));
+	void collect();
+	static void destroy_node(void* p);
+	static void destroy_table(void* p);
+
+	// writers lock the stripe their hash picks (the top bits, so the same one
+	// whatever the table's size)
+	enum { stripe_bits = 5, stripes = 1 << stripe_bits };
+	struct alignas(64) stripe
+	{
+		std::mutex _lock;
+	};
+
+	// something waiting for the readers to move on
+	struct retired
+	{
+		void*    _p;
+		void     (*_destroy)(void*);
+		uint64_t _epoch;
+	};
+
+	// data
+	std::atomic<table*>   _table;
+	std::atomic<size_t>   _size;
+	stripe                _stripes[stripes];
+	std::mutex            _retired_lock;
+	std::vector<retired>  _retired;
+	size_t                _retired_since; // since collect() last ran
+	Hash                  _hash;
+
+};
+
+
+
+#define __ptr_map_inl_include__
+#include "ptr_map.inl"
+#undef __ptr_map_inl_include__
+
+
+
+#endif // __ptr_map_h__
@@ -0,0 +1,483 @@
+#if !defined(__ptr_map_inl_include__)
+#error "ptr_map.inl may only be included from ptr_map.h"
+#endif // !defined(__ptr_map_inl_include__)
+
+
+
+#ifndef __ptr_map_inl__
+#define __ptr_map_inl__
+
+
+
+//
+// epochs
+//
+// Readers post the epoch they started in to a slot of their own (0 when
+// they're not reading).  The epoch only moves on once every reader has
+// posted the current one, so anything retired in epoch e has been out of
+// reach of every reader by the time it's e + 2.
+//
+struct alignas(64) ptr_epoch_slot
+{
+	ptr_epoch_slot() : _epoch(0), _taken(true), _next(0) { /* empty */ };
+	std::atomic<uint64_t> _epoch;
+	std::atomic<bool>     _taken; // by a thread that's still running
+	ptr_epoch_slot*       _next;
+};
+
+struct ptr_epoch_state
+{
+	ptr_epoch_state() : _epoch(2), _slots(0) { /* empty */ };
+	alignas(64) std::atomic<uint64_t>        _epoch;
+	alignas(64) std::atomic<ptr_epoch_slot*> _slots; // only ever grows
+};
+
+// never destroyed, threads exiting during static destruction still find it
+inline ptr_epoch_state& ptr_epoch_instance()
+{
+	static ptr_epoch_state* s_state = new ptr_epoch_state;
+	return *s_state;
+}
+
+// a slot some exited thread left behind, or a new one
+inline ptr_epoch_slot* ptr_epoch_take()
+{
+	ptr_epoch_state& state = ptr_epoch_instance();
+	for ( ptr_epoch_slot* slot = state._slots.load(std::memory_order_acquire); slot; slot = slot->_next )
+	{
+		bool taken = false;
+		if ( !slot->_taken.load(std::memory_order_relaxed) && slot->_taken.compare_exchange_strong(taken, true, std::memory_order_acquire) )
+		{
+			return slot;
+		}
+	}
+
+	ptr_epoch_slot* slot = new ptr_epoch_slot;
+	slot->_next = state._slots.load(std::memory_order_relaxed);
+	while ( !state._slots.compare_exchange_weak(slot->_next, slot, std::memory_order_release, std::memory_order_relaxed) )
+	{
+		// try again
+	}
+	return slot;
+}
+
+struct ptr_epoch_thread
+{
+	ptr_epoch_thread() : _slot(ptr_epoch_take()), _depth(0) { /* empty */ };
+	~ptr_epoch_thread() { _slot->_taken.store(false, std::memory_order_release); }
+	ptr_epoch_slot* _slot;
+	unsigned        _depth; // reads in progress, they may nest
+};
+
+inline ptr_epoch_thread& ptr_epoch_this_thread()
+{
+	static thread_local ptr_epoch_thread s_thread;
+	return s_thread;
+}
+
+// reading, for as long as one's around
+struct ptr_epoch_guard
+{
+	ptr_epoch_guard() : _thread(ptr_epoch_this_thread())
+	{
+		if ( _thread._depth++ == 0 )
+		{
+			_thread._slot->_epoch.store(ptr_epoch_instance()._epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+		}
+	}
+
+	~ptr_epoch_guard()
+	{
+		if ( --_thread._depth == 0 )
+		{
+			_thread._slot->_epoch.store(0, std::memory_order_release);
+		}
+	}
+
+	ptr_epoch_thread& _thread;
+};
+
+// move the epoch on if every reader has caught up with it, returns it
+inline uint64_t ptr_epoch_advance()
+{
+	ptr_epoch_state& state = ptr_epoch_instance();
+	uint64_t         epoch = state._epoch.load(std::memory_order_seq_cst);
+	for ( ptr_epoch_slot* slot = state._slots.load(std::memory_order_acquire); slot; slot = slot->_next )
+	{
+		const uint64_t reading = slot->_epoch.load(std::memory_order_seq_cst);
+		if ( reading && reading != epoch )
+		{
+			return epoch;
+		}
+	}
+
+	// (if someone else moved it first, that's just as good)
+	return state._epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst) ? epoch + 1 : epoch;
+}
+
+
+
+//
+// nodes and tables, never changed once readers can see them (but for the
+// links between nodes)
+//
+template <typename K, typename V, typename Hash>
+struct ptr_map<K, V, Hash>::node
+{
+	node(const K& key, const value_ptr& value, uint64_t hash, node* next) : _key(key), _value(value), _hash(hash), _next(next) { /* empty */ };
+	const K            _key;
+	const value_ptr    _value;
+	const uint64_t     _hash;
+	std::atomic<node*> _next;
+};
+
+template <typename K, typename V, typename Hash>
+struct ptr_map<K, V, Hash>::table
+{
+	explicit table(unsigned bits) : _bits(bits), _buckets(new std::atomic<node*>[size_t(1) << bits])
+	{
+		for ( size_t i = 0; i < (size_t(1) << bits); ++i )
+		{
+			_buckets[i].store(0, std::memory_order_relaxed);
+		}
+	}
+	~table() { delete[] _buckets; }
+	size_t buckets() const { return size_t(1) << _bits; }
+	const unsigned      _bits;
+	std::atomic<node*>* _buckets;
+};
+
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::destroy_node(void* p)
+{
+	delete static_cast<node*>(p);
+}
+
+// along with every node still in it
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::destroy_table(void* p)
+{
+	table* t = static_cast<table*>(p);
+	for ( size_t i = 0; i < t->buckets(); ++i )
+	{
+		node* n = t->_buckets[i].load(std::memory_order_relaxed);
+		while ( n )
+		{
+			node* next = n->_next.load(std::memory_order_relaxed);
+			delete n;
+			n = next;
+		}
+	}
+	delete t;
+}
+
+
+
+//
+// construction and destruction
+//
+template <typename K, typename V, typename Hash>
+inline ptr_map<K, V, Hash>::ptr_map(size_t buckets) : _table(0), _size(0), _retired_since(0)
+{
+	// every bucket has to belong to just one stripe
+	unsigned bits = stripe_bits;
+	while ( (size_t(1) << bits) < buckets )
+	{
+		++bits;
+	}
+	_table.store(new table(bits), std::memory_order_release);
+}
+
+template <typename K, typename V, typename Hash>
+inline ptr_map<K, V, Hash>::~ptr_map()
+{
+	destroy_table(_table.load(std::memory_order_acquire));
+	for ( size_t i = 0; i < _retired.size(); ++i )
+	{
+		_retired[i]._destroy(_retired[i]._p);
+	}
+}
+
+
+
+//
+// finding things
+//
+template <typename K, typename V, typename Hash>
+inline uint64_t ptr_map<K, V, Hash>::hash(const K& key) const
+{
+	// spread the bits over the top of the word, which is where buckets (and
+	// stripes) come from
+	return uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ull;
+}
+
+template <typename K, typename V, typename Hash>
+inline std::atomic<typename ptr_map<K, V, Hash>::node*>& ptr_map<K, V, Hash>::bucket(table* t, uint64_t hash)
+{
+	return t->_buckets[hash >> (64 - t->_bits)];
+}
+
+template <typename K, typename V, typename Hash>
+inline std::atomic<typename ptr_map<K, V, Hash>::node*>* ptr_map<K, V, Hash>::link(table* t, uint64_t hash, const K& key)
+{
+	std::atomic<node*>* l = &bucket(t, hash);
+	for ( node* n = l->load(std::memory_order_acquire); n; n = l->load(std::memory_order_acquire) )
+	{
+		if ( n->_hash == hash && n->_key == key )
+		{
+			break;
+		}
+		l = &n->_next;
+	}
+	return l;
+}
+
+template <typename K, typename V, typename Hash>
+inline typename ptr_map<K, V, Hash>::value_ptr ptr_map<K, V, Hash>::find(const K& key) const
+{
+	ptr_epoch_guard reading;
+	const uint64_t  h = hash(key);
+	for ( node* n = bucket(_table.load(std::memory_order_acquire), h).load(std::memory_order_acquire); n; n = n->_next.load(std::memory_order_acquire) )
+	{
+		if ( n->_hash == h && n->_key == key )
+		{
+			// the node holds a reference until we're done reading, so the
+			// count can't reach zero under us
+			return n->_value;
+		}
+	}
+	return value_ptr();
+}
+
+template <typename K, typename V, typename Hash>
+inline bool ptr_map<K, V, Hash>::contains(const K& key) const
+{
+	ptr_epoch_guard reading;
+	const uint64_t  h = hash(key);
+	for ( node* n = bucket(_table.load(std::memory_order_acquire), h).load(std::memory_order_acquire); n; n = n->_next.load(std::memory_order_acquire) )
+	{
+		if ( n->_hash == h && n->_key == key )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename K, typename V, typename Hash>
+inline size_t ptr_map<K, V, Hash>::size() const
+{
+	return _size.load(std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename Hash>
+template <typename F>
+inline void ptr_map<K, V, Hash>::for_each(F f) const
+{
+	ptr_epoch_guard reading;
+	table*          t = _table.load(std::memory_order_acquire);
+	for ( size_t i = 0; i < t->buckets(); ++i )
+	{
+		for ( node* n = t->_buckets[i].load(std::memory_order_acquire); n; n = n->_next.load(std::memory_order_acquire) )
+		{
+			f(n->_key, n->_value);
+		}
+	}
+}
+
+
+
+//
+// changing things, one stripe locked at a time (which also keeps the table
+// from growing underneath)
+//
+template <typename K, typename V, typename Hash>
+inline bool ptr_map<K, V, Hash>::insert(const K& key, const value_ptr& value)
+{
+	const uint64_t h = hash(key);
+	size_t         buckets;
+	{
+		std::lock_guard<std::mutex> guard(_stripes[h >> (64 - stripe_bits)]._lock);
+		table*                      t = _table.load(std::memory_order_relaxed);
+		std::atomic<node*>*         l = link(t, h, key);
+		if ( l->load(std::memory_order_relaxed) )
+		{
+			return false;
+		}
+		l->store(new node(key, value, h, 0), std::memory_order_release);
+		buckets = t->buckets();
+	}
+
+	if ( _size.fetch_add(1, std::memory_order_relaxed) >= buckets )
+	{
+		grow();
+	}
+	return true;
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::assign(const K& key, const value_ptr& value)
+{
+	const uint64_t h = hash(key);
+	size_t         buckets;
+	node*          old;
+	bool           full = false;
+	{
+		std::lock_guard<std::mutex> guard(_stripes[h >> (64 - stripe_bits)]._lock);
+		table*                      t = _table.load(std::memory_order_relaxed);
+		std::atomic<node*>*         l = link(t, h, key);
+		old = l->load(std::memory_order_relaxed);
+
+		// the new node takes the old one's place, readers already past the
+		// link go on through the old one to the same place
+		l->store(new node(key, value, h, old ? old->_next.load(std::memory_order_relaxed) : 0), std::memory_order_release);
+		if ( old )
+		{
+			full = retire(old, destroy_node);
+		}
+		buckets = t->buckets();
+	}
+
+	if ( full )
+	{
+		collect();
+	}
+	else if ( !old && _size.fetch_add(1, std::memory_order_relaxed) >= buckets )
+	{
+		grow();
+	}
+}
+
+template <typename K, typename V, typename Hash>
+inline typename ptr_map<K, V, Hash>::value_ptr ptr_map<K, V, Hash>::erase(const K& key)
+{
+	const uint64_t h = hash(key);
+	value_ptr      erased;
+	bool           full;
+	{
+		std::lock_guard<std::mutex> guard(_stripes[h >> (64 - stripe_bits)]._lock);
+		std::atomic<node*>*         l   = link(_table.load(std::memory_order_relaxed), h, key);
+		node*                       old = l->load(std::memory_order_relaxed);
+		if ( !old )
+		{
+			return erased;
+		}
+		erased = old->_value;
+		l->store(old->_next.load(std::memory_order_relaxed), std::memory_order_release);
+		full = retire(old, destroy_node);
+	}
+
+	_size.fetch_sub(1, std::memory_order_relaxed);
+	if ( full )
+	{
+		collect();
+	}
+	return erased;
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::grow()
+{
+	struct every_stripe
+	{
+		explicit every_stripe(stripe* stripes) : _stripes(stripes) { for ( int i = 0; i < ptr_map::stripes; ++i ) _stripes[i]._lock.lock(); }
+		~every_stripe() { for ( int i = ptr_map::stripes; i > 0; --i ) _stripes[i - 1]._lock.unlock(); }
+		stripe* _stripes;
+	};
+
+	bool full = false;
+	{
+		every_stripe guard(_stripes);
+
+		// someone else may have beaten us to it
+		table* old = _table.load(std::memory_order_relaxed);
+		if ( _size.load(std::memory_order_relaxed) <= old->buckets() )
+		{
+			return;
+		}
+
+		// copies of every node (readers may still be going through the old
+		// ones), each new bucket is the top half or bottom half of an old one
+		table* t = new table(old->_bits + 1);
+		try
+		{
+			for ( size_t i = 0; i < old->buckets(); ++i )
+			{
+				for ( node* n = old->_buckets[i].load(std::memory_order_relaxed); n; n = n->_next.load(std::memory_order_relaxed) )
+				{
+					std::atomic<node*>& b = bucket(t, n->_hash);
+					b.store(new node(n->_key, n->_value, n->_hash, b.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+				}
+			}
+		}
+		catch ( ... )
+		{
+			destroy_table(t);
+			throw;
+		}
+
+		_table.store(t, std::memory_order_release);
+		full = retire(old, destroy_table);
+	}
+
+	if ( full )
+	{
+		collect();
+	}
+}
+
+
+
+//
+// reclaiming what's been retired
+//
+template <typename K, typename V, typename Hash>
+inline bool ptr_map<K, V, Hash>::retire(void* p, void (*destroy)(void*))
+{
+	const retired               r = { p, destroy, ptr_epoch_instance()._epoch.load(std::memory_order_seq_cst) };
+	std::lock_guard<std::mutex> guard(_retired_lock);
+	_retired.push_back(r);
+	return ++_retired_since >= 64;
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::collect()
+{
+	std::vector<retired> ready;
+	{
+		std::lock_guard<std::mutex> guard(_retired_lock);
+		const uint64_t              epoch = ptr_epoch_advance();
+		size_t                      kept  = 0;
+		for ( size_t i = 0; i < _retired.size(); ++i )
+		{
+			if ( _retired[i]._epoch + 2 <= epoch )
+			{
+				ready.push_back(_retired[i]);
+			}
+			else
+			{
+				_retired[kept++] = _retired[i];
+			}
+		}
+		_retired.resize(kept);
+		_retired_since = 0;
+	}
+
+	// outside the lock, values' destructors may well use the map
+	for ( size_t i = 0; i < ready.size(); ++i )
+	{
+		ready[i]._destroy(ready[i]._p);
+	}
+}
+
+template <typename K, typename V, typename Hash>
+inline void ptr_map<K, V, Hash>::reclaim()
+{
+	// anything retired by now is safe two epochs on, if the readers allow
+	collect();
+	collect();
+}
+
+
+
+#endif // __ptr_map_inl__
@@ -0,0 +1,78 @@
+#ifndef __ptr_mmap_h__
+#define __ptr_mmap_h__
+
+
+
+//
+//
+//
+// memory mapped files as array_ptr<>s
+//
+//
+// Reading a big binary table into a new T[n] costs the whole file's worth of
+// I/O before the first element can be looked at, and then keeps a second copy
+// of it around (the page cache already has one).  Mapping the file instead
+// hands out the page cache pages themselves, faulted in only when touched:
+//
+//   // read-only, elements are const
+//   array_ptr<const Record> table = map_file<Record>("records.bin");
+//   if ( table )
+//   {
+//     for ( size_t i = 0; i < table.size(); ++i )
+//       ...
+//   }
+//
+//   // copy-on-write, writes stay private to this process
+//   array_ptr<Record> scratch = map_file_private<Record>("records.bin");
+//
+// The array_ptr<> knows its size(), which is the number of whole elements in
+// the file.  The file is unmapped when the last reference is dropped.  If the
+// file can't be opened or mapped (or is empty) you get an invalid array_ptr<>.
+//
+// An access hint is passed on to the kernel with madvise(), and populate asks
+// for everything to be read in up front (MAP_POPULATE), which is worth it when
+// you know you're going to touch it all anyway.
+//
+// T must be trivially copyable, no constructors or destructors are run.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+enum map_access
+{
+	map_normal,     // no particular pattern
+	map_sequential, // aggressive read-ahead, pages dropped soon after use
+	map_random,     // no read-ahead
+	map_willneed    // start reading the whole thing in now, in the background
+};
+
+
+
+//
+// map a whole file read-only
+//
+template <typename T>
+array_ptr<const T> map_file(const char* path, map_access access = map_normal, bool populate = false);
+
+//
+// map a whole file copy-on-write
+//
+template <typename T>
+array_ptr<T> map_file_private(const char* path, map_access access = map_normal, bool populate = false);
+
+
+
+#define __ptr_mmap_inl_include__
+#include "ptr_mmap.inl"
+#undef __ptr_mmap_inl_include__
+
+
+
+#endif // __ptr_mmap_h__
@@ -0,0 +1,139 @@
+#if !defined(__ptr_mmap_inl_include__)
+#error "ptr_mmap.inl may only be included from ptr_mmap.h"
+#endif // !defined(__ptr_mmap_inl_include__)
+
+
+
+#ifndef __ptr_mmap_inl__
+#define __ptr_mmap_inl__
+
+
+
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+//
+// a control block that remembers how much was mapped, the element count
+// doesn't cover a partial element at the end of the file
+//
+struct ptr_mmap_counter : public ptr_counter
+{
+	ptr_mmap_counter(size_t length, size_t bytes, release_func release) : ptr_counter(length, release), _bytes(bytes) { /* empty */ };
+	size_t _bytes;
+};
+
+inline void ptr_mmap_release(void* normal_ptr, ptr_counter* counter)
+{
+	ptr_mmap_counter* mapping = static_cast<ptr_mmap_counter*>(counter);
+	munmap(normal_ptr, mapping->_bytes);
+	delete mapping;
+}
+
+
+
+//
+// map the whole file, hand back the address (or 0) and how big it was
+//
+inline void* ptr_mmap_file(const char* path, bool writable, map_access access, bool populate, size_t& bytes)
+{
+	bytes = 0;
+
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 )
+	{
+		return 0;
+	}
+
+	struct stat info;
+	if ( fstat(fd, &info) != 0 || info.st_size <= 0 )
+	{
+		close(fd);
+		return 0;
+	}
+	bytes = size_t(info.st_size);
+
+	int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+	if ( populate )
+	{
+		flags |= MAP_POPULATE;
+	}
+#else
+	(void)populate;
+#endif // defined(MAP_POPULATE)
+
+	void* mem = mmap(0, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, flags, fd, 0);
+
+	// the mapping keeps its own reference to the file
+	close(fd);
+
+	if ( mem == MAP_FAILED )
+	{
+		bytes = 0;
+		return 0;
+	}
+
+	// just a hint, nothing to do if the kernel ignores it
+	switch ( access )
+	{
+		case map_sequential: madvise(mem, bytes, MADV_SEQUENTIAL); break;
+		case map_random:     madvise(mem, bytes, MADV_RANDOM);     break;
+		case map_willneed:   madvise(mem, bytes, MADV_WILLNEED);   break;
+		default:                                                   break;
+	}
+
+	return mem;
+}
+
+
+
+//
+// the factories
+//
+template <typename T>
+inline array_ptr<const T> map_file(const char* path, map_access access, bool populate)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "map_file<T>() needs a trivially copyable T");
+
+	size_t bytes = 0;
+	void*  mem   = ptr_mmap_file(path, false, access, populate, bytes);
+	if ( !mem || bytes < sizeof(T) )
+	{
+		if ( mem )
+		{
+			munmap(mem, bytes);
+		}
+		return array_ptr<const T>();
+	}
+
+	return array_ptr<const T>(static_cast<const T*>(mem), new ptr_mmap_counter(bytes / sizeof(T), bytes, ptr_mmap_release));
+}
+
+template <typename T>
+inline array_ptr<T> map_file_private(const char* path, map_access access, bool populate)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "map_file_private<T>() needs a trivially copyable T");
+
+	size_t bytes = 0;
+	void*  mem   = ptr_mmap_file(path, true, access, populate, bytes);
+	if ( !mem || bytes < sizeof(T) )
+	{
+		if ( mem )
+		{
+			munmap(mem, bytes);
+		}
+		return array_ptr<T>();
+	}
+
+	return array_ptr<T>(static_cast<T*>(mem), new ptr_mmap_counter(bytes / sizeof(T), bytes, ptr_mmap_release));
+}
+
+
+
+#endif // __ptr_mmap_inl__
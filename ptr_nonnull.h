@@ -0,0 +1,109 @@
+#ifndef __ptr_nonnull_h__
+#define __ptr_nonnull_h__
+
+
+
+//
+//
+//
+// pointers that are never null
+//
+//
+// Every ptr<> has to allow for being null (or immortal), so copying one,
+// destroying one and even using one each test for it first.  Code that knows
+// it always has an object pays for those tests anyway.  A nonnull_ptr<> can
+// only be made from an object, never from nothing, so it doesn't test:
+// copying is an increment, destruction a decrement and a test for the last
+// reference, and using it is just the pointer:
+//
+//   nonnull_ptr<Mesh> m = make_nonnull<Mesh>(vertices, indices);
+//   m->draw();                           // no assert, no test
+//
+//   nonnull_ptr<Mesh> n(some_ptr);      // some_ptr had better not be null
+//   ptr<Mesh>         p = n;             // and back to an ordinary ptr<>
+//
+// Making one from a null ptr<> asserts.  One made from an immortal pointer
+// gets a counter of its own (which lets the object be) so nothing it does
+// needs to tell the difference.  There's no default constructor, and no
+// assigning null.  Like ptr<>, they're counted without any synchronization.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+template <typename T>
+class nonnull_ptr
+{
+public:
+
+	// from an ordinary (valid) ptr<>
+	explicit nonnull_ptr(const ptr<T>& p);
+
+	// copying construction and assignment
+	nonnull_ptr(const nonnull_ptr<T>& other);
+	nonnull_ptr& operator=(const nonnull_ptr<T>& other);
+
+	// destruction
+	~nonnull_ptr();
+
+	// comparison
+	bool operator==(const nonnull_ptr<T>& other) const;
+	bool operator!=(const nonnull_ptr<T>& other) const;
+	bool operator<(const nonnull_ptr<T>& other) const;
+
+	// use the pointer
+	T* operator->() const;
+	T& operator*() const;
+	T* get() const;
+
+	// back to an ordinary ptr<>, sharing the count
+	operator ptr<T>() const;
+
+	// adopt a pointer along with a control block (used by make_nonnull<>(),
+	// you shouldn't need this)
+	nonnull_ptr(T* normal_ptr, ptr_counter* counter);
+
+private:
+
+	// never null, so never empty
+	nonnull_ptr();
+
+	// the last reference is gone
+	static void release(T* normal_ptr, ptr_counter* counter);
+
+	// data
+	T*           _ptr;
+	ptr_counter* _counter;
+
+};
+
+//
+// a new T, constructed from args
+//
+template <typename T, typename... Args>
+nonnull_ptr<T> make_nonnull(Args&&... args);
+
+//
+// it's a pointer and a counter, the same as ptr<>
+//
+template <typename T>
+struct ptr_relocatable< nonnull_ptr<T> >
+{
+	enum { value = true };
+};
+
+
+
+#define __ptr_nonnull_inl_include__
+#include "ptr_nonnull.inl"
+#undef __ptr_nonnull_inl_include__
+
+
+
+#endif // __ptr_nonnull_h__
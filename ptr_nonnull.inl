@@ -0,0 +1,193 @@
+#if !defined(__ptr_nonnull_inl_include__)
+#error "ptr_nonnull.inl may only be included from ptr_nonnull.h"
+#endif // !defined(__ptr_nonnull_inl_include__)
+
+
+
+#ifndef __ptr_nonnull_inl__
+#define __ptr_nonnull_inl__
+
+
+
+#include <cassert>
+#include <utility>
+
+
+
+// immortal objects get a counter of their own, which frees only itself
+inline void ptr_nonnull_release_counter(void*, ptr_counter* counter)
+{
+	delete counter;
+}
+
+
+
+//
+// construction
+//
+template <typename T>
+inline nonnull_ptr<T>::nonnull_ptr(const ptr<T>& p) : _ptr(0), _counter(p.counter())
+{
+	// null is the one thing this can't hold
+	assert(p.valid());
+	_ptr = p.operator->();
+
+	if ( _counter == ptr_immortal_counter() )
+	{
+		_counter = new ptr_counter(0, ptr_nonnull_release_counter);
+		_counter->inc();
+		ptr_adopted<T>(_counter);
+		return;
+	}
+	_counter->inc();
+}
+
+template <typename T>
+inline nonnull_ptr<T>::nonnull_ptr(T* normal_ptr, ptr_counter* counter) : _ptr(normal_ptr), _counter(counter)
+{
+	assert(normal_ptr && ptr_counted(counter));
+	_counter->inc();
+	if ( _counter->_count == 1 )
+	{
+		ptr_adopted<T>(_counter);
+	}
+}
+
+
+
+//
+// copying, no tests for null or immortal anywhere
+//
+template <typename T>
+inline nonnull_ptr<T>::nonnull_ptr(const nonnull_ptr<T>& other) : _ptr(other._ptr), _counter(other._counter)
+{
+	_counter->inc();
+}
+
+template <typename T>
+inline nonnull_ptr<T>& nonnull_ptr<T>::operator=(const nonnull_ptr<T>& other)
+{
+	// (counting the other first makes assigning to itself harmless)
+	other._counter->inc();
+
+	T*           old_ptr     = _ptr;
+	ptr_counter* old_counter = _counter;
+	_ptr     = other._ptr;
+	_counter = other._counter;
+
+	old_counter->dec();
+	if ( __builtin_expect(old_counter->_count == 0, 0) )
+	{
+		release(old_ptr, old_counter);
+	}
+	return *this;
+}
+
+
+
+//
+// destruction
+//
+template <typename T>
+inline nonnull_ptr<T>::~nonnull_ptr()
+{
+	_counter->dec();
+	if ( __builtin_expect(_counter->_count == 0, 0) )
+	{
+		release(_ptr, _counter);
+	}
+}
+
+template <typename T>
+__attribute__((noinline)) void nonnull_ptr<T>::release(T* normal_ptr, ptr_counter* counter)
+{
+	ptr_releasing<T>(counter);
+	if ( counter->_release )
+	{
+		// storage came from somewhere special, let it be returned there
+		counter->_release(const_cast<void*>(static_cast<const void*>(normal_ptr)), counter);
+	}
+	else
+	{
+		delete normal_ptr;
+		delete counter;
+	}
+}
+
+
+
+//
+// comparison
+//
+template <typename T>
+inline bool nonnull_ptr<T>::operator==(const nonnull_ptr<T>& other) const
+{
+	return _ptr == other._ptr;
+}
+
+template <typename T>
+inline bool nonnull_ptr<T>::operator!=(const nonnull_ptr<T>& other) const
+{
+	return _ptr != other._ptr;
+}
+
+template <typename T>
+inline bool nonnull_ptr<T>::operator<(const nonnull_ptr<T>& other) const
+{
+	return _ptr < other._ptr;
+}
+
+
+
+//
+// use the pointer
+//
+template <typename T>
+inline T* nonnull_ptr<T>::operator->() const
+{
+	return _ptr;
+}
+
+template <typename T>
+inline T& nonnull_ptr<T>::operator*() const
+{
+	return *_ptr;
+}
+
+template <typename T>
+inline T* nonnull_ptr<T>::get() const
+{
+	return _ptr;
+}
+
+template <typename T>
+inline nonnull_ptr<T>::operator ptr<T>() const
+{
+	return ptr<T>(_ptr, _counter);
+}
+
+
+
+//
+// the factory
+//
+template <typename T, typename... Args>
+inline nonnull_ptr<T> make_nonnull(Args&&... args)
+{
+	ptr_counter* counter = new ptr_counter;
+	T*           object  = 0;
+	try
+	{
+		object = new T(std::forward<Args>(args)...);
+	}
+	catch ( ... )
+	{
+		delete counter;
+		throw;
+	}
+	return nonnull_ptr<T>(object, counter);
+}
+
+
+
+#endif // __ptr_nonnull_inl__
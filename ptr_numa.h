@@ -0,0 +1,85 @@
+#ifndef __ptr_numa_h__
+#define __ptr_numa_h__
+
+
+
+//
+//
+//
+// NUMA aware array_ptr<> allocation
+//
+//
+// A plain array_ptr<X> comes from new X[n], so the pages behind it end up on
+// whichever node the thread that first touched them happened to be running
+// on -- usually the one that allocated it.  Every other socket then pays
+// remote latency for the whole life of the buffer.
+//
+// make_numa_array<>() maps the storage itself, tells the kernel where its
+// pages belong, and then constructs the elements from several threads at
+// once so the first-touch page faults are spread out as well:
+//
+//   // spread pages round-robin over every node
+//   array_ptr<double> a = make_numa_array<double>(n, numa_interleave);
+//
+//   // split into 8 contiguous chunks, chunk i lives on node (i * nodes / 8)
+//   array_ptr<double> b = make_numa_array<double>(n, numa_partition, 8);
+//
+//   // everything on the node of the calling thread
+//   array_ptr<double> c = make_numa_array<double>(n, numa_local);
+//
+// When work is later split the same way (chunk i of 8 on a thread running on
+// node i * nodes / 8) every thread streams from local memory.
+//
+// Elements are value-initialized, i.e. numbers start out as zero, and the
+// array_ptr<> knows its size().  The mapping is released with munmap() when
+// the last reference goes away, just like delete[] would have been.
+//
+// The policies are applied with the mbind() system call directly, so there's
+// no libnuma to link against.  On a single node machine, or wherever mbind()
+// isn't permitted, the placement quietly degrades to ordinary first-touch
+// and everything else still works.  X's default constructor must not throw,
+// since it runs on the helper threads, and must be safe to run on several
+// threads at once (pass threads = 1 if it isn't).
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+enum numa_placement
+{
+	numa_local,      // all pages on the calling thread's node
+	numa_interleave, // pages round-robin across all nodes
+	numa_partition   // contiguous chunk per thread, chunks spread over nodes
+};
+
+
+
+//
+// allocate n elements with the given placement, constructing them with the
+// given number of threads (0 means one per hardware thread)
+//
+template <typename X>
+array_ptr<X> make_numa_array(size_t n, numa_placement placement = numa_local, unsigned threads = 0);
+
+
+
+//
+// number of NUMA nodes on this machine (1 if unknown)
+//
+unsigned ptr_numa_nodes();
+
+
+
+#define __ptr_numa_inl_include__
+#include "ptr_numa.inl"
+#undef __ptr_numa_inl_include__
+
+
+
+#endif // __ptr_numa_h__
@@ -0,0 +1,287 @@
+#if !defined(__ptr_numa_inl_include__)
+#error "ptr_numa.inl may only be included from ptr_numa.h"
+#endif // !defined(__ptr_numa_inl_include__)
+
+
+
+#ifndef __ptr_numa_inl__
+#define __ptr_numa_inl__
+
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+
+//
+// the bits of <linux/mempolicy.h> we need, so nobody needs libnuma headers
+//
+enum
+{
+	ptr_numa_max_nodes       = 256,
+	ptr_numa_mpol_preferred  = 1,
+	ptr_numa_mpol_interleave = 3
+};
+
+struct ptr_numa_mask
+{
+	ptr_numa_mask() { for ( size_t i = 0; i < words; ++i ) bits[i] = 0; }
+	void set(unsigned node) { bits[node / bits_per_word] |= 1UL << (node % bits_per_word); }
+
+	static const size_t bits_per_word = 8 * sizeof(unsigned long);
+	static const size_t words         = ptr_numa_max_nodes / bits_per_word;
+	unsigned long bits[words];
+};
+
+
+
+//
+// machine topology
+//
+inline unsigned ptr_numa_nodes()
+{
+	// looks like "0", "0-3" or "0,2-3", we only want the highest node number
+	unsigned nodes = 1;
+	FILE*    f     = fopen("/sys/devices/system/node/online", "r");
+	if ( f )
+	{
+		char line[256];
+		if ( fgets(line, sizeof(line), f) )
+		{
+			for ( char* s = line; *s; )
+			{
+				char*         end  = s;
+				unsigned long node = strtoul(s, &end, 10);
+				if ( end == s )
+				{
+					++s;
+					continue;
+				}
+				if ( node + 1 > nodes && node < ptr_numa_max_nodes )
+				{
+					nodes = unsigned(node + 1);
+				}
+				s = end;
+			}
+		}
+		fclose(f);
+	}
+	return nodes;
+}
+
+inline unsigned ptr_numa_current_node()
+{
+	unsigned cpu  = 0;
+	unsigned node = 0;
+	syscall(SYS_getcpu, &cpu, &node, 0);
+	return node;
+}
+
+inline size_t ptr_numa_page_size()
+{
+	return size_t(sysconf(_SC_PAGESIZE));
+}
+
+inline size_t ptr_numa_mapping_size(size_t bytes)
+{
+	const size_t page = ptr_numa_page_size();
+	return (bytes + page - 1) / page * page;
+}
+
+
+
+//
+// placement, failure just leaves the pages to ordinary first-touch
+//
+inline void ptr_numa_bind(void* addr, size_t bytes, int mode, const ptr_numa_mask& mask)
+{
+	syscall(SYS_mbind, addr, bytes, mode, mask.bits, ptr_numa_max_nodes + 1, 0);
+}
+
+
+
+//
+// element construction and destruction
+//
+// if an X() throws, what this chunk built is destroyed again and the
+// exception handed back, rather than let loose on a worker thread
+template <typename X>
+inline void ptr_numa_construct(X* p, size_t first, size_t last, std::exception_ptr* failure)
+{
+	size_t i = first;
+	try
+	{
+		for ( ; i < last; ++i )
+		{
+			new (p + i) X();
+		}
+	}
+	catch ( ... )
+	{
+		while ( i > first )
+		{
+			p[--i].~X();
+		}
+		*failure = std::current_exception();
+	}
+}
+
+template <typename X>
+inline void ptr_numa_destroy(X* p, size_t first, size_t last)
+{
+	for ( size_t i = first; i < last; ++i )
+	{
+		p[i].~X();
+	}
+}
+
+template <typename X>
+inline void ptr_numa_release(void* normal_ptr, ptr_counter* counter)
+{
+	X* p = static_cast<X*>(normal_ptr);
+	for ( size_t i = 0; i < counter->_length; ++i )
+	{
+		p[i].~X();
+	}
+	munmap(normal_ptr, ptr_numa_mapping_size(counter->_length * sizeof(X)));
+	delete counter;
+}
+
+
+
+//
+// the factory
+//
+template <typename X>
+inline array_ptr<X> make_numa_array(size_t n, numa_placement placement, unsigned threads)
+{
+	// (nor can more than there are bytes to address, rounded up to a page)
+	if ( !n || n > (SIZE_MAX - ptr_numa_page_size()) / sizeof(X) )
+	{
+		return array_ptr<X>();
+	}
+
+	// map the storage ourselves so we can place it before anyone touches it
+	const size_t page  = ptr_numa_page_size();
+	const size_t bytes = ptr_numa_mapping_size(n * sizeof(X));
+	void*        mem   = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ( mem == MAP_FAILED )
+	{
+		return array_ptr<X>();
+	}
+	X* p = static_cast<X*>(mem);
+
+	// work out how many chunks we split the construction into
+	const size_t pages = bytes / page;
+	if ( placement == numa_local )
+	{
+		threads = 1;
+	}
+	else if ( threads == 0 )
+	{
+		threads = std::thread::hardware_concurrency();
+	}
+	threads = threads ? threads : 1;
+	threads = threads < pages ? threads : unsigned(pages);
+
+	// whole pages per chunk, which may leave fewer chunks than threads asked for
+	const size_t chunk_pages = (pages + threads - 1) / threads;
+	const size_t chunk_bytes = chunk_pages * page;
+	threads = unsigned((pages + chunk_pages - 1) / chunk_pages);
+
+	const unsigned nodes = ptr_numa_nodes();
+
+	// whole-buffer policies
+	if ( placement == numa_local )
+	{
+		ptr_numa_mask mask;
+		mask.set(ptr_numa_current_node());
+		ptr_numa_bind(mem, bytes, ptr_numa_mpol_preferred, mask);
+	}
+	else if ( placement == numa_interleave )
+	{
+		ptr_numa_mask mask;
+		for ( unsigned node = 0; node < nodes; ++node )
+		{
+			mask.set(node);
+		}
+		ptr_numa_bind(mem, bytes, ptr_numa_mpol_interleave, mask);
+	}
+
+	// construct each chunk on its own thread (the first one on ours), placing
+	// the chunk first if we're partitioning
+	std::vector<std::thread>        workers;
+	std::vector<size_t>             firsts(threads), lasts(threads);
+	std::vector<std::exception_ptr> failures(threads);
+	for ( unsigned t = threads; t-- > 0; )
+	{
+		const size_t byte_first = t * chunk_bytes;
+		const size_t byte_last  = byte_first + chunk_bytes < bytes ? byte_first + chunk_bytes : bytes;
+		const size_t first      = (byte_first + sizeof(X) - 1) / sizeof(X);
+		const size_t last       = t + 1 == threads ? n : (byte_last + sizeof(X) - 1) / sizeof(X);
+		firsts[t] = first;
+		lasts[t]  = last;
+
+		if ( placement == numa_partition )
+		{
+			ptr_numa_mask mask;
+			mask.set(unsigned(size_t(t) * nodes / threads));
+			ptr_numa_bind(static_cast<char*>(mem) + byte_first, byte_last - byte_first, ptr_numa_mpol_preferred, mask);
+		}
+
+		if ( t )
+		{
+			workers.push_back(std::thread(ptr_numa_construct<X>, p, first, last, &failures[t]));
+		}
+		else
+		{
+			ptr_numa_construct<X>(p, first, last, &failures[t]);
+		}
+	}
+	for ( size_t i = 0; i < workers.size(); ++i )
+	{
+		workers[i].join();
+	}
+
+	// if any chunk failed, the others are undone too and the memory goes
+	std::exception_ptr failure;
+	for ( unsigned t = 0; t < threads && !failure; ++t )
+	{
+		failure = failures[t];
+	}
+	try
+	{
+		if ( failure )
+		{
+			std::rethrow_exception(failure);
+		}
+		return array_ptr<X>(p, new ptr_counter(n, ptr_numa_release<X>));
+	}
+	catch ( ... )
+	{
+		for ( unsigned t = 0; t < threads; ++t )
+		{
+			if ( !failures[t] )
+			{
+				ptr_numa_destroy(p, firsts[t], lasts[t]);
+			}
+		}
+		munmap(mem, bytes);
+		throw;
+	}
+}
+
+
+
+#endif // __ptr_numa_inl__
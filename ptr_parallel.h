@@ -0,0 +1,179 @@
+#ifndef __ptr_parallel_h__
+#define __ptr_parallel_h__
+
+
+
+//
+//
+//
+// parallel algorithms over array_ptr<>s
+//
+//
+// A small work-stealing thread pool and the handful of loops that keep
+// coming up over big buffers, split into chunks and spread over the pool:
+//
+//   array_ptr<double> a = make_numa_array<double>(n, numa_partition);
+//
+//   parallel_for(a, [](double& x) { x = compute(x); });
+//   double total = parallel_reduce(a, 0.0, [](double s, double x) { return s + x; });
+//   parallel_transform(b, a, [](double x) { return x * 2.0; });
+//   parallel_sort(a);
+//
+// Each call returns once all of its work is done.  The thread making the
+// call joins in rather than just waiting, so calls may be nested (from inside
+// a parallel_for() body, say) without tying the pool up.
+//
+// The buffer is kept alive for the duration by a reference the job holds.
+// That reference is taken and dropped on the calling thread: array_ptr<>'s
+// counts aren't atomic, so the tasks themselves never copy the handle.
+// Don't let anyone else drop the last reference to a buffer from another
+// thread while a job is running over it either.
+//
+// Everything works on the whole array, as given by size() (see the sizing
+// factories, make_numa_array<>() and friends), so an array_ptr<> of unknown
+// size is treated as empty.  By default the shared pool is used, with one
+// worker fewer than there are hardware threads (the caller is the last one),
+// but you may make pools of your own:
+//
+//   work_pool pool(4);
+//   parallel_sort(a, std::greater<double>(), pool);
+//
+// Bodies shouldn't throw.
+//
+//
+
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ptr.h"
+
+
+
+class work_pool;
+
+//
+// f(element) for every element
+//
+template <typename X, typename F>
+void parallel_for(const array_ptr<X>& a, F f);
+
+template <typename X, typename F>
+void parallel_for(const array_ptr<X>& a, F f, work_pool& pool);
+
+//
+// op(op(op(identity, a[0]), a[1]), ...) in some order, op must be associative
+// and is also used to combine the partial results of each chunk
+//
+template <typename X, typename T, typename Op>
+T parallel_reduce(const array_ptr<X>& a, T identity, Op op);
+
+template <typename X, typename T, typename Op>
+T parallel_reduce(const array_ptr<X>& a, T identity, Op op, work_pool& pool);
+
+//
+// dest[i] = op(src[i]) for all of src, dest must be at least as big
+//
+template <typename X, typename Y, typename Op>
+void parallel_transform(const array_ptr<Y>& dest, const array_ptr<X>& src, Op op);
+
+template <typename X, typename Y, typename Op>
+void parallel_transform(const array_ptr<Y>& dest, const array_ptr<X>& src, Op op, work_pool& pool);
+
+//
+// sort the whole array (not stable)
+//
+template <typename X>
+void parallel_sort(const array_ptr<X>& a);
+
+template <typename X, typename Compare>
+void parallel_sort(const array_ptr<X>& a, Compare comp);
+
+template <typename X, typename Compare>
+void parallel_sort(const array_ptr<X>& a, Compare comp, work_pool& pool);
+
+
+
+//
+// the pool itself
+//
+class work_pool
+{
+public:
+
+	// 0 threads means one fewer than there are hardware threads
+	explicit work_pool(unsigned threads = 0);
+	~work_pool();
+
+	// the pool the algorithms use when you don't give them one
+	static work_pool& shared();
+
+	// worker threads, not counting whoever is calling run()
+	unsigned threads() const;
+
+	// call task(0) .. task(count - 1), in parallel where possible, and return
+	// once they've all finished
+	void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+
+	// not copyable
+	work_pool(const work_pool&);
+	work_pool& operator=(const work_pool&);
+
+	// one run() call, living on its caller's stack
+	struct job
+	{
+		const std::function<void(size_t)>* task;
+		size_t                             remaining;
+		std::mutex                         lock;
+		std::condition_variable            done;
+	};
+
+	// one call to a job's task
+	struct item
+	{
+		job*   owner;
+		size_t index;
+	};
+
+	// each worker's own work, which others may steal from the front of
+	struct queue
+	{
+		std::mutex       lock;
+		std::deque<item> items;
+	};
+
+	// find something to do, our own work first, then anyone else's
+	bool pop(size_t self, item& out);
+	void execute(const item& work);
+	void worker(size_t self);
+
+	// data
+	std::vector<std::thread> _workers;
+	queue*                   _queues;
+	unsigned                 _threads;
+	std::atomic<size_t>      _pending;
+	std::atomic<size_t>      _next;
+	std::mutex               _sleep_lock;
+	std::condition_variable  _wake;
+	bool                     _stop;
+
+};
+
+
+
+#define __ptr_parallel_inl_include__
+#include "ptr_parallel.inl"
+#undef __ptr_parallel_inl_include__
+
+
+
+#endif // __ptr_parallel_h__
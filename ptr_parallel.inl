@@ -0,0 +1,396 @@
+#if !defined(__ptr_parallel_inl_include__)
+#error "ptr_parallel.inl may only be included from ptr_parallel.h"
+#endif // !defined(__ptr_parallel_inl_include__)
+
+
+
+#ifndef __ptr_parallel_inl__
+#define __ptr_parallel_inl__
+
+
+
+#include <algorithm>
+#include <cassert>
+
+
+
+//
+// which pool (if any) the current thread works for
+//
+struct ptr_parallel_worker
+{
+	const work_pool* pool;
+	size_t           index;
+};
+
+inline ptr_parallel_worker& ptr_parallel_self()
+{
+	static thread_local ptr_parallel_worker self = { 0, 0 };
+	return self;
+}
+
+
+
+//
+// construction and destruction
+//
+inline work_pool::work_pool(unsigned threads) : _queues(0), _threads(threads), _pending(0), _next(0), _stop(false)
+{
+	if ( _threads == 0 )
+	{
+		// the caller makes up the last one
+		const unsigned hardware = std::thread::hardware_concurrency();
+		_threads = hardware > 1 ? hardware - 1 : 0;
+	}
+
+	// (workers start looking for work before we're done starting the rest)
+	_queues = _threads ? new queue[_threads] : 0;
+	for ( unsigned i = 0; i < _threads; ++i )
+	{
+		_workers.push_back(std::thread(&work_pool::worker, this, size_t(i)));
+	}
+}
+
+inline work_pool::~work_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(_sleep_lock);
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for ( size_t i = 0; i < _workers.size(); ++i )
+	{
+		_workers[i].join();
+	}
+	delete[] _queues;
+}
+
+inline work_pool& work_pool::shared()
+{
+	static work_pool pool;
+	return pool;
+}
+
+inline unsigned work_pool::threads() const
+{
+	return _threads;
+}
+
+
+
+//
+// running a job
+//
+inline void work_pool::run(size_t count, const std::function<void(size_t)>& task)
+{
+	// nobody to share with (or nothing to share)
+	if ( !_threads || count <= 1 )
+	{
+		for ( size_t i = 0; i < count; ++i )
+		{
+			task(i);
+		}
+		return;
+	}
+
+	job work;
+	work.task      = &task;
+	work.remaining = count;
+
+	// one of our own workers keeps it all for itself (to be stolen from),
+	// anyone else deals it out
+	const ptr_parallel_worker& self = ptr_parallel_self();
+	const size_t               mine = self.pool == this ? self.index : _threads;
+
+	_pending += count;
+	for ( size_t i = 0; i < count; ++i )
+	{
+		queue&                      q = _queues[mine < _threads ? mine : _next++ % _threads];
+		std::lock_guard<std::mutex> guard(q.lock);
+		item                        it = { &work, i };
+		q.items.push_back(it);
+	}
+	{
+		std::lock_guard<std::mutex> guard(_sleep_lock);
+	}
+	_wake.notify_all();
+
+	// lend a hand until it's all done
+	for ( ;; )
+	{
+		{
+			std::lock_guard<std::mutex> guard(work.lock);
+			if ( !work.remaining )
+			{
+				return;
+			}
+		}
+
+		item next;
+		if ( pop(mine, next) )
+		{
+			execute(next);
+			continue;
+		}
+
+		// everything left is already running somewhere
+		std::unique_lock<std::mutex> guard(work.lock);
+		while ( work.remaining )
+		{
+			work.done.wait(guard);
+		}
+		return;
+	}
+}
+
+inline bool work_pool::pop(size_t self, item& out)
+{
+	const size_t workers = _threads;
+
+	// our own, newest first
+	if ( self < workers )
+	{
+		queue&                      q = _queues[self];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if ( !q.items.empty() )
+		{
+			out = q.items.back();
+			q.items.pop_back();
+			_pending--;
+			return true;
+		}
+	}
+
+	// someone else's, oldest first
+	const size_t start = self < workers ? self + 1 : _next.load();
+	for ( size_t k = 0; k < workers; ++k )
+	{
+		const size_t victim = (start + k) % workers;
+		if ( victim == self )
+		{
+			continue;
+		}
+
+		queue&                      q = _queues[victim];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if ( !q.items.empty() )
+		{
+			out = q.items.front();
+			q.items.pop_front();
+			_pending--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline void work_pool::execute(const item& work)
+{
+	(*work.owner->task)(work.index);
+
+	// the job lives on its caller's stack, it may be gone the moment the
+	// count reaches zero and we let go of the lock
+	std::lock_guard<std::mutex> guard(work.owner->lock);
+	if ( --work.owner->remaining == 0 )
+	{
+		work.owner->done.notify_all();
+	}
+}
+
+inline void work_pool::worker(size_t self)
+{
+	ptr_parallel_worker& me = ptr_parallel_self();
+	me.pool  = this;
+	me.index = self;
+
+	for ( ;; )
+	{
+		item work;
+		if ( pop(self, work) )
+		{
+			execute(work);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(_sleep_lock);
+		if ( _stop )
+		{
+			return;
+		}
+		if ( _pending == 0 )
+		{
+			_wake.wait(guard);
+		}
+	}
+}
+
+
+
+//
+// splitting work up
+//
+inline size_t ptr_parallel_chunks(size_t n, const work_pool& pool)
+{
+	// a few chunks per thread so stealing can even things out, but never so
+	// small that handing them out costs more than doing them
+	const size_t grain  = 2048;
+	const size_t chunks = (size_t(pool.threads()) + 1) * 4;
+	const size_t most   = (n + grain - 1) / grain;
+	return chunks < most ? chunks : most;
+}
+
+inline size_t ptr_parallel_bound(size_t n, size_t chunk, size_t chunks)
+{
+	return n / chunks * chunk + n % chunks * chunk / chunks;
+}
+
+template <typename X>
+inline X* ptr_parallel_data(const array_ptr<X>& a)
+{
+	return a.size() ? a.operator->() : 0;
+}
+
+
+
+//
+// the algorithms, each holds one reference to its buffer(s) for the duration
+// of the job, taken and dropped here on the calling thread
+//
+template <typename X, typename F>
+inline void parallel_for(const array_ptr<X>& a, F f)
+{
+	parallel_for(a, f, work_pool::shared());
+}
+
+template <typename X, typename F>
+inline void parallel_for(const array_ptr<X>& a, F f, work_pool& pool)
+{
+	const array_ptr<X> hold(a);
+	X* const           p      = ptr_parallel_data(hold);
+	const size_t       n      = hold.size();
+	const size_t       chunks = ptr_parallel_chunks(n, pool);
+
+	pool.run(chunks, [&](size_t c)
+	{
+		const size_t last = ptr_parallel_bound(n, c + 1, chunks);
+		for ( size_t i = ptr_parallel_bound(n, c, chunks); i < last; ++i )
+		{
+			f(p[i]);
+		}
+	});
+}
+
+template <typename X, typename T, typename Op>
+inline T parallel_reduce(const array_ptr<X>& a, T identity, Op op)
+{
+	return parallel_reduce(a, identity, op, work_pool::shared());
+}
+
+template <typename X, typename T, typename Op>
+inline T parallel_reduce(const array_ptr<X>& a, T identity, Op op, work_pool& pool)
+{
+	const array_ptr<X> hold(a);
+	X* const           p      = ptr_parallel_data(hold);
+	const size_t       n      = hold.size();
+	const size_t       chunks = ptr_parallel_chunks(n, pool);
+
+	// a deque rather than a vector, so even bools have an element each
+	std::deque<T> partial(chunks, identity);
+	pool.run(chunks, [&](size_t c)
+	{
+		T            result = identity;
+		const size_t last   = ptr_parallel_bound(n, c + 1, chunks);
+		for ( size_t i = ptr_parallel_bound(n, c, chunks); i < last; ++i )
+		{
+			result = op(result, p[i]);
+		}
+		partial[c] = result;
+	});
+
+	T result = identity;
+	for ( size_t c = 0; c < chunks; ++c )
+	{
+		result = op(result, partial[c]);
+	}
+	return result;
+}
+
+template <typename X, typename Y, typename Op>
+inline void parallel_transform(const array_ptr<Y>& dest, const array_ptr<X>& src, Op op)
+{
+	parallel_transform(dest, src, op, work_pool::shared());
+}
+
+template <typename X, typename Y, typename Op>
+inline void parallel_transform(const array_ptr<Y>& dest, const array_ptr<X>& src, Op op, work_pool& pool)
+{
+	assert(dest.size() >= src.size());
+
+	const array_ptr<Y> hold_dest(dest);
+	const array_ptr<X> hold_src(src);
+	Y* const           d      = ptr_parallel_data(hold_dest);
+	X* const           s      = ptr_parallel_data(hold_src);
+	const size_t       n      = hold_src.size();
+	const size_t       chunks = ptr_parallel_chunks(n, pool);
+
+	pool.run(chunks, [&](size_t c)
+	{
+		const size_t last = ptr_parallel_bound(n, c + 1, chunks);
+		for ( size_t i = ptr_parallel_bound(n, c, chunks); i < last; ++i )
+		{
+			d[i] = op(s[i]);
+		}
+	});
+}
+
+template <typename X>
+inline void parallel_sort(const array_ptr<X>& a)
+{
+	parallel_sort(a, std::less<X>(), work_pool::shared());
+}
+
+template <typename X, typename Compare>
+inline void parallel_sort(const array_ptr<X>& a, Compare comp)
+{
+	parallel_sort(a, comp, work_pool::shared());
+}
+
+template <typename X, typename Compare>
+inline void parallel_sort(const array_ptr<X>& a, Compare comp, work_pool& pool)
+{
+	const array_ptr<X> hold(a);
+	X* const           p = ptr_parallel_data(hold);
+	const size_t       n = hold.size();
+
+	// a power of two number of chunks, so they pair up nicely for merging
+	size_t chunks = 1;
+	while ( chunks * 2 <= ptr_parallel_chunks(n, pool) )
+	{
+		chunks *= 2;
+	}
+
+	// sort each chunk on its own...
+	pool.run(chunks, [&](size_t c)
+	{
+		std::sort(p + ptr_parallel_bound(n, c, chunks), p + ptr_parallel_bound(n, c + 1, chunks), comp);
+	});
+
+	// ...then merge neighbours, halving the number of runs each time
+	for ( size_t width = 1; width < chunks; width *= 2 )
+	{
+		pool.run(chunks / (2 * width), [&](size_t k)
+		{
+			const size_t first = 2 * k * width;
+			std::inplace_merge(p + ptr_parallel_bound(n, first, chunks),
+			                   p + ptr_parallel_bound(n, first + width, chunks),
+			                   p + ptr_parallel_bound(n, first + 2 * width, chunks),
+			                   comp);
+		});
+	}
+}
+
+
+
+#endif // __ptr_parallel_inl__
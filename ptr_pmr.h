@@ -0,0 +1,67 @@
+#ifndef __ptr_pmr_h__
+#define __ptr_pmr_h__
+
+
+
+//
+//
+//
+// ptr<>s and array_ptr<>s allocated from a std::pmr::memory_resource
+//
+//
+// new T and new ptr_counter each go to the global heap, which is the wrong
+// place for objects that belong to one request (or one frame, or one parse)
+// when there's an arena for it already.  These allocate the object and its
+// control block together, in one piece, from whichever memory resource you
+// give them, and give it back to the same resource when the last reference
+// goes away:
+//
+//   char                                buffer[64 * 1024];
+//   std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+//
+//   ptr<Request>     r = make_pmr<Request>(&arena, socket);
+//   array_ptr<Field> f = make_pmr_array<Field>(&arena, 32);
+//
+// The resource is remembered in the control block, so nothing else needs to
+// know where the memory came from.  The resource must outlive every pointer
+// allocated from it (a monotonic resource frees nothing until it's
+// destroyed, so with one of those the memory is reclaimed all at once when
+// the arena goes, destructors having been run as the pointers went away).
+// A null resource means std::pmr::get_default_resource().
+//
+// Arrays know their size() and have their elements value-initialized, as
+// with the other sizing factories.  Exceptions from a constructor give the
+// memory back to the resource and propagate.
+//
+//
+
+
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "ptr.h"
+
+
+
+//
+// one T, constructed from args
+//
+template <typename T, typename... Args>
+ptr<T> make_pmr(std::pmr::memory_resource* resource, Args&&... args);
+
+//
+// n value-initialized Xs
+//
+template <typename X>
+array_ptr<X> make_pmr_array(std::pmr::memory_resource* resource, size_t n);
+
+
+
+#define __ptr_pmr_inl_include__
+#include "ptr_pmr.inl"
+#undef __ptr_pmr_inl_include__
+
+
+
+#endif // __ptr_pmr_h__
@@ -0,0 +1,156 @@
+#if !defined(__ptr_pmr_inl_include__)
+#error "ptr_pmr.inl may only be included from ptr_pmr.h"
+#endif // !defined(__ptr_pmr_inl_include__)
+
+
+
+#ifndef __ptr_pmr_inl__
+#define __ptr_pmr_inl__
+
+
+
+#include <new>
+#include <utility>
+
+
+
+//
+// a control block that remembers where its memory came from, the object
+// follows it in the same allocation
+//
+struct ptr_pmr_counter : public ptr_counter
+{
+	ptr_pmr_counter(size_t length, release_func release, std::pmr::memory_resource* resource, size_t bytes, size_t alignment)
+		: ptr_counter(length, release), _resource(resource), _bytes(bytes), _alignment(alignment) { /* empty */ };
+	std::pmr::memory_resource* _resource;
+	size_t                     _bytes;
+	size_t                     _alignment;
+};
+
+//
+// where in the allocation the objects start, and how big and how aligned the
+// whole thing has to be
+//
+template <typename X>
+struct ptr_pmr_layout
+{
+	enum
+	{
+		alignment = alignof(X) > alignof(ptr_pmr_counter) ? alignof(X) : alignof(ptr_pmr_counter),
+		offset    = (sizeof(ptr_pmr_counter) + alignof(X) - 1) / alignof(X) * alignof(X)
+	};
+
+	static size_t bytes(size_t n) { return offset + n * sizeof(X); }
+};
+
+
+
+//
+// releasing storage, the counter and the objects are destroyed and the lot
+// goes back to the resource in one piece (every counter made here has its
+// _release set, so basic_ptr<>'s out of line release() always comes here and
+// never to its deletion policy, which would hand the resource's memory to
+// delete)
+//
+inline void ptr_pmr_deallocate(ptr_pmr_counter* counter)
+{
+	std::pmr::memory_resource* resource  = counter->_resource;
+	const size_t               bytes     = counter->_bytes;
+	const size_t               alignment = counter->_alignment;
+
+	counter->~ptr_pmr_counter();
+	resource->deallocate(counter, bytes, alignment);
+}
+
+template <typename T>
+inline void ptr_pmr_release(void* normal_ptr, ptr_counter* counter)
+{
+	static_cast<T*>(normal_ptr)->~T();
+	ptr_pmr_deallocate(static_cast<ptr_pmr_counter*>(counter));
+}
+
+template <typename X>
+inline void ptr_pmr_release_array(void* normal_ptr, ptr_counter* counter)
+{
+	X* p = static_cast<X*>(normal_ptr);
+	for ( size_t i = counter->_length; i > 0; --i )
+	{
+		p[i - 1].~X();
+	}
+	ptr_pmr_deallocate(static_cast<ptr_pmr_counter*>(counter));
+}
+
+
+
+//
+// the factories
+//
+template <typename T, typename... Args>
+inline ptr<T> make_pmr(std::pmr::memory_resource* resource, Args&&... args)
+{
+	typedef ptr_pmr_layout<T> layout;
+
+	if ( !resource )
+	{
+		resource = std::pmr::get_default_resource();
+	}
+
+	char*            block   = static_cast<char*>(resource->allocate(layout::bytes(1), layout::alignment));
+	ptr_pmr_counter* counter = new(block) ptr_pmr_counter(0, ptr_pmr_release<T>, resource, layout::bytes(1), layout::alignment);
+
+	T* object = 0;
+	try
+	{
+		object = new(block + layout::offset) T(std::forward<Args>(args)...);
+	}
+	catch ( ... )
+	{
+		ptr_pmr_deallocate(counter);
+		throw;
+	}
+
+	return ptr<T>(object, counter);
+}
+
+template <typename X>
+inline array_ptr<X> make_pmr_array(std::pmr::memory_resource* resource, size_t n)
+{
+	typedef ptr_pmr_layout<X> layout;
+
+	if ( !n )
+	{
+		return array_ptr<X>();
+	}
+	if ( !resource )
+	{
+		resource = std::pmr::get_default_resource();
+	}
+
+	char*            block   = static_cast<char*>(resource->allocate(layout::bytes(n), layout::alignment));
+	ptr_pmr_counter* counter = new(block) ptr_pmr_counter(n, ptr_pmr_release_array<X>, resource, layout::bytes(n), layout::alignment);
+
+	X*     p           = reinterpret_cast<X*>(block + layout::offset);
+	size_t constructed = 0;
+	try
+	{
+		for ( ; constructed < n; ++constructed )
+		{
+			new(p + constructed) X();
+		}
+	}
+	catch ( ... )
+	{
+		while ( constructed > 0 )
+		{
+			p[--constructed].~X();
+		}
+		ptr_pmr_deallocate(counter);
+		throw;
+	}
+
+	return array_ptr<X>(p, counter);
+}
+
+
+
+#endif // __ptr_pmr_inl__
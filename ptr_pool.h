@@ -0,0 +1,161 @@
+#ifndef __ptr_pool_h__
+#define __ptr_pool_h__
+
+
+
+//
+//
+//
+// recycling array_ptr<char> buffers instead of going back to the heap
+//
+//
+// I/O paths tend to allocate buffers of a handful of sizes over and over,
+// thousands of times a second, and big ones cost the allocator real work
+// (buffers past a few hundred kilobytes are mmap()ed and unmapped every
+// time).  A buffer_pool hands out array_ptr<char>s from power-of-two size
+// classes, and when the last reference to one goes, its release hook puts it
+// back in a cache kept for the thread that let it go, instead of freeing it:
+//
+//   array_ptr<char> b = make_pooled_buffer(65536);  // from the shared pool
+//   size_t got = read(fd, &b[0], b.size());
+//   ...
+//   b = 0;                                           // back to this thread's
+//                                                    // cache, not the heap
+//
+//   buffer_pool pool(4 << 20);                       // or a pool of your own,
+//   array_ptr<char> c = pool.make(1500);             // caching up to 4MB per
+//                                                    // thread per size class
+//
+// Each thread's cache is a slot of its own (handed out as sharded_ptr<>
+// hands out count slots, so threads only share one when there are more of
+// them than hardware threads), with a short lock that's only ever contended
+// then.  When a slot has more of a size than it's allowed, half of them move
+// to a list shared by every thread, and a slot that's run out takes a batch
+// back from there before it goes to the heap, so buffers made on one thread
+// and let go on another still go round.
+//
+// Nothing is given back to the heap unless asked: trim() frees the buffers
+// that have sat unused since the trim() before it (each cache remembers the
+// fewest it held in between, those never needed are the ones that go), so
+// calling it every second or so from some housekeeping thread returns what
+// an idle spell left behind.  purge() frees everything cached.  stats()
+// says what's out, what's cached and how often the caches had a buffer to
+// hand, size class by size class.
+//
+// Buffers know their size() (the size asked for, though there's room up to
+// the size class), and come uninitialized, with 64 byte alignment.  Requests
+// bigger than the largest class (16MB) are made and freed on the spot.  A
+// pool has to outlive every buffer it makes, the shared one never goes.
+//
+//
+
+
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// one size class's occupancy, and the pool's as a whole
+//
+struct buffer_pool_class
+{
+	size_t   bytes;       // each buffer's capacity
+	uint64_t in_use;      // buffers out right now
+	uint64_t cached;      // buffers waiting to be reused
+	uint64_t made;        // make() calls
+	uint64_t reused;      // of those, handed a cached buffer
+	uint64_t trimmed;     // buffers given back to the heap
+};
+
+struct buffer_pool_stats
+{
+	std::vector<buffer_pool_class> classes;
+	uint64_t                       bytes_in_use; // capacity, not size()s
+	uint64_t                       bytes_cached;
+	double                         hit_rate;     // reused / made, 0 before any
+};
+
+
+
+class buffer_pool
+{
+public:
+
+	// caching up to cache_bytes of each size class per thread
+	explicit buffer_pool(size_t cache_bytes = 1 << 20);
+	~buffer_pool();
+
+	// the pool make_pooled_buffer() uses
+	static buffer_pool& shared();
+
+	// an uninitialized buffer of n bytes
+	array_ptr<char> make(size_t n);
+
+	// free whatever's sat unused since the last trim(), and everything cached
+	void trim();
+	void purge();
+
+	// occupancy, by size class
+	buffer_pool_stats stats() const;
+
+	// the smallest and largest size classes, and how many there are
+	enum { smallest_bits = 6, largest_bits = 24, classes = largest_bits - smallest_bits + 1 };
+
+private:
+
+	// not copyable
+	buffer_pool(const buffer_pool&);
+	buffer_pool& operator=(const buffer_pool&);
+
+	struct block;
+	struct counter;
+	struct list;
+	struct slot;
+	struct central;
+
+	// the release hook, every buffer's last reference ends up here
+	static void release(void* normal_ptr, ptr_counter* counter);
+
+	// room for the control block in front of a buffer's bytes, and the size
+	// class n bytes come from (classes if none)
+	static size_t header();
+	static unsigned class_of(size_t n);
+
+	// a cached block of class c, or 0
+	block* take(unsigned c);
+	void   recycle(block* b, unsigned c);
+
+	// give back what's sat unused since the last trim (or everything)
+	void trim(bool everything);
+
+	// how many of class c a slot may keep, and move at once
+	size_t limit(unsigned c) const;
+
+	// data
+	slot*        _slots;
+	central*     _shared;      // one per class
+	const size_t _cache_bytes;
+
+};
+
+//
+// a buffer from the shared pool
+//
+array_ptr<char> make_pooled_buffer(size_t n);
+
+
+
+#define __ptr_pool_inl_include__
+#include "ptr_pool.inl"
+#undef __ptr_pool_inl_include__
+
+
+
+#endif // __ptr_pool_h__
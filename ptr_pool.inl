@@ -0,0 +1,394 @@
+#if !defined(__ptr_pool_inl_include__)
+#error "ptr_pool.inl may only be included from ptr_pool.h"
+#endif // !defined(__ptr_pool_inl_include__)
+
+
+
+#ifndef __ptr_pool_inl__
+#define __ptr_pool_inl__
+
+
+
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "ptr_sharded.h"
+
+
+
+//
+// a lock held for a handful of instructions, only ever contended when
+// threads share a slot
+//
+struct ptr_pool_lock
+{
+	ptr_pool_lock() : _held(false) { /* empty */ };
+
+	void lock()
+	{
+		while ( _held.exchange(true, std::memory_order_acquire) )
+		{
+			while ( _held.load(std::memory_order_relaxed) )
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void unlock()
+	{
+		_held.store(false, std::memory_order_release);
+	}
+
+	std::atomic<bool> _held;
+};
+
+
+
+//
+// the pieces
+//
+
+// a buffer's memory, while it's cached the first word links it to the next
+struct buffer_pool::block
+{
+	block* _next;
+};
+
+// while it's out, a buffer's control block sits at the start of its memory
+struct buffer_pool::counter : public ptr_counter
+{
+	counter(size_t length, buffer_pool* pool, unsigned c) : ptr_counter(length, &buffer_pool::release), _pool(pool), _class(c) { /* empty */ };
+	buffer_pool* _pool;
+	unsigned     _class;
+};
+
+// cached blocks of one size class, and the fewest there have been since the
+// last trim
+struct buffer_pool::list
+{
+	list() : _head(0), _count(0), _low(0) { /* empty */ };
+
+	void push(block* b)
+	{
+		b->_next = _head;
+		_head    = b;
+		++_count;
+	}
+
+	block* pop()
+	{
+		block* b = _head;
+		_head = b->_next;
+		if ( --_count < _low )
+		{
+			_low = _count;
+		}
+		return b;
+	}
+
+	block* _head;
+	size_t _count;
+	size_t _low;
+};
+
+// a thread's (or a few threads') cache
+struct alignas(64) buffer_pool::slot
+{
+	slot()
+	{
+		for ( unsigned c = 0; c < classes; ++c )
+		{
+			_made[c] = _reused[c] = _released[c] = _trimmed[c] = 0;
+		}
+	}
+
+	ptr_pool_lock _lock;
+	list          _lists[classes];
+	uint64_t      _made[classes];
+	uint64_t      _reused[classes];
+	uint64_t      _released[classes];
+	uint64_t      _trimmed[classes];
+};
+
+// where a size class's overflow goes, for any thread to take
+struct alignas(64) buffer_pool::central
+{
+	central() : _trimmed(0) { /* empty */ };
+
+	ptr_pool_lock _lock;
+	list          _list;
+	uint64_t      _trimmed;
+};
+
+
+
+//
+// sizes
+//
+inline size_t buffer_pool::header()
+{
+	return (sizeof(counter) + 63) & ~size_t(63);
+}
+
+inline unsigned buffer_pool::class_of(size_t n)
+{
+	if ( n > (size_t(1) << largest_bits) )
+	{
+		return classes;
+	}
+	if ( n <= (size_t(1) << smallest_bits) )
+	{
+		return 0;
+	}
+	return unsigned(64 - __builtin_clzll(uint64_t(n - 1))) - smallest_bits;
+}
+
+inline size_t buffer_pool::limit(unsigned c) const
+{
+	const size_t n = _cache_bytes >> (smallest_bits + c);
+	return n > 2 ? n : 2;
+}
+
+
+
+//
+// construction and destruction
+//
+inline buffer_pool::buffer_pool(size_t cache_bytes) : _slots(new slot[ptr_shard_count()]), _shared(new central[classes]), _cache_bytes(cache_bytes)
+{
+	// empty
+}
+
+inline buffer_pool::~buffer_pool()
+{
+	purge();
+	delete[] _slots;
+	delete[] _shared;
+}
+
+inline buffer_pool& buffer_pool::shared()
+{
+	// never destroyed, buffers may well be let go of during static destruction
+	static buffer_pool* s_pool = new buffer_pool;
+	return *s_pool;
+}
+
+
+
+//
+// making and recycling buffers
+//
+inline array_ptr<char> buffer_pool::make(size_t n)
+{
+	if ( !n )
+	{
+		return array_ptr<char>();
+	}
+
+	const unsigned c = class_of(n);
+	block*         b = (c < classes) ? take(c) : 0;
+	if ( !b )
+	{
+		const size_t bytes = (c < classes) ? (size_t(1) << (smallest_bits + c)) : n;
+		b = static_cast<block*>(::operator new(header() + bytes, std::align_val_t(64)));
+	}
+
+	counter* k = new(b) counter(n, this, c);
+	return array_ptr<char>(reinterpret_cast<char*>(b) + header(), k);
+}
+
+inline buffer_pool::block* buffer_pool::take(unsigned c)
+{
+	slot&                          s = _slots[ptr_shard_index()];
+	std::lock_guard<ptr_pool_lock> guard(s._lock);
+	list&                          l = s._lists[c];
+	s._made[c]++;
+
+	if ( !l._count )
+	{
+		// run out, see if other threads have left any
+		central&                       h = _shared[c];
+		std::lock_guard<ptr_pool_lock> shared_guard(h._lock);
+		for ( size_t i = limit(c) / 2; i > 0 && h._list._count; --i )
+		{
+			l.push(h._list.pop());
+		}
+		if ( !l._count )
+		{
+			return 0;
+		}
+	}
+
+	s._reused[c]++;
+	return l.pop();
+}
+
+inline void buffer_pool::recycle(block* b, unsigned c)
+{
+	slot&                          s = _slots[ptr_shard_index()];
+	std::lock_guard<ptr_pool_lock> guard(s._lock);
+	list&                          l = s._lists[c];
+	s._released[c]++;
+
+	if ( l._count >= limit(c) )
+	{
+		// too many, half of them go where any thread can have them
+		central&                       h = _shared[c];
+		std::lock_guard<ptr_pool_lock> shared_guard(h._lock);
+		for ( size_t i = limit(c) / 2; i > 0; --i )
+		{
+			h._list.push(l.pop());
+		}
+	}
+
+	l.push(b);
+}
+
+inline void buffer_pool::release(void*, ptr_counter* c)
+{
+	counter*       k    = static_cast<counter*>(c);
+	buffer_pool*   pool = k->_pool;
+	const unsigned cls  = k->_class;
+	block*         b    = reinterpret_cast<block*>(k);
+
+	k->~counter();
+	if ( cls < classes )
+	{
+		pool->recycle(b, cls);
+	}
+	else
+	{
+		::operator delete(b, std::align_val_t(64));
+	}
+}
+
+
+
+//
+// giving memory back
+//
+inline void buffer_pool::trim()
+{
+	trim(false);
+}
+
+inline void buffer_pool::purge()
+{
+	trim(true);
+}
+
+inline void buffer_pool::trim(bool everything)
+{
+	// taken off the lists with them locked, freed once they aren't
+	list freed;
+
+	for ( unsigned i = 0; i < ptr_shard_count(); ++i )
+	{
+		slot&                          s = _slots[i];
+		std::lock_guard<ptr_pool_lock> guard(s._lock);
+		for ( unsigned c = 0; c < classes; ++c )
+		{
+			list&        l = s._lists[c];
+			const size_t n = everything ? l._count : (l._low < l._count ? l._low : l._count);
+			for ( size_t j = 0; j < n; ++j )
+			{
+				freed.push(l.pop());
+			}
+			s._trimmed[c] += n;
+			l._low         = l._count;
+		}
+	}
+
+	for ( unsigned c = 0; c < classes; ++c )
+	{
+		central&                       h = _shared[c];
+		std::lock_guard<ptr_pool_lock> guard(h._lock);
+		list&                          l = h._list;
+		const size_t                   n = everything ? l._count : (l._low < l._count ? l._low : l._count);
+		for ( size_t j = 0; j < n; ++j )
+		{
+			freed.push(l.pop());
+		}
+		h._trimmed += n;
+		l._low      = l._count;
+	}
+
+	while ( freed._count )
+	{
+		::operator delete(freed.pop(), std::align_val_t(64));
+	}
+}
+
+
+
+//
+// statistics
+//
+inline buffer_pool_stats buffer_pool::stats() const
+{
+	buffer_pool_stats total;
+	total.classes.resize(classes);
+	total.bytes_in_use = 0;
+	total.bytes_cached = 0;
+
+	uint64_t released[classes] = {};
+	for ( unsigned c = 0; c < classes; ++c )
+	{
+		buffer_pool_class& k = total.classes[c];
+		k.bytes  = size_t(1) << (smallest_bits + c);
+		k.in_use = k.cached = k.made = k.reused = k.trimmed = 0;
+	}
+
+	for ( unsigned i = 0; i < ptr_shard_count(); ++i )
+	{
+		slot&                          s = _slots[i];
+		std::lock_guard<ptr_pool_lock> guard(s._lock);
+		for ( unsigned c = 0; c < classes; ++c )
+		{
+			buffer_pool_class& k = total.classes[c];
+			k.made      += s._made[c];
+			k.reused    += s._reused[c];
+			k.cached    += s._lists[c]._count;
+			k.trimmed   += s._trimmed[c];
+			released[c] += s._released[c];
+		}
+	}
+
+	uint64_t made   = 0;
+	uint64_t reused = 0;
+	for ( unsigned c = 0; c < classes; ++c )
+	{
+		central&                       h = _shared[c];
+		std::lock_guard<ptr_pool_lock> guard(h._lock);
+		buffer_pool_class&             k = total.classes[c];
+		k.cached  += h._list._count;
+		k.trimmed += h._trimmed;
+
+		// (slots are locked one at a time, so a buffer let go of on one thread
+		// while another was being counted can make these a little off)
+		k.in_use = (k.made > released[c]) ? k.made - released[c] : 0;
+
+		total.bytes_in_use += k.in_use * k.bytes;
+		total.bytes_cached += k.cached * k.bytes;
+		made               += k.made;
+		reused             += k.reused;
+	}
+	total.hit_rate = made ? double(reused) / double(made) : 0.0;
+	return total;
+}
+
+
+
+//
+// the shorthand
+//
+inline array_ptr<char> make_pooled_buffer(size_t n)
+{
+	return buffer_pool::shared().make(n);
+}
+
+
+
+#endif // __ptr_pool_inl__
@@ -0,0 +1,92 @@
+#ifndef __ptr_profile_h__
+#define __ptr_profile_h__
+
+
+
+//
+//
+//
+// a sampling heap profile of objects owned by ptr<>s
+//
+//
+// Recording every allocation is far too slow to leave on in production, so
+// this samples instead: on average one object in every so many bytes handed
+// to a ptr<> or array_ptr<> (512KB unless you say otherwise) has its call
+// stack recorded, and is remembered until its last reference goes away.
+// Sampling is a Poisson process over bytes, so big objects are more likely
+// to be caught than small ones, and each sample stands for as many bytes as
+// it's likely to have been picked out of.  An object that isn't sampled
+// costs one subtraction from a thread-local countdown, and a branch.
+//
+// It's compiled in only when PTR_PROFILE is defined, which must be the same
+// for the whole program (it adds a field to the control block), so do it on
+// the command line:
+//
+//   g++ -DPTR_PROFILE -g ...
+//
+//   ptr_profile_set_rate(64 * 1024);              // sample more often
+//   ...
+//   std::ofstream heap("app.heap");
+//   ptr_profile_write_pprof(heap);                // pprof --text app app.heap
+//   ptr_profile_write_text(std::cerr);            // or read it yourself
+//
+// The pprof output is the legacy heap profile format (what gperftools writes),
+// with the process's mappings appended so pprof can symbolize it.  The text
+// output groups the live samples by type and call stack, biggest estimated
+// total first, symbolized as well as backtrace_symbols() can (link with
+// -rdynamic for function names).
+//
+// Only objects that are still alive are reported, and only the moment an
+// object is first owned is sampled, so what's reported is which call sites
+// created what's holding the memory now.  Storage from mmap, shared memory
+// and the like is counted by its element size the same as anything else.
+// Everything is safe to use from any thread.
+//
+//
+
+
+
+#if !defined(PTR_PROFILE)
+#error "the heap profile is only compiled in when PTR_PROFILE is defined (for the whole program)"
+#endif
+
+
+
+#include <cstddef>
+#include <ostream>
+
+#include "ptr.h"
+
+
+
+//
+// sampling rate, the mean number of bytes between samples (0 stops sampling)
+//
+// The calling thread starts counting down from the new rate immediately, the
+// others the next time their countdown runs out.
+//
+void   ptr_profile_set_rate(size_t bytes);
+size_t ptr_profile_rate();
+
+//
+// number of sampled objects still alive, and the bytes they're estimated to
+// stand for
+//
+size_t ptr_profile_live_samples();
+size_t ptr_profile_live_bytes();
+
+//
+// write out the live samples
+//
+void ptr_profile_write_text(std::ostream& out);
+void ptr_profile_write_pprof(std::ostream& out);
+
+
+
+#define __ptr_profile_inl_include__
+#include "ptr_profile.inl"
+#undef __ptr_profile_inl_include__
+
+
+
+#endif // __ptr_profile_h__
@@ -0,0 +1,318 @@
+#if !defined(__ptr_profile_inl_include__)
+#error "ptr_profile.inl may only be included from ptr_profile.h"
+#endif // !defined(__ptr_profile_inl_include__)
+
+
+
+#ifndef __ptr_profile_inl__
+#define __ptr_profile_inl__
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cxxabi.h>
+#include <execinfo.h>
+
+
+
+//
+// what's remembered about each sampled object
+//
+enum { ptr_profile_max_depth = 32 };
+
+struct ptr_profile_record
+{
+	size_t                _bytes;
+	double                _weight; // objects this sample stands for
+	const std::type_info* _type;
+	int                   _depth;
+	void*                 _frames[ptr_profile_max_depth];
+};
+
+struct ptr_profile_state
+{
+	ptr_profile_state() : _rate(512 * 1024) { /* empty */ };
+	std::atomic<size_t>                                        _rate;
+	std::mutex                                                 _lock;
+	std::unordered_map<const ptr_counter*, ptr_profile_record> _live;
+};
+
+// never destroyed, pointers released during static destruction still find it
+inline ptr_profile_state& ptr_profile_instance()
+{
+	static ptr_profile_state* s_state = new ptr_profile_state;
+	return *s_state;
+}
+
+inline thread_local bool     ptr_profile_seeded = false;
+inline thread_local uint64_t ptr_profile_random = 0;
+
+// exponentially distributed bytes until the next sample, mean rate
+inline int64_t ptr_profile_interval(size_t rate)
+{
+	if ( !ptr_profile_random )
+	{
+		ptr_profile_random = uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) ^ reinterpret_cast<uintptr_t>(&ptr_profile_random);
+		ptr_profile_random |= 1;
+	}
+
+	// xorshift64*
+	ptr_profile_random ^= ptr_profile_random >> 12;
+	ptr_profile_random ^= ptr_profile_random << 25;
+	ptr_profile_random ^= ptr_profile_random >> 27;
+	const double u = double(((ptr_profile_random * 2685821657736338717ull) >> 11) + 1) / 9007199254740992.0; // (0,1]
+
+	const double interval = -std::log(u) * double(rate);
+	return interval < 1.0 ? 1 : interval > 1e12 ? int64_t(1e12) : int64_t(interval);
+}
+
+// how long to count down while sampling is off, before looking again
+const int64_t ptr_profile_idle_interval = int64_t(1) << 30;
+
+
+
+//
+// the hooks called from ptr.inl
+//
+inline void ptr_profile_sample(ptr_counter* counter, size_t bytes, const std::type_info& type)
+{
+	ptr_profile_state& state = ptr_profile_instance();
+	const size_t       rate  = state._rate.load(std::memory_order_relaxed);
+	if ( !rate )
+	{
+		ptr_profile_countdown = ptr_profile_idle_interval;
+		return;
+	}
+
+	// a thread's first countdown starts here, rather than sampling the very
+	// first thing it makes
+	if ( !ptr_profile_seeded )
+	{
+		ptr_profile_seeded     = true;
+		ptr_profile_countdown += ptr_profile_interval(rate);
+		if ( ptr_profile_countdown >= 0 )
+		{
+			return;
+		}
+	}
+	ptr_profile_countdown = ptr_profile_interval(rate);
+
+	// it's in, it stands for everything of its size it's likely to have
+	// been picked out of
+	ptr_profile_record record;
+	record._bytes  = bytes;
+	record._weight = 1.0 / -std::expm1(-double(bytes) / double(rate));
+	record._type   = &type;
+	record._depth  = backtrace(record._frames, ptr_profile_max_depth);
+
+	// (leave ourselves off the top of the stack)
+	if ( record._depth > 0 )
+	{
+		std::copy(record._frames + 1, record._frames + record._depth, record._frames);
+		record._depth--;
+	}
+
+	counter->_sampled = true;
+	std::lock_guard<std::mutex> guard(state._lock);
+	state._live[counter] = record;
+}
+
+inline void ptr_profile_forget(ptr_counter* counter)
+{
+	ptr_profile_state&          state = ptr_profile_instance();
+	std::lock_guard<std::mutex> guard(state._lock);
+	state._live.erase(counter);
+}
+
+
+
+//
+// sampling rate
+//
+inline void ptr_profile_set_rate(size_t bytes)
+{
+	ptr_profile_instance()._rate.store(bytes, std::memory_order_relaxed);
+	ptr_profile_seeded    = true;
+	ptr_profile_countdown = bytes ? ptr_profile_interval(bytes) : ptr_profile_idle_interval;
+}
+
+inline size_t ptr_profile_rate()
+{
+	return ptr_profile_instance()._rate.load(std::memory_order_relaxed);
+}
+
+
+
+//
+// what's alive
+//
+inline size_t ptr_profile_live_samples()
+{
+	ptr_profile_state&          state = ptr_profile_instance();
+	std::lock_guard<std::mutex> guard(state._lock);
+	return state._live.size();
+}
+
+inline size_t ptr_profile_live_bytes()
+{
+	ptr_profile_state&          state = ptr_profile_instance();
+	std::lock_guard<std::mutex> guard(state._lock);
+
+	double bytes = 0;
+	for ( std::unordered_map<const ptr_counter*, ptr_profile_record>::const_iterator it = state._live.begin(); it != state._live.end(); ++it )
+	{
+		bytes += double(it->second._bytes) * it->second._weight;
+	}
+	return size_t(bytes);
+}
+
+
+
+//
+// writing it out, samples with the same type and stack are reported together
+//
+struct ptr_profile_group
+{
+	ptr_profile_group() : _samples(0), _sampled_bytes(0), _objects(0), _bytes(0) { /* empty */ };
+	const std::type_info* _type;
+	std::vector<void*>    _frames;
+	size_t                _samples;
+	size_t                _sampled_bytes;
+	double                _objects;
+	double                _bytes;
+};
+
+inline bool ptr_profile_bigger(const ptr_profile_group& a, const ptr_profile_group& b)
+{
+	return a._bytes > b._bytes;
+}
+
+inline std::vector<ptr_profile_group> ptr_profile_groups()
+{
+	typedef std::pair<const std::type_info*, std::vector<void*> > key;
+	std::map<key, ptr_profile_group> groups;
+	{
+		ptr_profile_state&          state = ptr_profile_instance();
+		std::lock_guard<std::mutex> guard(state._lock);
+		for ( std::unordered_map<const ptr_counter*, ptr_profile_record>::const_iterator it = state._live.begin(); it != state._live.end(); ++it )
+		{
+			const ptr_profile_record& r = it->second;
+			ptr_profile_group&        g = groups[key(r._type, std::vector<void*>(r._frames, r._frames + r._depth))];
+			g._samples       += 1;
+			g._sampled_bytes += r._bytes;
+			g._objects       += r._weight;
+			g._bytes         += double(r._bytes) * r._weight;
+		}
+	}
+
+	std::vector<ptr_profile_group> sorted;
+	for ( std::map<key, ptr_profile_group>::iterator it = groups.begin(); it != groups.end(); ++it )
+	{
+		sorted.push_back(it->second);
+		sorted.back()._type   = it->first.first;
+		sorted.back()._frames = it->first.second;
+	}
+	std::sort(sorted.begin(), sorted.end(), ptr_profile_bigger);
+	return sorted;
+}
+
+inline std::string ptr_profile_type_name(const std::type_info& type)
+{
+	int         status    = 0;
+	char*       demangled = abi::__cxa_demangle(type.name(), 0, 0, &status);
+	std::string name(status == 0 && demangled ? demangled : type.name());
+	free(demangled);
+	return name;
+}
+
+inline void ptr_profile_write_text(std::ostream& out)
+{
+	const std::vector<ptr_profile_group> groups = ptr_profile_groups();
+
+	size_t samples = 0;
+	double bytes   = 0;
+	for ( size_t i = 0; i < groups.size(); ++i )
+	{
+		samples += groups[i]._samples;
+		bytes   += groups[i]._bytes;
+	}
+
+	char line[256];
+	snprintf(line, sizeof(line), "ptr<> heap profile: %zu live samples, about %.0f bytes (one sample every %zu bytes)\n", samples, bytes, ptr_profile_rate());
+	out << line;
+
+	for ( size_t i = 0; i < groups.size(); ++i )
+	{
+		const ptr_profile_group& g = groups[i];
+		snprintf(line, sizeof(line), "\n%.0f bytes in %.0f objects (%zu samples) of ", g._bytes, g._objects, g._samples);
+		out << line << ptr_profile_type_name(*g._type) << "\n";
+
+		char** symbols = g._frames.empty() ? 0 : backtrace_symbols(&g._frames[0], int(g._frames.size()));
+		for ( size_t f = 0; f < g._frames.size(); ++f )
+		{
+			if ( symbols )
+			{
+				out << "    " << symbols[f] << "\n";
+			}
+			else
+			{
+				snprintf(line, sizeof(line), "    %p\n", g._frames[f]);
+				out << line;
+			}
+		}
+		free(symbols);
+	}
+}
+
+inline void ptr_profile_write_pprof(std::ostream& out)
+{
+	const std::vector<ptr_profile_group> groups = ptr_profile_groups();
+
+	// raw sample counts, pprof scales them up by the rate itself
+	size_t samples = 0;
+	size_t bytes   = 0;
+	for ( size_t i = 0; i < groups.size(); ++i )
+	{
+		samples += groups[i]._samples;
+		bytes   += groups[i]._sampled_bytes;
+	}
+
+	char line[128];
+	snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", samples, bytes, samples, bytes, ptr_profile_rate());
+	out << line;
+
+	for ( size_t i = 0; i < groups.size(); ++i )
+	{
+		const ptr_profile_group& g = groups[i];
+		snprintf(line, sizeof(line), "%zu: %zu [%zu: %zu] @", g._samples, g._sampled_bytes, g._samples, g._sampled_bytes);
+		out << line;
+		for ( size_t f = 0; f < g._frames.size(); ++f )
+		{
+			snprintf(line, sizeof(line), " %p", g._frames[f]);
+			out << line;
+		}
+		out << "\n";
+	}
+
+	// and where everything was loaded, so the addresses can be symbolized
+	out << "\nMAPPED_LIBRARIES:\n";
+	std::ifstream maps("/proc/self/maps");
+	out << maps.rdbuf();
+}
+
+
+
+#endif // __ptr_profile_inl__
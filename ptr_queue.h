@@ -0,0 +1,168 @@
+#ifndef __ptr_queue_h__
+#define __ptr_queue_h__
+
+
+
+//
+//
+//
+// handing ptr<>s from thread to thread without locks, or counting
+//
+//
+// Passing work items between pipeline stages through a std::deque behind a
+// mutex costs a lock each way, and a copy in and a copy out of the deque,
+// i.e. an increment and a decrement of the item's count just to end up
+// where it started.  Both queues here move the handle itself instead: its
+// bytes go into a slot and the one you pushed is left empty, and popping
+// moves them back out into yours, so the item's counter is never touched
+// along the way (see ptr_relocatable<> in ptr.h):
+//
+//   ptr_queue< ptr<Job> > jobs(1024);        // room for 1024
+//
+//   ptr<Job> j = new Job(...);              // producers
+//   if ( !jobs.push(j) )                    // j is null after a push
+//     ...                                   // (and untouched when full)
+//
+//   ptr<Job> next;                          // consumers
+//   while ( jobs.pop(next) )                // whatever next held is let go
+//     next->run();
+//
+// ptr_queue<> is a bounded ring that any number of threads may push to and
+// pop from at once, without locking: each slot has a sequence number saying
+// whose turn it is, and pushers and poppers claim slots by bumping their end
+// of the ring with a compare-and-swap.  Items come out in the order their
+// slots were claimed.
+//
+// ptr_deque<> is for work stealing: one thread (its owner) pushes and pops
+// at the bottom, last in first out, while any number of others steal() from
+// the top.  The owner only pays for an atomic exchange when it pops, and
+// only competes with thieves (with a compare-and-swap) for the very last
+// item.  Thieves read an item before they know it's theirs, so the deque
+// only holds relocatable types (ptr<> and friends) and copies them a word at
+// a time.
+//
+// Because an item only ever has one handle in flight, even an ordinary
+// (unsynchronized) ptr<> is safe to pass this way, so long as the pushing
+// thread gave up every other handle it had to the object.  Element types
+// need a default constructor (which is what's left behind by a push).  Both
+// are fixed in size, rounded up to a power of two, and anything still in
+// them when they're destroyed is let go.
+//
+//
+
+
+
+#include <atomic>
+#include <cstddef>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// multiple producers, multiple consumers
+//
+template <typename T>
+class ptr_queue
+{
+public:
+
+	explicit ptr_queue(size_t capacity);
+	~ptr_queue();
+
+	// move value into the queue (leaving it empty), false if it's full
+	bool push(T& value);
+
+	// move the oldest item out into value, false if there isn't one
+	bool pop(T& value);
+
+	// how many it can hold, and roughly how many it's holding now
+	size_t capacity() const;
+	size_t size() const;
+
+private:
+
+	// not copyable
+	ptr_queue(const ptr_queue&);
+	ptr_queue& operator=(const ptr_queue&);
+
+	struct cell
+	{
+		std::atomic<size_t>           _sequence;
+		alignas(T) unsigned char      _storage[sizeof(T)];
+	};
+
+	// data
+	cell*                           _cells;
+	const size_t                    _mask;
+	alignas(64) std::atomic<size_t> _push; // next slot to push to
+	alignas(64) std::atomic<size_t> _pop;  // next slot to pop from
+
+};
+
+
+
+//
+// one owner pushing and popping at the bottom, thieves stealing from the top
+//
+template <typename T>
+class ptr_deque
+{
+public:
+
+	explicit ptr_deque(size_t capacity);
+	~ptr_deque();
+
+	// the owner only: move value in at the bottom (leaving it empty), false
+	// if it's full
+	bool push(T& value);
+
+	// the owner only: move the newest item out into value, false if there
+	// isn't one
+	bool pop(T& value);
+
+	// anyone: move the oldest item out into value, false if there isn't one
+	// or another thread got it first
+	bool steal(T& value);
+
+	// how many it can hold, and roughly how many it's holding now
+	size_t capacity() const;
+	size_t size() const;
+
+private:
+
+	// not copyable
+	ptr_deque(const ptr_deque&);
+	ptr_deque& operator=(const ptr_deque&);
+
+	// items are copied in and out a word at a time, so a thief reading a slot
+	// the owner is reusing gets nonsense rather than undefined behaviour (and
+	// then finds it lost the race)
+	enum { words = (sizeof(T) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t) };
+	struct slot
+	{
+		std::atomic<uintptr_t> _words[words];
+	};
+
+	void put(int64_t i, T& value);
+	void take(int64_t i, T& value);
+
+	// data
+	slot*                            _slots;
+	const size_t                     _mask;
+	alignas(64) std::atomic<int64_t> _top;    // where thieves steal from
+	alignas(64) std::atomic<int64_t> _bottom; // where the owner pushes
+
+};
+
+
+
+#define __ptr_queue_inl_include__
+#include "ptr_queue.inl"
+#undef __ptr_queue_inl_include__
+
+
+
+#endif // __ptr_queue_h__
@@ -0,0 +1,290 @@
+#if !defined(__ptr_queue_inl_include__)
+#error "ptr_queue.inl may only be included from ptr_queue.h"
+#endif // !defined(__ptr_queue_inl_include__)
+
+
+
+#ifndef __ptr_queue_inl__
+#define __ptr_queue_inl__
+
+
+
+#include <cstring>
+#include <new>
+
+#include "ptr_vector.h"
+
+
+
+// a power of two, at least two
+inline size_t ptr_queue_capacity(size_t capacity)
+{
+	size_t n = 2;
+	while ( n < capacity )
+	{
+		n *= 2;
+	}
+	return n;
+}
+
+
+
+//
+// ptr_queue<>
+//
+// A slot's sequence number is its position when it's free to push to, and
+// one past that once it's full, so a pusher at position p waits for p and a
+// popper for p + 1.  Popping hands the slot on to whoever pushes a lap later.
+//
+template <typename T>
+inline ptr_queue<T>::ptr_queue(size_t capacity) : _cells(0), _mask(ptr_queue_capacity(capacity) - 1), _push(0), _pop(0)
+{
+	_cells = new cell[_mask + 1];
+	for ( size_t i = 0; i <= _mask; ++i )
+	{
+		_cells[i]._sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+template <typename T>
+inline ptr_queue<T>::~ptr_queue()
+{
+	T value;
+	while ( pop(value) )
+	{
+		// let it go
+	}
+	delete[] _cells;
+}
+
+template <typename T>
+inline bool ptr_queue<T>::push(T& value)
+{
+	size_t position = _push.load(std::memory_order_relaxed);
+	cell*  c;
+	for ( ;; )
+	{
+		c = &_cells[position & _mask];
+		const intptr_t behind = intptr_t(c->_sequence.load(std::memory_order_acquire)) - intptr_t(position);
+		if ( behind == 0 )
+		{
+			if ( _push.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+			{
+				break;
+			}
+		}
+		else if ( behind < 0 )
+		{
+			// still holding what was pushed a lap ago
+			return false;
+		}
+		else
+		{
+			position = _push.load(std::memory_order_relaxed);
+		}
+	}
+
+	// the handle's bytes move over, and what's left behind is an empty one
+	ptr_relocate(reinterpret_cast<T*>(c->_storage), &value, 1);
+	new (&value) T();
+	c->_sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+inline bool ptr_queue<T>::pop(T& value)
+{
+	size_t position = _pop.load(std::memory_order_relaxed);
+	cell*  c;
+	for ( ;; )
+	{
+		c = &_cells[position & _mask];
+		const intptr_t behind = intptr_t(c->_sequence.load(std::memory_order_acquire)) - intptr_t(position + 1);
+		if ( behind == 0 )
+		{
+			if ( _pop.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+			{
+				break;
+			}
+		}
+		else if ( behind < 0 )
+		{
+			// nothing's been pushed here yet
+			return false;
+		}
+		else
+		{
+			position = _pop.load(std::memory_order_relaxed);
+		}
+	}
+
+	value.~T();
+	ptr_relocate(&value, reinterpret_cast<T*>(c->_storage), 1);
+	c->_sequence.store(position + _mask + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+inline size_t ptr_queue<T>::capacity() const
+{
+	return _mask + 1;
+}
+
+template <typename T>
+inline size_t ptr_queue<T>::size() const
+{
+	const size_t popped = _pop.load(std::memory_order_relaxed);
+	const size_t pushed = _push.load(std::memory_order_relaxed);
+	return pushed > popped ? pushed - popped : 0;
+}
+
+
+
+//
+// ptr_deque<>
+//
+// After Chase and Lev, in the form Le et al. gave for C11 atomics, but bounded.
+// The owner's pop takes the item before it knows whether a thief is after
+// the same one, and only when there's just the one left do they settle it by
+// racing to move the top.  Orderings are on the loads and stores themselves
+// rather than fences, which comes to the same instructions on x86 and keeps
+// ThreadSanitizer able to follow along.
+//
+template <typename T>
+inline ptr_deque<T>::ptr_deque(size_t capacity) : _slots(0), _mask(ptr_queue_capacity(capacity) - 1), _top(0), _bottom(0)
+{
+	static_assert(ptr_relocatable<T>::value, "ptr_deque<> only holds types that may be moved with memcpy()");
+	_slots = new slot[_mask + 1];
+}
+
+template <typename T>
+inline ptr_deque<T>::~ptr_deque()
+{
+	T value;
+	while ( pop(value) )
+	{
+		// let it go
+	}
+	delete[] _slots;
+}
+
+template <typename T>
+inline void ptr_deque<T>::put(int64_t i, T& value)
+{
+	uintptr_t bytes[words] = { 0 };
+	memcpy(static_cast<void*>(bytes), static_cast<const void*>(&value), sizeof(T));
+	new (&value) T();
+
+	slot& s = _slots[size_t(i) & _mask];
+	for ( int w = 0; w < words; ++w )
+	{
+		s._words[w].store(bytes[w], std::memory_order_relaxed);
+	}
+}
+
+template <typename T>
+inline void ptr_deque<T>::take(int64_t i, T& value)
+{
+	uintptr_t bytes[words];
+	slot&     s = _slots[size_t(i) & _mask];
+	for ( int w = 0; w < words; ++w )
+	{
+		bytes[w] = s._words[w].load(std::memory_order_relaxed);
+	}
+
+	value.~T();
+	memcpy(static_cast<void*>(&value), static_cast<const void*>(bytes), sizeof(T));
+}
+
+template <typename T>
+inline bool ptr_deque<T>::push(T& value)
+{
+	const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+	const int64_t top    = _top.load(std::memory_order_acquire);
+	if ( bottom - top > int64_t(_mask) )
+	{
+		return false;
+	}
+	put(bottom, value);
+	_bottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+inline bool ptr_deque<T>::pop(T& value)
+{
+	// claim the bottom item first, then see whether thieves have got to it
+	const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+	_bottom.store(bottom, std::memory_order_seq_cst);
+	int64_t top = _top.load(std::memory_order_seq_cst);
+
+	if ( top > bottom )
+	{
+		// it was empty
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if ( top < bottom )
+	{
+		// more than one left, no thief can reach this one
+		take(bottom, value);
+		return true;
+	}
+
+	// the last one, whoever moves the top gets it
+	const bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	if ( won )
+	{
+		take(bottom, value);
+	}
+	_bottom.store(bottom + 1, std::memory_order_relaxed);
+	return won;
+}
+
+template <typename T>
+inline bool ptr_deque<T>::steal(T& value)
+{
+	int64_t       top    = _top.load(std::memory_order_seq_cst);
+	const int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+	if ( top >= bottom )
+	{
+		return false;
+	}
+
+	// read it before claiming it, the owner may reuse the slot the moment
+	// the top moves past it
+	uintptr_t bytes[words];
+	slot&     s = _slots[size_t(top) & _mask];
+	for ( int w = 0; w < words; ++w )
+	{
+		bytes[w] = s._words[w].load(std::memory_order_relaxed);
+	}
+	if ( !_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+	{
+		// someone else got it, and what was read belongs to them
+		return false;
+	}
+
+	value.~T();
+	memcpy(static_cast<void*>(&value), static_cast<const void*>(bytes), sizeof(T));
+	return true;
+}
+
+template <typename T>
+inline size_t ptr_deque<T>::capacity() const
+{
+	return _mask + 1;
+}
+
+template <typename T>
+inline size_t ptr_deque<T>::size() const
+{
+	const int64_t top    = _top.load(std::memory_order_relaxed);
+	const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+	return bottom > top ? size_t(bottom - top) : 0;
+}
+
+
+
+#endif // __ptr_queue_inl__
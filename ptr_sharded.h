@@ -0,0 +1,120 @@
+#ifndef __ptr_sharded_h__
+#define __ptr_sharded_h__
+
+
+
+//
+//
+//
+// sharded reference counts for objects every thread keeps copying
+//
+//
+// ptr<>'s count isn't thread-safe, and making it atomic isn't enough for an
+// object that every request on every core takes a copy of (the current
+// routing table, say): all of those increments and decrements land on the
+// same cache line, which then spends its life bouncing between cores.
+//
+// A sharded_ptr<> spreads its count over one slot per thread (slots are
+// handed out to threads in turn, and shared once there are more threads than
+// slots), each on a cache line of its own, so copying one only ever touches
+// the copying thread's line:
+//
+//   sharded_ptr<RoutingTable> g_routes(new RoutingTable(...));
+//
+//   void handle(Request& r)
+//   {
+//     sharded_ptr<RoutingTable> routes = g_routes; // copy, no bouncing
+//     routes->lookup(r.destination);
+//   }
+//
+// The catch is that no single slot knows the whole count, so there's no way
+// to notice it reaching zero as it goes.  Instead nothing is deleted until
+// the object is retired: whoever owns the object (usually whoever owns the
+// global handle) calls retire() on their handle once no more copies will be
+// made of it from scratch.  That folds the slots into a single ordinary
+// (atomic) count and drops the handle, and from then on the object is
+// deleted as soon as the last copy goes, the same way a ptr<>'s would be:
+//
+//   sharded_ptr<RoutingTable> old = g_routes;   // (under whatever lock
+//   g_routes = sharded_ptr<RoutingTable>(next); //  guards g_routes)
+//   old.retire();                               // deleted once unused
+//
+// An object that's never retired is never deleted, even once every handle to
+// it is gone.  Copies of a retired object can still be made and dropped
+// safely (by threads that had a handle already), they just count on the
+// shared line again.  Retiring an object a second time only drops the handle.
+//
+// Copying and dropping different handles from different threads is
+// thread-safe, but as with std::shared_ptr<> a single handle isn't, so the
+// global one needs a lock (or to never change) if it's going to be assigned
+// to while others copy it.  Each object costs a cache line per slot, up to
+// one per hardware thread, so keep this for the few objects that need it.
+//
+//
+
+
+
+#include <atomic>
+#include <cstddef>
+
+#include <stdint.h>
+
+
+
+struct ptr_sharded_counter;
+
+template <typename T>
+class sharded_ptr
+{
+public:
+
+	// default constructor
+	sharded_ptr();
+
+	// copying construction and assignment
+	sharded_ptr(const sharded_ptr<T>& other);
+	sharded_ptr& operator=(const sharded_ptr<T>& other);
+
+	// take ownership of a normal pointer
+	explicit sharded_ptr(T* normal_ptr);
+
+	// destruction
+	~sharded_ptr();
+
+	// fold the count back together so the object may be deleted once the
+	// last handle is gone, and drop this one
+	void retire();
+
+	// comparison
+	bool operator==(const sharded_ptr<T>& other) const;
+	bool operator!=(const sharded_ptr<T>& other) const;
+
+	// use the pointer
+	T* operator->() const;
+	T& operator*() const;
+
+	// check whether pointer is valid
+	operator bool() const;
+	bool valid() const;
+
+private:
+
+	// these do the work of taking a pointer in, updating reference count, etc.
+	void grab(T* normal_ptr, ptr_sharded_counter* counter);
+	void drop();
+
+	// data
+	T*                   _ptr;
+	ptr_sharded_counter* _counter;
+
+};
+
+
+
+#define __ptr_sharded_inl_include__
+#include "ptr_sharded.inl"
+#undef __ptr_sharded_inl_include__
+
+
+
+#endif // __ptr_sharded_h__
@@ -0,0 +1,292 @@
+#if !defined(__ptr_sharded_inl_include__)
+#error "ptr_sharded.inl may only be included from ptr_sharded.h"
+#endif // !defined(__ptr_sharded_inl_include__)
+
+
+
+#ifndef __ptr_sharded_inl__
+#define __ptr_sharded_inl__
+
+
+
+#include <cassert>
+#include <thread>
+
+
+
+//
+// one thread's (or a few threads') part of the count, on a line of its own
+//
+// The count is kept biased by half the range, so a slot that has seen more
+// drops than copies doesn't borrow from the top bit, which marks a slot that
+// has been folded into the shared count.  Once folded the slot's value no
+// longer means anything, and everyone counts on the shared count instead.
+//
+struct alignas(64) ptr_shard
+{
+	static constexpr uint64_t folded = uint64_t(1) << 63;
+	static constexpr uint64_t bias   = uint64_t(1) << 61;
+
+	ptr_shard() : _value(bias) { /* empty */ };
+	std::atomic<uint64_t> _value;
+};
+
+
+
+//
+// which slot the current thread counts on
+//
+inline unsigned ptr_shard_count()
+{
+	// a power of two, at least as many as there are hardware threads
+	static const unsigned count = []
+	{
+		const unsigned hardware = std::thread::hardware_concurrency();
+		unsigned       n        = 1;
+		while ( n < hardware && n < 256 )
+		{
+			n *= 2;
+		}
+		return n;
+	}();
+	return count;
+}
+
+inline unsigned ptr_shard_index()
+{
+	static std::atomic<unsigned> next(0);
+	static thread_local unsigned index = next++;
+	return index & (ptr_shard_count() - 1);
+}
+
+
+
+//
+// the counter
+//
+struct ptr_sharded_counter
+{
+	// the shared count starts out well clear of zero, so nothing it picks up
+	// while slots are being folded into it can bring it down to zero early
+	static constexpr int64_t folding = int64_t(1) << 62;
+
+	ptr_sharded_counter() : _shards(new ptr_shard[ptr_shard_count()]), _shared(folding), _retired(false) { /* empty */ };
+	~ptr_sharded_counter() { delete[] _shards; }
+
+	void inc()
+	{
+		const uint64_t old = _shards[ptr_shard_index()]._value.fetch_add(1, std::memory_order_relaxed);
+		if ( old & ptr_shard::folded )
+		{
+			_shared.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	// true when that was the last reference (which can only happen once the
+	// object has been retired)
+	bool dec()
+	{
+		const uint64_t old = _shards[ptr_shard_index()]._value.fetch_sub(1, std::memory_order_release);
+		if ( old & ptr_shard::folded )
+		{
+			return _shared.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+		return false;
+	}
+
+	// move every slot's count over to the shared count, false if someone
+	// already has
+	bool fold()
+	{
+		if ( _retired.exchange(true, std::memory_order_acq_rel) )
+		{
+			return false;
+		}
+
+		// each slot's count up to the moment it's marked comes over with it,
+		// anything after that is counted on the shared count directly
+		const unsigned count = ptr_shard_count();
+		for ( unsigned i = 0; i < count; ++i )
+		{
+			const uint64_t old = _shards[i]._value.fetch_or(ptr_shard::folded, std::memory_order_acq_rel);
+			_shared.fetch_add(int64_t(old & ~ptr_shard::folded) - int64_t(ptr_shard::bias), std::memory_order_relaxed);
+		}
+
+		// the caller still holds a reference, so this can't reach zero
+		_shared.fetch_sub(folding, std::memory_order_acq_rel);
+		return true;
+	}
+
+	ptr_shard*           _shards;
+	std::atomic<int64_t> _shared;
+	std::atomic<bool>    _retired;
+
+private:
+
+	// not copyable
+	ptr_sharded_counter(const ptr_sharded_counter&);
+	ptr_sharded_counter& operator=(const ptr_sharded_counter&);
+};
+
+
+
+//
+// construction, copying and destruction
+//
+template <typename T>
+inline sharded_ptr<T>::sharded_ptr() : _ptr(0), _counter(0)
+{
+	// empty
+}
+
+template <typename T>
+inline sharded_ptr<T>::sharded_ptr(const sharded_ptr<T>& other) : _ptr(0), _counter(0)
+{
+	// defer to copy assignment operator
+	*this = other;
+}
+
+template <typename T>
+inline sharded_ptr<T>& sharded_ptr<T>::operator=(const sharded_ptr<T>& other)
+{
+	// make certain it's not trying to copy assign itself to itself
+	if ( this != &other )
+	{
+		grab(other._ptr, other._counter);
+	}
+
+	// send back a reference to this object
+	return *this;
+}
+
+template <typename T>
+inline sharded_ptr<T>::sharded_ptr(T* normal_ptr) : _ptr(0), _counter(0)
+{
+	grab(normal_ptr, 0);
+}
+
+template <typename T>
+inline sharded_ptr<T>::~sharded_ptr()
+{
+	// decrement count and possibly release pointer
+	drop();
+}
+
+
+
+//
+// retirement
+//
+template <typename T>
+inline void sharded_ptr<T>::retire()
+{
+	if ( valid() )
+	{
+		_counter->fold();
+		drop();
+	}
+}
+
+
+
+//
+// take a pointer as ours and increment reference count
+//
+template <typename T>
+inline void sharded_ptr<T>::grab(T* normal_ptr, ptr_sharded_counter* counter)
+{
+	// drop any pointer+counter we may already have
+	drop();
+
+	// if the pointer is 0, we're finished
+	if ( !normal_ptr )
+	{
+		return;
+	}
+
+	// copy pointer, copy or create a new counter, and count ourselves
+	_ptr     = normal_ptr;
+	_counter = counter ? counter : new ptr_sharded_counter;
+	_counter->inc();
+}
+
+
+
+//
+// reset our pointer and counter to zero and decrement reference count
+// and, possibly, delete the pointer (only ever once it has been retired)
+//
+template <typename T>
+inline void sharded_ptr<T>::drop()
+{
+	if ( valid() )
+	{
+		if ( _counter->dec() )
+		{
+			// this was the last reference
+			delete _ptr;
+			delete _counter;
+		}
+
+		// now reset ("drop") the pointer and the counter
+		_ptr     = 0;
+		_counter = 0;
+	}
+}
+
+
+
+//
+// comparison
+//
+template <typename T>
+inline bool sharded_ptr<T>::operator==(const sharded_ptr<T>& other) const
+{
+	return _ptr == other._ptr;
+}
+
+template <typename T>
+inline bool sharded_ptr<T>::operator!=(const sharded_ptr<T>& other) const
+{
+	return _ptr != other._ptr;
+}
+
+
+
+//
+// use the pointer
+//
+template <typename T>
+inline T* sharded_ptr<T>::operator->() const
+{
+	assert(valid());
+	return _ptr;
+}
+
+template <typename T>
+inline T& sharded_ptr<T>::operator*() const
+{
+	assert(valid());
+	return *_ptr;
+}
+
+
+
+//
+// validity
+//
+template <typename T>
+inline sharded_ptr<T>::operator bool() const
+{
+	return valid();
+}
+
+template <typename T>
+inline bool sharded_ptr<T>::valid() const
+{
+	return _ptr != 0;
+}
+
+
+
+#endif // __ptr_sharded_inl__
@@ -0,0 +1,85 @@
+#ifndef __ptr_shm_h__
+#define __ptr_shm_h__
+
+
+
+//
+//
+//
+// array_ptr<>s in POSIX shared memory, shared between processes
+//
+//
+// Handing a big buffer from one process to another through a pipe or socket
+// copies it twice, once into the kernel and once back out.  Putting it in a
+// named shared memory segment instead lets every process map the very same
+// pages:
+//
+//   // producer
+//   array_ptr<Sample> out = make_shm_array<Sample>("/frames.42", n);
+//   fill(out);
+//   tell_consumer("/frames.42");
+//
+//   // consumer, in some other process
+//   array_ptr<Sample> in = open_shm_array<Sample>("/frames.42");
+//   if ( in )
+//   {
+//     for ( size_t i = 0; i < in.size(); ++i )
+//       ...
+//   }
+//
+// Each process has its own array_ptr<> references as usual, and the segment
+// itself keeps an (atomic) count of how many processes hold any.  When the
+// last reference in the last process goes away the segment is unlinked, and
+// its memory goes back to the system once everyone has unmapped it.  Opening
+// a segment that's already on its way out fails, just as if it were gone.
+//
+// make_shm_array<>() fails (returns an invalid array_ptr<>) if there's already
+// a segment by that name, and open_shm_array<>() if there isn't one, if it
+// wasn't made for elements of the same size or if its creator hasn't finished
+// making it yet.  Names follow shm_open()'s rules, a leading '/' and no others.
+//
+// Some things to keep in mind:
+//
+//   - X must be trivially copyable, the elements are value-initialized once by
+//     their creator and never destroyed.  Pointers in them won't mean the same
+//     thing in another process, the segment may be mapped at another address.
+//   - The segment's count goes up once per process (per open), not per
+//     array_ptr<> reference, those are still counted locally and aren't
+//     thread-safe.
+//   - A process that dies holding a reference never gives it back, and the
+//     segment stays around until someone shm_unlink()s it by hand.
+//   - References don't survive fork(), the child gets copies of the parent's
+//     but the segment only counted the parent once.  Open the segment again
+//     by name in the child instead (and leave the inherited ones alone).
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+//
+// create a new segment holding n value-initialized elements
+//
+template <typename X>
+array_ptr<X> make_shm_array(const char* name, size_t n);
+
+//
+// map an existing segment
+//
+template <typename X>
+array_ptr<X> open_shm_array(const char* name);
+
+
+
+#define __ptr_shm_inl_include__
+#include "ptr_shm.inl"
+#undef __ptr_shm_inl_include__
+
+
+
+#endif // __ptr_shm_h__
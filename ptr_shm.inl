@@ -0,0 +1,196 @@
+#if !defined(__ptr_shm_inl_include__)
+#error "ptr_shm.inl may only be included from ptr_shm.h"
+#endif // !defined(__ptr_shm_inl_include__)
+
+
+
+#ifndef __ptr_shm_inl__
+#define __ptr_shm_inl__
+
+
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+//
+// the start of every segment, the elements follow on the next cache line
+//
+struct ptr_shm_header
+{
+	std::atomic<uint64_t> _processes;
+	uint64_t              _length;
+	uint64_t              _element_size;
+	std::atomic<uint64_t> _magic;
+};
+
+enum { ptr_shm_header_bytes = 64 };
+
+const uint64_t ptr_shm_magic = 0x70747273686d3031ull; // "ptrshm01"
+
+static_assert(sizeof(ptr_shm_header) <= ptr_shm_header_bytes, "ptr_shm_header has outgrown its cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory counts need lock free 64-bit atomics");
+
+
+
+//
+// where the elements start, worked out as an address so the compiler doesn't
+// go warning about delete[]ing an offset pointer on paths we never take
+//
+template <typename X>
+inline X* ptr_shm_elements(char* base)
+{
+	return reinterpret_cast<X*>(reinterpret_cast<uintptr_t>(base) + ptr_shm_header_bytes);
+}
+
+
+
+//
+// a control block that remembers the mapping and the segment's name, which we
+// need to unlink it
+//
+struct ptr_shm_counter : public ptr_counter
+{
+	ptr_shm_counter(size_t length, size_t bytes, const char* name, release_func release) : ptr_counter(length, release), _bytes(bytes), _name(name) { /* empty */ };
+	size_t      _bytes;
+	std::string _name;
+};
+
+inline void ptr_shm_release(void* normal_ptr, ptr_counter* counter)
+{
+	ptr_shm_counter* segment = static_cast<ptr_shm_counter*>(counter);
+	char*            base    = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(normal_ptr) - ptr_shm_header_bytes);
+	ptr_shm_header*  header  = reinterpret_cast<ptr_shm_header*>(base);
+
+	// last process out turns off the lights
+	if ( header->_processes.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+	{
+		shm_unlink(segment->_name.c_str());
+	}
+
+	munmap(base, segment->_bytes);
+	delete segment;
+}
+
+
+
+//
+// mapping a segment (shared, read/write) by its descriptor
+//
+inline char* ptr_shm_map(int fd, size_t bytes)
+{
+	void* mem = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	// the mapping keeps its own reference to the segment
+	close(fd);
+
+	return mem != MAP_FAILED ? static_cast<char*>(mem) : 0;
+}
+
+
+
+//
+// the factories
+//
+template <typename X>
+inline array_ptr<X> make_shm_array(const char* name, size_t n)
+{
+	static_assert(std::is_trivially_copyable<X>::value, "make_shm_array<X>() needs a trivially copyable X");
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if ( fd < 0 )
+	{
+		return array_ptr<X>();
+	}
+
+	const size_t bytes = ptr_shm_header_bytes + n * sizeof(X);
+	if ( ftruncate(fd, off_t(bytes)) != 0 )
+	{
+		close(fd);
+		shm_unlink(name);
+		return array_ptr<X>();
+	}
+
+	char* base = ptr_shm_map(fd, bytes);
+	if ( !base )
+	{
+		shm_unlink(name);
+		return array_ptr<X>();
+	}
+
+	ptr_shm_header* header = new(base) ptr_shm_header;
+	header->_processes.store(1, std::memory_order_relaxed);
+	header->_length       = n;
+	header->_element_size = sizeof(X);
+
+	X* p = ptr_shm_elements<X>(base);
+	for ( size_t i = 0; i < n; ++i )
+	{
+		new(p + i) X();
+	}
+
+	// only now may anyone else open it
+	header->_magic.store(ptr_shm_magic, std::memory_order_release);
+
+	return array_ptr<X>(p, new ptr_shm_counter(n, bytes, name, ptr_shm_release));
+}
+
+template <typename X>
+inline array_ptr<X> open_shm_array(const char* name)
+{
+	static_assert(std::is_trivially_copyable<X>::value, "open_shm_array<X>() needs a trivially copyable X");
+
+	int fd = shm_open(name, O_RDWR, 0);
+	if ( fd < 0 )
+	{
+		return array_ptr<X>();
+	}
+
+	// (a segment whose creator hasn't even sized it yet is too small)
+	struct stat info;
+	if ( fstat(fd, &info) != 0 || size_t(info.st_size) < ptr_shm_header_bytes )
+	{
+		close(fd);
+		return array_ptr<X>();
+	}
+
+	const size_t bytes = size_t(info.st_size);
+	char*        base  = ptr_shm_map(fd, bytes);
+	if ( !base )
+	{
+		return array_ptr<X>();
+	}
+
+	ptr_shm_header* header = reinterpret_cast<ptr_shm_header*>(base);
+	const bool      usable = header->_magic.load(std::memory_order_acquire) == ptr_shm_magic &&
+	                         header->_element_size == sizeof(X) &&
+	                         header->_length <= (bytes - ptr_shm_header_bytes) / sizeof(X);
+
+	// join in, but only while someone else is still holding on to it
+	uint64_t processes = usable ? header->_processes.load(std::memory_order_relaxed) : 0;
+	while ( processes && !header->_processes.compare_exchange_weak(processes, processes + 1, std::memory_order_acq_rel) )
+	{
+		// processes has been reloaded, try again
+	}
+	if ( !processes )
+	{
+		munmap(base, bytes);
+		return array_ptr<X>();
+	}
+
+	const size_t n = size_t(header->_length);
+	return array_ptr<X>(ptr_shm_elements<X>(base), new ptr_shm_counter(n, bytes, name, ptr_shm_release));
+}
+
+
+
+#endif // __ptr_shm_inl__
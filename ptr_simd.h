@@ -0,0 +1,138 @@
+#ifndef __ptr_simd_h__
+#define __ptr_simd_h__
+
+
+
+//
+//
+//
+// SIMD bulk operations over array_ptr<> contents
+//
+//
+// Looping over an array_ptr<> with operator[] is easy, but every access goes
+// through an assert() in debug builds, and in release builds you're at the
+// mercy of the auto-vectorizer (which gives up on reductions over floats
+// altogether).  These do the common loops for arithmetic element types with
+// explicit 64-byte vectors, compiled three times -- SSE2, AVX2 and AVX-512 --
+// and picked at runtime for the CPU we're actually running on:
+//
+//   array_ptr<float> a = make_aligned_array<float, 64>(n);
+//
+//   array_fill(a, 1.0f);                       // every element = 1
+//   float total = array_sum(a);                // n
+//   float lo    = array_min(a);                // 1
+//   size_t i    = array_find(a, 2.0f);         // a.size(), not found
+//   array_transform(a, a, [](float x) { return x * 2.0f; });
+//
+// They all work on the whole array, as given by size(), so the array has to
+// come from one of the sizing factories (make_numa_array<>(),
+// make_aligned_array<>(), ...).  An array_ptr<> of unknown size is treated as
+// empty.  What's only read may be read-only, an array_ptr<const T> (say
+// from map_file()) can be searched, summed, compared and copied or
+// transformed from, just not written to.
+//
+// A few things differ from the obvious scalar loop:
+//
+//   - array_sum() keeps many partial sums in parallel, so a floating point
+//     total may differ from a left-to-right sum in the last few bits.
+//   - array_min()/array_max() on floating point data containing NaNs return
+//     an unspecified one of the elements.
+//   - array_transform() calls op one element at a time, but in fixed blocks
+//     of 64 bytes, which the compiler turns into vector code whenever op is
+//     simple enough (arithmetic, comparisons, min/max and the like).
+//
+// Element types are the arithmetic types other than bool and long double.
+// This leans on GCC's vector extensions (Clang has them too).  On anything
+// other than x86-64 there's a single version, built for the compiler's own
+// target.
+//
+//
+
+
+
+#include <cstddef>
+#include <type_traits>
+
+#include "ptr.h"
+
+
+
+//
+// the instruction set the kernels were dispatched to on this machine
+//
+enum simd_isa
+{
+	simd_generic,
+	simd_sse2,
+	simd_avx2,
+	simd_avx512
+};
+
+simd_isa array_simd_isa();
+
+//
+// the element type of an array that's only read, whether or not it's const
+//
+template <typename T>
+struct ptr_simd_element
+{
+	typedef typename std::remove_const<T>::type type;
+};
+
+
+
+//
+// every element = value
+//
+template <typename T>
+void array_fill(const array_ptr<T>& a, T value);
+
+//
+// copy all of src into the start of dest, which must be at least as big
+//
+template <typename T, typename S>
+void array_copy(const array_ptr<T>& dest, const array_ptr<S>& src);
+
+//
+// same size and same elements
+//
+template <typename A, typename B>
+bool array_equal(const array_ptr<A>& a, const array_ptr<B>& b);
+
+//
+// index of the first element equal to value, a.size() if there isn't one
+//
+template <typename T>
+size_t array_find(const array_ptr<T>& a, typename ptr_simd_element<T>::type value);
+
+//
+// smallest and largest elements, a must not be empty
+//
+template <typename T>
+typename ptr_simd_element<T>::type array_min(const array_ptr<T>& a);
+
+template <typename T>
+typename ptr_simd_element<T>::type array_max(const array_ptr<T>& a);
+
+//
+// sum of all elements (0 when empty), accumulated in T
+//
+template <typename T>
+typename ptr_simd_element<T>::type array_sum(const array_ptr<T>& a);
+
+//
+// dest[i] = op(src[i]) for all of src, dest must be at least as big (and may
+// be src itself)
+//
+template <typename T, typename S, typename Op>
+void array_transform(const array_ptr<T>& dest, const array_ptr<S>& src, Op op);
+
+
+
+#define __ptr_simd_inl_include__
+#include "ptr_simd.inl"
+#undef __ptr_simd_inl_include__
+
+
+
+#endif // __ptr_simd_h__
@@ -0,0 +1,469 @@
+#if !defined(__ptr_simd_inl_include__)
+#error "ptr_simd.inl may only be included from ptr_simd.h"
+#endif // !defined(__ptr_simd_inl_include__)
+
+
+
+#ifndef __ptr_simd_inl__
+#define __ptr_simd_inl__
+
+
+
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+
+#include <stdint.h>
+
+
+
+#if defined(__x86_64__)
+#define PTR_SIMD_X86
+#endif // defined(__x86_64__)
+
+#define PTR_SIMD_INLINE inline __attribute__((always_inline))
+
+
+
+//
+// one 64-byte vector of T: a single AVX-512 register, two AVX2 or four SSE2
+// ones, the compiler splits it up to suit whichever target it's building for
+//
+template <typename T>
+struct ptr_simd_vector
+{
+	static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= 8,
+		"array kernels need an arithmetic element type (not bool or long double)");
+
+	typedef T vec __attribute__((vector_size(64)));
+	static const size_t lanes = 64 / sizeof(T);
+};
+
+// (vectors go in and out by reference, returning them by value outside an
+// AVX-512 function would change the ABI)
+template <typename V, typename T>
+PTR_SIMD_INLINE void ptr_simd_load(V& v, const T* p)
+{
+	memcpy(&v, p, sizeof(V));
+}
+
+template <typename T, typename V>
+PTR_SIMD_INLINE void ptr_simd_store(T* p, const V& v)
+{
+	memcpy(p, &v, sizeof(V));
+}
+
+template <typename V, typename T>
+PTR_SIMD_INLINE void ptr_simd_broadcast(V& v, T value)
+{
+	for ( size_t j = 0; j < sizeof(V) / sizeof(T); ++j )
+	{
+		v[j] = value;
+	}
+}
+
+// is any lane of a comparison result set?
+template <typename M>
+PTR_SIMD_INLINE bool ptr_simd_any(const M& mask)
+{
+	uint64_t words[sizeof(M) / sizeof(uint64_t)];
+	memcpy(words, &mask, sizeof(M));
+
+	uint64_t any = 0;
+	for ( size_t j = 0; j < sizeof(M) / sizeof(uint64_t); ++j )
+	{
+		any |= words[j];
+	}
+	return any != 0;
+}
+
+
+
+//
+// the kernels, each one is compiled once per instruction set by ptr_simd_run()
+//
+template <typename T>
+struct ptr_simd_fill
+{
+	PTR_SIMD_INLINE void run()
+	{
+		typedef typename ptr_simd_vector<T>::vec V;
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		V v;
+		ptr_simd_broadcast(v, value);
+
+		size_t i = 0;
+		for ( ; i + L <= n; i += L )
+		{
+			ptr_simd_store(p + i, v);
+		}
+		for ( ; i < n; ++i )
+		{
+			p[i] = value;
+		}
+	}
+
+	T*     p;
+	size_t n;
+	T      value;
+};
+
+template <typename T>
+struct ptr_simd_equal
+{
+	PTR_SIMD_INLINE void run()
+	{
+		typedef typename ptr_simd_vector<T>::vec V;
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		result = false;
+		size_t i = 0;
+		for ( ; i + L <= n; i += L )
+		{
+			V x, y;
+			ptr_simd_load(x, a + i);
+			ptr_simd_load(y, b + i);
+			if ( ptr_simd_any(x != y) )
+			{
+				return;
+			}
+		}
+		for ( ; i < n; ++i )
+		{
+			if ( a[i] != b[i] )
+			{
+				return;
+			}
+		}
+		result = true;
+	}
+
+	const T* a;
+	const T* b;
+	size_t   n;
+	bool     result;
+};
+
+template <typename T>
+struct ptr_simd_find
+{
+	PTR_SIMD_INLINE void run()
+	{
+		typedef typename ptr_simd_vector<T>::vec V;
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		V v;
+		ptr_simd_broadcast(v, value);
+
+		size_t i = 0;
+		for ( ; i + L <= n; i += L )
+		{
+			V x;
+			ptr_simd_load(x, p + i);
+			if ( ptr_simd_any(x == v) )
+			{
+				// it's in this block somewhere
+				break;
+			}
+		}
+		for ( ; i < n; ++i )
+		{
+			if ( p[i] == value )
+			{
+				break;
+			}
+		}
+		result = i;
+	}
+
+	const T* p;
+	size_t   n;
+	T        value;
+	size_t   result;
+};
+
+template <typename T, bool Max>
+struct ptr_simd_extreme
+{
+	PTR_SIMD_INLINE void run()
+	{
+		typedef typename ptr_simd_vector<T>::vec V;
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		size_t i = 0;
+		result   = p[0];
+		if ( n >= L )
+		{
+			V best;
+			ptr_simd_load(best, p);
+			for ( i = L; i + L <= n; i += L )
+			{
+				V x;
+				ptr_simd_load(x, p + i);
+				best = (Max ? x > best : x < best) ? x : best;
+			}
+			for ( size_t j = 0; j < L; ++j )
+			{
+				result = (Max ? best[j] > result : best[j] < result) ? best[j] : result;
+			}
+		}
+		for ( ; i < n; ++i )
+		{
+			result = (Max ? p[i] > result : p[i] < result) ? p[i] : result;
+		}
+	}
+
+	const T* p;
+	size_t   n;
+	T        result;
+};
+
+template <typename T>
+struct ptr_simd_sum
+{
+	PTR_SIMD_INLINE void run()
+	{
+		typedef typename ptr_simd_vector<T>::vec V;
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		// two independent chains, so we're not waiting on the adder
+		V sum0, sum1, x, y;
+		ptr_simd_broadcast(sum0, T(0));
+		ptr_simd_broadcast(sum1, T(0));
+
+		size_t i = 0;
+		for ( ; i + 2 * L <= n; i += 2 * L )
+		{
+			ptr_simd_load(x, p + i);
+			ptr_simd_load(y, p + i + L);
+			sum0 += x;
+			sum1 += y;
+		}
+		for ( ; i + L <= n; i += L )
+		{
+			ptr_simd_load(x, p + i);
+			sum0 += x;
+		}
+		sum0 += sum1;
+
+		result = T(0);
+		for ( size_t j = 0; j < L; ++j )
+		{
+			result += sum0[j];
+		}
+		for ( ; i < n; ++i )
+		{
+			result += p[i];
+		}
+	}
+
+	const T* p;
+	size_t   n;
+	T        result;
+};
+
+template <typename T, typename Op>
+struct ptr_simd_transform
+{
+	PTR_SIMD_INLINE void run()
+	{
+		const size_t L = ptr_simd_vector<T>::lanes;
+
+		// fixed size blocks, for the vectorizer's benefit
+		size_t i = 0;
+		for ( ; i + L <= n; i += L )
+		{
+			for ( size_t j = 0; j < L; ++j )
+			{
+				dest[i + j] = op(src[i + j]);
+			}
+		}
+		for ( ; i < n; ++i )
+		{
+			dest[i] = op(src[i]);
+		}
+	}
+
+	T*       dest;
+	const T* src;
+	size_t   n;
+	Op       op;
+};
+
+
+
+//
+// dispatch
+//
+inline simd_isa ptr_simd_detect()
+{
+#if defined(PTR_SIMD_X86)
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") )
+	{
+		return simd_avx512;
+	}
+	if ( __builtin_cpu_supports("avx2") )
+	{
+		return simd_avx2;
+	}
+	return simd_sse2;
+#else
+	return simd_generic;
+#endif // defined(PTR_SIMD_X86)
+}
+
+inline simd_isa array_simd_isa()
+{
+	static const simd_isa isa = ptr_simd_detect();
+	return isa;
+}
+
+#if defined(PTR_SIMD_X86)
+
+template <typename K>
+__attribute__((target("avx512f,avx512bw"))) void ptr_simd_run_avx512(K& kernel)
+{
+	kernel.run();
+}
+
+template <typename K>
+__attribute__((target("avx2"))) void ptr_simd_run_avx2(K& kernel)
+{
+	kernel.run();
+}
+
+template <typename K>
+void ptr_simd_run_sse2(K& kernel)
+{
+	// SSE2 is the x86-64 baseline
+	kernel.run();
+}
+
+#endif // defined(PTR_SIMD_X86)
+
+template <typename K>
+inline void ptr_simd_run(K& kernel)
+{
+#if defined(PTR_SIMD_X86)
+	switch ( array_simd_isa() )
+	{
+		case simd_avx512: ptr_simd_run_avx512(kernel); break;
+		case simd_avx2:   ptr_simd_run_avx2(kernel);   break;
+		default:          ptr_simd_run_sse2(kernel);   break;
+	}
+#else
+	kernel.run();
+#endif // defined(PTR_SIMD_X86)
+}
+
+
+
+//
+// raw access to the elements, without an assert() per element
+//
+template <typename T>
+inline T* ptr_simd_data(const array_ptr<T>& a)
+{
+	return a.size() ? a.operator->() : 0;
+}
+
+
+
+//
+// the public face of it all
+//
+template <typename T>
+inline void array_fill(const array_ptr<T>& a, T value)
+{
+	ptr_simd_fill<T> kernel = { ptr_simd_data(a), a.size(), value };
+	ptr_simd_run(kernel);
+}
+
+template <typename T, typename S>
+inline void array_copy(const array_ptr<T>& dest, const array_ptr<S>& src)
+{
+	static_assert(std::is_same<T, typename ptr_simd_element<S>::type>::value, "copying needs the same element type on both sides");
+	assert(dest.size() >= src.size());
+
+	// libc already picks the best copy loop for this machine
+	if ( src.size() )
+	{
+		memmove(ptr_simd_data(dest), ptr_simd_data(src), src.size() * sizeof(T));
+	}
+}
+
+template <typename A, typename B>
+inline bool array_equal(const array_ptr<A>& a, const array_ptr<B>& b)
+{
+	typedef typename ptr_simd_element<A>::type T;
+	static_assert(std::is_same<T, typename ptr_simd_element<B>::type>::value, "comparing needs the same element type on both sides");
+
+	if ( a.size() != b.size() )
+	{
+		return false;
+	}
+
+	ptr_simd_equal<T> kernel = { ptr_simd_data(a), ptr_simd_data(b), a.size(), false };
+	ptr_simd_run(kernel);
+	return kernel.result;
+}
+
+template <typename T>
+inline size_t array_find(const array_ptr<T>& a, typename ptr_simd_element<T>::type value)
+{
+	ptr_simd_find<typename ptr_simd_element<T>::type> kernel = { ptr_simd_data(a), a.size(), value, 0 };
+	ptr_simd_run(kernel);
+	return kernel.result;
+}
+
+template <typename T>
+inline typename ptr_simd_element<T>::type array_min(const array_ptr<T>& a)
+{
+	typedef typename ptr_simd_element<T>::type E;
+	assert(a.size());
+
+	ptr_simd_extreme<E, false> kernel = { ptr_simd_data(a), a.size(), E(0) };
+	ptr_simd_run(kernel);
+	return kernel.result;
+}
+
+template <typename T>
+inline typename ptr_simd_element<T>::type array_max(const array_ptr<T>& a)
+{
+	typedef typename ptr_simd_element<T>::type E;
+	assert(a.size());
+
+	ptr_simd_extreme<E, true> kernel = { ptr_simd_data(a), a.size(), E(0) };
+	ptr_simd_run(kernel);
+	return kernel.result;
+}
+
+template <typename T>
+inline typename ptr_simd_element<T>::type array_sum(const array_ptr<T>& a)
+{
+	typedef typename ptr_simd_element<T>::type E;
+
+	ptr_simd_sum<E> kernel = { ptr_simd_data(a), a.size(), E(0) };
+	ptr_simd_run(kernel);
+	return kernel.result;
+}
+
+template <typename T, typename S, typename Op>
+inline void array_transform(const array_ptr<T>& dest, const array_ptr<S>& src, Op op)
+{
+	static_assert(std::is_same<T, typename ptr_simd_element<S>::type>::value, "transforming needs the same element type on both sides");
+	assert(dest.size() >= src.size());
+
+	ptr_simd_transform<T, Op> kernel = { ptr_simd_data(dest), ptr_simd_data(src), src.size(), op };
+	ptr_simd_run(kernel);
+}
+
+
+
+#undef PTR_SIMD_INLINE
+
+
+
+#endif // __ptr_simd_inl__
@@ -0,0 +1,245 @@
+#ifndef __ptr_snapshot_h__
+#define __ptr_snapshot_h__
+
+
+
+//
+//
+//
+// binary snapshots of ptr<> object graphs
+//
+//
+// Writing out a structure held together by ptr<>s field by field is easy
+// enough, until two of them point at the same object: it gets written twice,
+// and comes back as two objects.  A ptr_writer writes each object the first
+// time it's reached and only a reference to it after that, and a ptr_reader
+// hands every later reference the same (counted) object back, so whatever
+// was shared before is shared again afterward:
+//
+//   struct Node
+//   {
+//     int               id;
+//     ptr<Node>         left, right;
+//     array_ptr<double> weights;
+//   };
+//
+//   // say how to write and read one (found by argument dependent lookup)
+//   void ptr_snapshot(ptr_writer& w, const Node& n)
+//   {
+//     w.write(n.id);
+//     w.write(n.left);
+//     w.write(n.right);
+//     w.write(n.weights);
+//   }
+//
+//   void ptr_restore(ptr_reader& r, Node& n)
+//   {
+//     r.read(n.id);
+//     r.read(n.left);
+//     r.read(n.right);
+//     r.read(n.weights);
+//   }
+//
+//   std::ofstream out("graph.bin", std::ios::binary);
+//   ptr_writer w(out);
+//   w.write(root);
+//
+//   std::ifstream in("graph.bin", std::ios::binary);
+//   ptr_reader r(in);
+//   ptr<Node> copy;
+//   r.read(copy);
+//   if ( !r.good() )
+//     ...
+//
+// Trivially copyable types need no ptr_snapshot()/ptr_restore() of their own,
+// they're written as they are, and an array_ptr<> of them is written (and
+// read back) in a single call, straight from and into the array.  Other
+// types are written one field at a time by their ptr_snapshot(), and are
+// default constructed and then filled in by their ptr_restore(), so they
+// need a default constructor.  An object is registered before its fields are
+// read, so structures that point back at themselves come back that way too
+// (though, as ever, a ptr<> cycle is never deleted).  Writing and reading
+// recurse through the graph, so a long chain (a million node linked list,
+// say) needs a deep stack; an array_ptr<> of the nodes doesn't.
+//
+// Identity is the object's control block (or its address, for immortal
+// pointers, which have none), so with multiple inheritance a ptr<Derived>
+// and a ptr<Base2> to the same object are still one object, even though
+// they hold different addresses.  A reference can be read back as a public
+// base of what the object was first written as and comes back pointing at
+// that part of it, sharing its counter.  array_ptr<>s need to know their size() (see the sizing factories,
+// make_uninitialized_array<>() and friends), one of unknown size can't be
+// written and puts the writer in a failed state.  Restored arrays always know
+// their size.  Everything comes back as ordinary counted new/new[] storage,
+// whichever factory it came from originally (immortal pointers included).
+//
+// Both ends buffer what goes through them, so nothing's certain to have
+// reached the stream until the writer is flush()ed (or destroyed), and the
+// reader may read past the end of the snapshot.  It seeks back to where the
+// snapshot ended when it's destroyed, if the stream can seek.
+//
+// Objects must otherwise be read back as the same type they were written
+// as, and in the same order.  Reading something back as another type fails
+// (good() turns false and you get null pointers).  The format is the
+// machine's own byte order and type sizes, it's meant for checkpoints, not
+// for swapping files between machines.
+//
+//
+
+
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ptr.h"
+
+
+
+//
+// writing a snapshot
+//
+class ptr_writer
+{
+public:
+
+	explicit ptr_writer(std::ostream& out);
+	~ptr_writer();
+
+	// raw bytes, and trivially copyable values
+	void write_bytes(const void* bytes, size_t length);
+
+	template <typename T>
+	void write(const T& value);
+
+	// pointers, each object is written only the first time it's seen
+	template <typename T>
+	void write(const ptr<T>& p);
+
+	template <typename X>
+	void write(const array_ptr<X>& a);
+
+	// send along everything written so far (otherwise done on destruction)
+	void flush();
+
+	// false once anything has gone wrong
+	bool good() const;
+
+	// number of distinct objects written so far
+	size_t objects() const;
+
+private:
+
+	// not copyable
+	ptr_writer(const ptr_writer&);
+	ptr_writer& operator=(const ptr_writer&);
+
+	// the tag in front of every pointer, true when the object is new
+	template <typename Handle>
+	bool write_identity(const Handle& h);
+	void put(const char* bytes, size_t length);
+
+	// data
+	std::ostream&                             _out;
+	std::unordered_map<const void*, uint64_t> _ids;
+	std::vector<char>                         _buffer;
+	size_t                                    _used;
+	bool                                      _failed;
+
+};
+
+
+
+//
+// reading one back
+//
+class ptr_reader
+{
+public:
+
+	explicit ptr_reader(std::istream& in);
+	~ptr_reader();
+
+	// raw bytes, and trivially copyable values
+	void read_bytes(void* bytes, size_t length);
+
+	template <typename T>
+	void read(T& value);
+
+	// pointers, later references to an object share the first one's
+	template <typename T>
+	void read(ptr<T>& p);
+
+	template <typename X>
+	void read(array_ptr<X>& a);
+
+	// false once anything has gone wrong
+	bool good() const;
+
+	// number of distinct objects read so far
+	size_t objects() const;
+
+private:
+
+	// not copyable
+	ptr_reader(const ptr_reader&);
+	ptr_reader& operator=(const ptr_reader&);
+
+	// a handle (ptr<T> or array_ptr<X>) to every object read so far, kept
+	// so later references can share its counter, and for a ptr<T> a way to
+	// find its bases (throw the T*, see what catches it)
+	struct object
+	{
+		alignas(void*) char   handle[2 * sizeof(void*)];
+		const std::type_info* type;
+		ptr_counter*          counter;
+		void                  (*destroy)(void* handle);
+		void                  (*raise)(const void* handle);
+	};
+
+	template <typename Handle>
+	static void destroy_handle(void* handle);
+
+	template <typename T>
+	static void raise_pointer(const void* handle);
+
+	// read the tag in front of a pointer, returns the object it refers back
+	// to (or 0 if it's null or new, new sets fresh)
+	const object* read_identity(bool& fresh);
+
+	// bytes left in the snapshot at most (UINT64_MAX if there's no knowing)
+	uint64_t remaining();
+
+	template <typename Handle>
+	bool read_reference(const object* seen, Handle& h);
+
+	template <typename T>
+	bool read_base(const object* seen, ptr<T>& p);
+
+	template <typename Handle>
+	void remember(const Handle& h);
+
+	// data
+	std::istream&       _in;
+	std::vector<object> _objects;
+	std::vector<char>   _buffer;
+	size_t              _begin;
+	size_t              _end;
+	bool                _failed;
+
+};
+
+
+
+#define __ptr_snapshot_inl_include__
+#include "ptr_snapshot.inl"
+#undef __ptr_snapshot_inl_include__
+
+
+
+#endif // __ptr_snapshot_h__
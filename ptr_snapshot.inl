@@ -0,0 +1,493 @@
+#if !defined(__ptr_snapshot_inl_include__)
+#error "ptr_snapshot.inl may only be included from ptr_snapshot.h"
+#endif // !defined(__ptr_snapshot_inl_include__)
+
+
+
+#ifndef __ptr_snapshot_inl__
+#define __ptr_snapshot_inl__
+
+
+
+#include <cstring>
+#include <new>
+#include <streambuf>
+#include <type_traits>
+
+
+
+//
+// what goes in front of every pointer
+//
+enum ptr_snapshot_tag
+{
+	ptr_snapshot_null,      // nothing follows
+	ptr_snapshot_reference, // the id of an object already written follows
+	ptr_snapshot_object     // a new object follows (its id is the next one)
+};
+
+// how much the reader and writer gather up before going to the stream
+enum { ptr_snapshot_buffer_bytes = 64 * 1024 };
+
+
+
+//
+// the default for trivially copyable types, their bytes as they are
+//
+template <typename T>
+inline void ptr_snapshot(ptr_writer& w, const T& value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "write a ptr_snapshot(ptr_writer&, const T&) for this type");
+	w.write_bytes(&value, sizeof(T));
+}
+
+template <typename T>
+inline void ptr_restore(ptr_reader& r, T& value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "write a ptr_restore(ptr_reader&, T&) for this type");
+	r.read_bytes(&value, sizeof(T));
+}
+
+
+
+//
+// writing
+//
+inline ptr_writer::ptr_writer(std::ostream& out) : _out(out), _buffer(ptr_snapshot_buffer_bytes), _used(0), _failed(false)
+{
+	// empty
+}
+
+inline ptr_writer::~ptr_writer()
+{
+	flush();
+}
+
+inline void ptr_writer::write_bytes(const void* bytes, size_t length)
+{
+	if ( _failed )
+	{
+		return;
+	}
+
+	// fields are gathered up here, a stream call for each of them costs more
+	// than the copy does
+	if ( _used + length <= _buffer.size() )
+	{
+		memcpy(&_buffer[_used], bytes, length);
+		_used += length;
+		return;
+	}
+
+	// anything big goes straight through
+	flush();
+	if ( length >= _buffer.size() / 2 )
+	{
+		put(static_cast<const char*>(bytes), length);
+	}
+	else
+	{
+		memcpy(&_buffer[0], bytes, length);
+		_used = length;
+	}
+}
+
+inline void ptr_writer::put(const char* bytes, size_t length)
+{
+	std::streambuf* buffer = _out.rdbuf();
+	if ( !_failed && length && (!buffer || buffer->sputn(bytes, std::streamsize(length)) != std::streamsize(length)) )
+	{
+		_out.setstate(std::ios::badbit);
+		_failed = true;
+	}
+}
+
+inline void ptr_writer::flush()
+{
+	put(&_buffer[0], _used);
+	_used = 0;
+}
+
+template <typename T>
+inline void ptr_writer::write(const T& value)
+{
+	ptr_snapshot(*this, value);
+}
+
+template <typename Handle>
+inline bool ptr_writer::write_identity(const Handle& h)
+{
+	if ( !h )
+	{
+		const uint8_t tag = ptr_snapshot_null;
+		write_bytes(&tag, sizeof(tag));
+		return false;
+	}
+
+	// the control block, handles of different types to one object can hold
+	// different addresses (a base that isn't the first one, say) but they
+	// share that
+	const void* identity = ptr_counted(h.counter()) ? static_cast<const void*>(h.counter()) : static_cast<const void*>(h.operator->());
+
+	std::pair<std::unordered_map<const void*, uint64_t>::iterator, bool> found = _ids.insert(std::make_pair(identity, uint64_t(_ids.size())));
+	if ( !found.second )
+	{
+		const uint8_t tag = ptr_snapshot_reference;
+		write_bytes(&tag, sizeof(tag));
+		write_bytes(&found.first->second, sizeof(uint64_t));
+		return false;
+	}
+
+	const uint8_t tag = ptr_snapshot_object;
+	write_bytes(&tag, sizeof(tag));
+	return true;
+}
+
+template <typename T>
+inline void ptr_writer::write(const ptr<T>& p)
+{
+	if ( write_identity(p) )
+	{
+		write(*p);
+	}
+}
+
+template <typename X>
+inline void ptr_writer::write(const array_ptr<X>& a)
+{
+	// we need to know how much there is, and there's no way to say "some"
+	if ( a && !a.size() )
+	{
+		_failed = true;
+		return;
+	}
+
+	if ( write_identity(a) )
+	{
+		const uint64_t length = a.size();
+		write_bytes(&length, sizeof(length));
+
+		const X* elements = a.operator->();
+		if ( std::is_trivially_copyable<X>::value )
+		{
+			// all at once
+			write_bytes(elements, a.size() * sizeof(X));
+		}
+		else
+		{
+			for ( size_t i = 0; i < a.size(); ++i )
+			{
+				write(elements[i]);
+			}
+		}
+	}
+}
+
+inline bool ptr_writer::good() const
+{
+	return !_failed;
+}
+
+inline size_t ptr_writer::objects() const
+{
+	return _ids.size();
+}
+
+
+
+//
+// reading
+//
+inline ptr_reader::ptr_reader(std::istream& in) : _in(in), _buffer(ptr_snapshot_buffer_bytes), _begin(0), _end(0), _failed(false)
+{
+	// empty
+}
+
+inline ptr_reader::~ptr_reader()
+{
+	// hand back whatever we read ahead, when the stream lets us
+	if ( _end > _begin && _in.rdbuf() )
+	{
+		_in.rdbuf()->pubseekoff(-std::streamoff(_end - _begin), std::ios::cur, std::ios::in);
+	}
+
+	// let go of our references, whatever's left is the caller's now
+	for ( size_t i = 0; i < _objects.size(); ++i )
+	{
+		_objects[i].destroy(_objects[i].handle);
+	}
+}
+
+template <typename Handle>
+inline void ptr_reader::destroy_handle(void* handle)
+{
+	static_cast<Handle*>(handle)->~Handle();
+}
+
+template <typename T>
+inline void ptr_reader::raise_pointer(const void* handle)
+{
+	throw static_cast<const ptr<T>*>(handle)->operator->();
+}
+
+inline void ptr_reader::read_bytes(void* bytes, size_t length)
+{
+	char* out = static_cast<char*>(bytes);
+	while ( !_failed && length )
+	{
+		// whatever we already have
+		const size_t available = _end - _begin;
+		const size_t n         = available < length ? available : length;
+		if ( n )
+		{
+			memcpy(out, &_buffer[_begin], n);
+			_begin += n;
+			out    += n;
+			length -= n;
+			continue;
+		}
+
+		// anything big goes straight into place, anything else a buffer at a
+		// time (which may read past the end of the snapshot)
+		std::streambuf* buffer = _in.rdbuf();
+		if ( length >= _buffer.size() / 2 )
+		{
+			_failed = !buffer || buffer->sgetn(out, std::streamsize(length)) != std::streamsize(length);
+			length  = 0;
+		}
+		else
+		{
+			_begin  = 0;
+			_end    = buffer ? size_t(buffer->sgetn(&_buffer[0], std::streamsize(_buffer.size()))) : 0;
+			_failed = _end == 0;
+		}
+	}
+
+	if ( _failed )
+	{
+		_in.setstate(std::ios::failbit | std::ios::eofbit);
+	}
+}
+
+inline uint64_t ptr_reader::remaining()
+{
+	// what's read ahead, and whatever's after it if the stream can tell us
+	const uint64_t  ahead  = _end - _begin;
+	std::streambuf* buffer = _in.rdbuf();
+	if ( !buffer )
+	{
+		return ahead;
+	}
+
+	const std::streampos here = buffer->pubseekoff(0, std::ios::cur, std::ios::in);
+	const std::streampos end  = (here == std::streampos(-1)) ? here : buffer->pubseekoff(0, std::ios::end, std::ios::in);
+	if ( end == std::streampos(-1) )
+	{
+		return UINT64_MAX;
+	}
+
+	buffer->pubseekpos(here, std::ios::in);
+	return ahead + uint64_t(end - here);
+}
+
+template <typename T>
+inline void ptr_reader::read(T& value)
+{
+	ptr_restore(*this, value);
+}
+
+inline const ptr_reader::object* ptr_reader::read_identity(bool& fresh)
+{
+	fresh = false;
+
+	uint8_t tag = ptr_snapshot_null;
+	read_bytes(&tag, sizeof(tag));
+	if ( _failed )
+	{
+		return 0;
+	}
+
+	switch ( tag )
+	{
+		case ptr_snapshot_null:
+			return 0;
+
+		case ptr_snapshot_reference:
+		{
+			uint64_t id = 0;
+			read_bytes(&id, sizeof(id));
+			if ( _failed || id >= _objects.size() )
+			{
+				_failed = true;
+				return 0;
+			}
+			return &_objects[size_t(id)];
+		}
+
+		case ptr_snapshot_object:
+			fresh = true;
+			return 0;
+
+		default:
+			_failed = true;
+			return 0;
+	}
+}
+
+template <typename Handle>
+inline bool ptr_reader::read_reference(const object* seen, Handle& h)
+{
+	// written as one type, read back as another
+	if ( *seen->type != typeid(Handle) )
+	{
+		_failed = true;
+		return false;
+	}
+
+	h = *static_cast<const Handle*>(static_cast<const void*>(seen->handle));
+	return true;
+}
+
+template <typename T>
+inline bool ptr_reader::read_base(const object* seen, ptr<T>& p)
+{
+	// the same object, read back as one of its bases (the compiler knows
+	// where that is, and only a catch can ask it about a type we don't know)
+	if ( seen->raise )
+	{
+		try
+		{
+			seen->raise(seen->handle);
+		}
+		catch ( T* base )
+		{
+			p = ptr<T>(base, seen->counter);
+			return true;
+		}
+		catch ( ... )
+		{
+			// not one of them
+		}
+	}
+
+	_failed = true;
+	return false;
+}
+
+template <typename Handle>
+inline void ptr_reader::remember(const Handle& h)
+{
+	static_assert(sizeof(Handle) <= sizeof(object().handle) && ptr_relocatable<Handle>::value, "handles are kept in place");
+
+	// the handle lives in the entry itself, which the vector may move around
+	// bitwise as it grows (fine, see ptr_relocatable<>)
+	_objects.push_back(object());
+	object& seen = _objects.back();
+	new(seen.handle) Handle(h);
+	seen.type    = &typeid(Handle);
+	seen.counter = h.counter();
+	seen.destroy = &ptr_reader::destroy_handle<Handle>;
+	seen.raise   = 0;
+}
+
+template <typename T>
+inline void ptr_reader::read(ptr<T>& p)
+{
+	p = 0;
+
+	bool          fresh = false;
+	const object* seen  = read_identity(fresh);
+	if ( seen )
+	{
+		if ( *seen->type == typeid(ptr<T>) )
+		{
+			read_reference(seen, p);
+		}
+		else
+		{
+			read_base(seen, p);
+		}
+	}
+	else if ( fresh )
+	{
+		// registered before its fields are read, they may refer back to it
+		p = new T();
+		remember(p);
+		_objects.back().raise = &ptr_reader::raise_pointer<T>;
+		read(*p);
+	}
+
+	if ( _failed )
+	{
+		p = 0;
+	}
+}
+
+template <typename X>
+inline void ptr_reader::read(array_ptr<X>& a)
+{
+	a = 0;
+
+	bool          fresh = false;
+	const object* seen  = read_identity(fresh);
+	if ( seen )
+	{
+		read_reference(seen, a);
+	}
+	else if ( fresh )
+	{
+		// a corrupt length shouldn't become a huge allocation, a trivially
+		// copyable array's bytes have to be there to be read, anything else
+		// must at least fit in memory
+		uint64_t length = 0;
+		read_bytes(&length, sizeof(length));
+		if ( _failed || !length || length > SIZE_MAX / sizeof(X) || (std::is_trivially_copyable<X>::value && length * sizeof(X) > remaining()) )
+		{
+			_failed = true;
+			return;
+		}
+
+		// trivially copyable elements are left for the read to fill in,
+		// anything else is default constructed and restored one by one
+		const size_t n        = size_t(length);
+		X*           elements = std::is_trivially_copyable<X>::value ? new(std::nothrow) X[n] : new(std::nothrow) X[n]();
+		if ( !elements )
+		{
+			_failed = true;
+			return;
+		}
+		a = array_ptr<X>(elements, new ptr_counter(n, 0));
+		remember(a);
+
+		if ( std::is_trivially_copyable<X>::value )
+		{
+			read_bytes(elements, n * sizeof(X));
+		}
+		else
+		{
+			for ( size_t i = 0; i < n && !_failed; ++i )
+			{
+				read(elements[i]);
+			}
+		}
+	}
+
+	if ( _failed )
+	{
+		a = 0;
+	}
+}
+
+inline bool ptr_reader::good() const
+{
+	return !_failed;
+}
+
+inline size_t ptr_reader::objects() const
+{
+	return _objects.size();
+}
+
+
+
+#endif // __ptr_snapshot_inl__
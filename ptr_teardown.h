@@ -0,0 +1,159 @@
+#ifndef __ptr_teardown_h__
+#define __ptr_teardown_h__
+
+
+
+//
+//
+//
+// letting go of deep structures without recursing
+//
+//
+// When the last reference to the head of a ptr<>-linked list goes, its
+// destructor drops the next node's last reference, whose destructor drops
+// the one after that, and so on: a million node list is a million stack
+// frames deep by the time the tail is deleted, which is far more than a
+// thread's stack has room for.  teardown() takes the structure apart from a
+// worklist instead, one node at a time, so the stack never grows:
+//
+//   struct Node
+//   {
+//     int       value;
+//     ptr<Node> next;
+//   };
+//
+//   // say where the children are (found by argument dependent lookup)
+//   void ptr_detach(Node& n, ptr_teardown& t)
+//   {
+//     t.take(n.next);
+//   }
+//
+//   ptr<Node> head = ...;  // a million nodes long
+//   teardown(head);        // head is null now, and so is everything after it
+//
+// Whenever a handle on the worklist turns out to be its object's last
+// reference, the object's children are moved onto the worklist (take()
+// leaves the member null, without touching any counts) before the object is
+// deleted, so its destructor has nothing left to recurse into.  Objects
+// that are still referenced from elsewhere are only let go of, the same as
+// dropping the handle would, and immortal ones are left alone.  Types with no
+// ptr_detach() of their own have no children as far as teardown() is
+// concerned, and for an array_ptr<> of known size() each element's children
+// are detached.  A handle's only child is its object, so an array of handles
+// has every handle in it taken:
+//
+//   struct Branch
+//   {
+//     array_ptr< ptr<Branch> > children;  // from a sizing factory
+//   };
+//
+//   void ptr_detach(Branch& b, ptr_teardown& t)
+//   {
+//     t.take(b.children);                  // and from there, each child
+//   }
+//
+// Given a work_pool (see ptr_parallel.h), a big structure is first taken
+// apart breadth first on the calling thread until there are several
+// subtrees for each thread, and then the subtrees are torn down in parallel:
+//
+//   teardown(root, work_pool::shared());
+//
+// That only works if the subtrees don't share anything, since ordinary
+// ptr<>s aren't counted atomically: a tree is fine, a graph whose nodes are
+// reachable along more than one path needs ptr_synchronized counts (see
+// ptr.h), or to be torn down on one thread.  Chains (lists) have nothing to
+// split up, and are torn down on the calling thread regardless.  Objects are
+// deleted on whichever thread gets to them, so their destructors should be
+// happy to run anywhere.
+//
+// A ptr_teardown may also be used on its own, to collect several structures
+// and take them all down at once (anything still on it when it's destroyed
+// is torn down then).
+//
+//
+
+
+
+#include <cstddef>
+#include <vector>
+
+#include "ptr.h"
+
+
+
+class work_pool;
+
+class ptr_teardown
+{
+public:
+
+	ptr_teardown();
+	~ptr_teardown();
+
+	// move a handle onto the worklist, leaving it null
+	template <typename T, typename C, typename D, typename S>
+	void take(basic_ptr<T, C, D, S>& p);
+
+	// tear down everything on the worklist, on this thread
+	void run();
+
+	// the same, spread over a pool's threads once there's enough to go around
+	void run(work_pool& pool);
+
+	// handles waiting on the worklist
+	size_t size() const;
+
+private:
+
+	// not copyable
+	ptr_teardown(const ptr_teardown&);
+	ptr_teardown& operator=(const ptr_teardown&);
+
+	// a handle (of any basic_ptr<> type) along with what to do with it
+	struct entry
+	{
+		alignas(void*) char handle[2 * sizeof(void*)];
+		void                (*step)(entry& e, ptr_teardown& t);
+	};
+
+	// detach the object's children if this is the last reference, then let go
+	template <typename T, typename C, typename D, typename S>
+	static void step(entry& e, ptr_teardown& t);
+
+	// data
+	std::vector<entry> _items;
+
+};
+
+//
+// children are found by calling this (write your own for each type that has
+// any, see above)
+//
+template <typename T>
+void ptr_detach(T& object, ptr_teardown& t);
+
+//
+// a handle's child is what it points to, so an array of handles (say a node's
+// children, as an array_ptr< ptr<Node> >) has each of them taken
+//
+template <typename T, typename C, typename D, typename S>
+void ptr_detach(basic_ptr<T, C, D, S>& p, ptr_teardown& t);
+
+//
+// tear down everything reachable only through p, leaving p null
+//
+template <typename T, typename C, typename D, typename S>
+void teardown(basic_ptr<T, C, D, S>& p);
+
+template <typename T, typename C, typename D, typename S>
+void teardown(basic_ptr<T, C, D, S>& p, work_pool& pool);
+
+
+
+#define __ptr_teardown_inl_include__
+#include "ptr_teardown.inl"
+#undef __ptr_teardown_inl_include__
+
+
+
+#endif // __ptr_teardown_h__
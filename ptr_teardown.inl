@@ -0,0 +1,172 @@
+#if !defined(__ptr_teardown_inl_include__)
+#error "ptr_teardown.inl may only be included from ptr_teardown.h"
+#endif // !defined(__ptr_teardown_inl_include__)
+
+
+
+#ifndef __ptr_teardown_inl__
+#define __ptr_teardown_inl__
+
+
+
+#include <cstring>
+#include <deque>
+#include <new>
+#include <type_traits>
+
+#include "ptr_parallel.h"
+
+
+
+//
+// objects without a ptr_detach() of their own have no children
+//
+template <typename T>
+inline void ptr_detach(T&, ptr_teardown&)
+{
+	// empty
+}
+
+//
+// handles (in an array, or pointed to) have their objects taken
+//
+template <typename T, typename C, typename D, typename S>
+inline void ptr_detach(basic_ptr<T, C, D, S>& p, ptr_teardown& t)
+{
+	t.take(p);
+}
+
+
+
+//
+// the worklist
+//
+inline ptr_teardown::ptr_teardown()
+{
+	// empty
+}
+
+inline ptr_teardown::~ptr_teardown()
+{
+	run();
+}
+
+template <typename T, typename C, typename D, typename S>
+inline void ptr_teardown::take(basic_ptr<T, C, D, S>& p)
+{
+	typedef basic_ptr<T, C, D, S> handle;
+	static_assert(sizeof(handle) <= sizeof(entry().handle), "a handle has to fit in an entry");
+
+	if ( !p.counter() )
+	{
+		// nothing there, nothing to do
+		return;
+	}
+
+	// the handle's bytes move onto the list, and what's left behind is null
+	entry e;
+	memcpy(static_cast<void*>(e.handle), static_cast<const void*>(&p), sizeof(handle));
+	e.step = &ptr_teardown::step<T, C, D, S>;
+	new (&p) handle();
+	_items.push_back(e);
+}
+
+template <typename T, typename C, typename D, typename S>
+inline void ptr_teardown::step(entry& e, ptr_teardown& t)
+{
+	typedef basic_ptr<T, C, D, S> handle;
+	handle& h = *reinterpret_cast<handle*>(e.handle);
+
+	// only the last reference gets to take the object apart, nobody else can
+	// be making copies of it then
+	ptr_counter* counter = h.counter();
+	if ( ptr_counted(counter) && C::count(counter) == 1 )
+	{
+		if ( std::is_same<D, ptr_delete_array>::value )
+		{
+			for ( size_t i = 0; i < h.size(); ++i )
+			{
+				ptr_detach(h[i], t);
+			}
+		}
+		else
+		{
+			ptr_detach(*h, t);
+		}
+	}
+	h.~handle();
+}
+
+inline void ptr_teardown::run()
+{
+	// last in first out, so the list only grows as long as the widest part
+	// of the structure it's working on
+	while ( !_items.empty() )
+	{
+		entry e = _items.back();
+		_items.pop_back();
+		e.step(e, *this);
+	}
+}
+
+inline void ptr_teardown::run(work_pool& pool)
+{
+	if ( !pool.threads() )
+	{
+		run();
+		return;
+	}
+
+	// breadth first until there are a few subtrees for every thread (or
+	// nothing left, if it was a chain all along)
+	const size_t      wanted = 8 * (size_t(pool.threads()) + 1);
+	std::deque<entry> frontier(_items.begin(), _items.end());
+	_items.clear();
+	while ( !frontier.empty() && frontier.size() < wanted )
+	{
+		entry e = frontier.front();
+		frontier.pop_front();
+		e.step(e, *this);
+		frontier.insert(frontier.end(), _items.begin(), _items.end());
+		_items.clear();
+	}
+
+	// each subtree on a worklist of its own
+	const std::vector<entry> subtrees(frontier.begin(), frontier.end());
+	pool.run(subtrees.size(), [&](size_t i)
+	{
+		ptr_teardown t;
+		t._items.push_back(subtrees[i]);
+		t.run();
+	});
+}
+
+inline size_t ptr_teardown::size() const
+{
+	return _items.size();
+}
+
+
+
+//
+// the shorthand
+//
+template <typename T, typename C, typename D, typename S>
+inline void teardown(basic_ptr<T, C, D, S>& p)
+{
+	ptr_teardown t;
+	t.take(p);
+	t.run();
+}
+
+template <typename T, typename C, typename D, typename S>
+inline void teardown(basic_ptr<T, C, D, S>& p, work_pool& pool)
+{
+	ptr_teardown t;
+	t.take(p);
+	t.run(pool);
+}
+
+
+
+#endif // __ptr_teardown_inl__
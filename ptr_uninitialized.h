@@ -0,0 +1,63 @@
+#ifndef __ptr_uninitialized_h__
+#define __ptr_uninitialized_h__
+
+
+
+//
+//
+//
+// uninitialized and lazily zeroed array_ptr<> allocation
+//
+//
+// A buffer that's about to be overwritten by a read() or a decoder doesn't
+// need to be zeroed first -- that's a whole extra pass over memory, and on a
+// big buffer the pass costs as much as the useful work.
+//
+// make_uninitialized_array<>() hands out sized storage for trivial types
+// without touching it at all:
+//
+//   array_ptr<double> a = make_uninitialized_array<double>(n);
+//   fread(&a[0], sizeof(double), a.size(), f); // the only write
+//
+// make_zeroed_array<>() is for when you really do want zeroes, but maybe not
+// all of them: large sizes come straight from mmap(), whose pages the kernel
+// zeroes as they're first touched, so untouched parts cost nothing at all
+// (small sizes use calloc()):
+//
+//   array_ptr<unsigned> counts = make_zeroed_array<unsigned>(1 << 28);
+//
+// Both only accept trivial types (no constructors or destructors are run),
+// the array_ptr<> knows its size(), and the storage is freed on the last
+// release.  If the allocation fails you get an invalid array_ptr<>.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+//
+// n elements with indeterminate values
+//
+template <typename X>
+array_ptr<X> make_uninitialized_array(size_t n);
+
+//
+// n zeroed elements, large sizes zeroed lazily by the kernel
+//
+template <typename X>
+array_ptr<X> make_zeroed_array(size_t n);
+
+
+
+#define __ptr_uninitialized_inl_include__
+#include "ptr_uninitialized.inl"
+#undef __ptr_uninitialized_inl_include__
+
+
+
+#endif // __ptr_uninitialized_h__
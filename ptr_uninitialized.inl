@@ -0,0 +1,103 @@
+#if !defined(__ptr_uninitialized_inl_include__)
+#error "ptr_uninitialized.inl may only be included from ptr_uninitialized.h"
+#endif // !defined(__ptr_uninitialized_inl_include__)
+
+
+
+#ifndef __ptr_uninitialized_inl__
+#define __ptr_uninitialized_inl__
+
+
+
+#include <cstdlib>
+#include <type_traits>
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+
+
+//
+// zeroed buffers at least this big are mapped directly, so we know they're
+// lazily zeroed (malloc()'s own threshold moves around at runtime)
+//
+enum { ptr_zeroed_map_threshold = 1 << 20 };
+
+
+
+//
+// releasing storage
+//
+inline void ptr_uninitialized_release(void* normal_ptr, ptr_counter* counter)
+{
+	free(normal_ptr);
+	delete counter;
+}
+
+template <typename X>
+inline void ptr_zeroed_release(void* normal_ptr, ptr_counter* counter)
+{
+	const size_t bytes = counter->_length * sizeof(X);
+	if ( bytes >= ptr_zeroed_map_threshold )
+	{
+		munmap(normal_ptr, bytes);
+	}
+	else
+	{
+		free(normal_ptr);
+	}
+	delete counter;
+}
+
+
+
+//
+// the factories
+//
+template <typename X>
+inline array_ptr<X> make_uninitialized_array(size_t n)
+{
+	static_assert(std::is_trivial<X>::value, "make_uninitialized_array<X>() needs a trivial X");
+
+	// (more elements than there are bytes to address can't be had)
+	X* p = (n && n <= SIZE_MAX / sizeof(X)) ? static_cast<X*>(malloc(n * sizeof(X))) : 0;
+	if ( !p )
+	{
+		return array_ptr<X>();
+	}
+
+	return array_ptr<X>(p, new ptr_counter(n, ptr_uninitialized_release));
+}
+
+template <typename X>
+inline array_ptr<X> make_zeroed_array(size_t n)
+{
+	static_assert(std::is_trivial<X>::value, "make_zeroed_array<X>() needs a trivial X");
+
+	// (checked here, since the mapped path would wrap where calloc() wouldn't)
+	if ( !n || n > SIZE_MAX / sizeof(X) )
+	{
+		return array_ptr<X>();
+	}
+
+	X* p = 0;
+	if ( n * sizeof(X) >= ptr_zeroed_map_threshold )
+	{
+		void* mem = mmap(0, n * sizeof(X), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		p = mem != MAP_FAILED ? static_cast<X*>(mem) : 0;
+	}
+	else
+	{
+		p = static_cast<X*>(calloc(n, sizeof(X)));
+	}
+	if ( !p )
+	{
+		return array_ptr<X>();
+	}
+
+	return array_ptr<X>(p, new ptr_counter(n, ptr_zeroed_release<X>));
+}
+
+
+
+#endif // __ptr_uninitialized_inl__
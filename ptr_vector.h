@@ -0,0 +1,115 @@
+#ifndef __ptr_vector_h__
+#define __ptr_vector_h__
+
+
+
+//
+//
+//
+// ptr_vector<> - a growable array that knows how to move ptr<>s around
+//
+//
+// Growing a std::vector< ptr<T> > copies every element into the new storage
+// and then destroys the old one.  For a ptr<> that means a grab() and a
+// drop() per element, i.e. two trips out to every reference counter in the
+// container, just to end up with exactly the same counts we started with.
+//
+// ptr_vector<> is a small std::vector look-alike that relocates its elements
+// with memcpy() whenever ptr_relocatable<T>::value says it's safe (which it
+// is for ptr<> and array_ptr<>), so growing it never touches a counter:
+//
+//   ptr_vector< ptr<SomeClass> > v;
+//   for ( int i = 0; i < 1000000; ++i )
+//   {
+//     v.push_back(new SomeClass); // reallocations are plain memcpy()s
+//   }
+//
+// Any other element type still works, it just gets the usual
+// copy-then-destroy treatment.
+//
+// The relocation itself is available on its own as ptr_relocate(), in case
+// you're managing raw storage yourself.
+//
+//
+
+
+
+#include <cstddef>
+
+#include "ptr.h"
+
+
+
+//
+// move n objects from src to (uninitialized) dest, leaving src as raw storage
+// (if a copy throws, dest is left as raw storage and src as it was)
+//
+template <typename T>
+void ptr_relocate(T* dest, T* src, size_t n);
+
+
+
+template <typename T>
+class ptr_vector
+{
+public:
+
+	// default constructor
+	ptr_vector();
+
+	// copying construction and assignment
+	ptr_vector(const ptr_vector<T>& other);
+	ptr_vector& operator=(const ptr_vector<T>& other);
+
+	// destruction
+	~ptr_vector();
+
+	// add and remove elements
+	void push_back(const T& value);
+	void pop_back();
+	void clear();
+
+	// grow storage so that at least n elements fit without reallocating
+	void reserve(size_t n);
+
+	// access elements
+	T& operator[](size_t i);
+	const T& operator[](size_t i) const;
+	T& back();
+	const T& back() const;
+
+	// iteration
+	T* begin();
+	T* end();
+	const T* begin() const;
+	const T* end() const;
+
+	// size queries
+	size_t size() const;
+	size_t capacity() const;
+	bool empty() const;
+
+	// exchange contents with another vector
+	void swap(ptr_vector<T>& other);
+
+private:
+
+	// move our elements into a new block of storage of the given capacity
+	void reallocate(size_t capacity);
+
+	// data
+	T*     _data;
+	size_t _size;
+	size_t _capacity;
+
+};
+
+
+
+#define __ptr_vector_inl_include__
+#include "ptr_vector.inl"
+#undef __ptr_vector_inl_include__
+
+
+
+#endif // __ptr_vector_h__
@@ -0,0 +1,336 @@
+#if !defined(__ptr_vector_inl_include__)
+#error "ptr_vector.inl may only be included from ptr_vector.h"
+#endif // !defined(__ptr_vector_inl_include__)
+
+
+
+#ifndef __ptr_vector_inl__
+#define __ptr_vector_inl__
+
+
+
+#include <cassert>
+#include <cstring>
+#include <new>
+
+
+
+//
+// relocation
+//
+template <typename T>
+inline void ptr_relocate(T* dest, T* src, size_t n)
+{
+	if ( !n )
+	{
+		// nothing to move (and src may well be null)
+		return;
+	}
+
+	if ( ptr_relocatable<T>::value )
+	{
+		// bitwise move, the old copies simply cease to exist
+		memcpy(static_cast<void*>(dest), static_cast<const void*>(src), n * sizeof(T));
+	}
+	else
+	{
+		// the long way around, copy them all and only then destroy the
+		// originals, so if a copy throws the copies made so far are undone and
+		// src is left just as it was
+		size_t i = 0;
+		try
+		{
+			for ( ; i < n; ++i )
+			{
+				new (dest + i) T(src[i]);
+			}
+		}
+		catch ( ... )
+		{
+			while ( i > 0 )
+			{
+				dest[--i].~T();
+			}
+			throw;
+		}
+		for ( i = 0; i < n; ++i )
+		{
+			src[i].~T();
+		}
+	}
+}
+
+
+
+//
+// default construction
+//
+template <typename T>
+inline ptr_vector<T>::ptr_vector() : _data(0), _size(0), _capacity(0)
+{
+	// empty
+}
+
+
+
+//
+// copying
+//
+template <typename T>
+inline ptr_vector<T>::ptr_vector(const ptr_vector<T>& other) : _data(0), _size(0), _capacity(0)
+{
+	// defer to copy assignment operator (our destructor won't run if that
+	// throws, so whatever it got through is let go of here)
+	try
+	{
+		*this = other;
+	}
+	catch ( ... )
+	{
+		clear();
+		::operator delete(_data);
+		throw;
+	}
+}
+
+template <typename T>
+inline ptr_vector<T>& ptr_vector<T>::operator=(const ptr_vector<T>& other)
+{
+	// make certain it's not trying to copy assign itself to itself
+	if ( this != &other )
+	{
+		clear();
+		reserve(other._size);
+
+		// counted one at a time, so if a copy throws, the ones already made
+		// are ours to destroy
+		for ( size_t i = 0; i < other._size; ++i )
+		{
+			new (_data + i) T(other._data[i]);
+			_size++;
+		}
+	}
+
+	// send back a reference to this object
+	return *this;
+}
+
+
+
+//
+// destructor
+//
+template <typename T>
+inline ptr_vector<T>::~ptr_vector()
+{
+	clear();
+	::operator delete(_data);
+}
+
+
+
+//
+// add and remove elements
+//
+template <typename T>
+inline void ptr_vector<T>::push_back(const T& value)
+{
+	if ( _size < _capacity )
+	{
+		new (_data + _size) T(value);
+	}
+	else
+	{
+		// value may live in our own storage, so construct the new element
+		// before relocating (and releasing) the old ones
+		size_t capacity = _capacity ? _capacity * 2 : 4;
+		T*     data     = static_cast<T*>(::operator new(capacity * sizeof(T)));
+		try
+		{
+			new (data + _size) T(value);
+		}
+		catch ( ... )
+		{
+			// nothing's changed yet, bar the new storage
+			::operator delete(data);
+			throw;
+		}
+		try
+		{
+			ptr_relocate(data, _data, _size);
+		}
+		catch ( ... )
+		{
+			// the old elements are untouched, only the new one has to go
+			data[_size].~T();
+			::operator delete(data);
+			throw;
+		}
+		::operator delete(_data);
+
+		_data     = data;
+		_capacity = capacity;
+	}
+	_size++;
+}
+
+template <typename T>
+inline void ptr_vector<T>::pop_back()
+{
+	assert(_size);
+	_data[--_size].~T();
+}
+
+template <typename T>
+inline void ptr_vector<T>::clear()
+{
+	while ( _size )
+	{
+		pop_back();
+	}
+}
+
+
+
+//
+// storage
+//
+template <typename T>
+inline void ptr_vector<T>::reserve(size_t n)
+{
+	if ( n > _capacity )
+	{
+		reallocate(n);
+	}
+}
+
+template <typename T>
+inline void ptr_vector<T>::reallocate(size_t capacity)
+{
+	assert(capacity >= _size);
+
+	T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+	try
+	{
+		ptr_relocate(data, _data, _size);
+	}
+	catch ( ... )
+	{
+		::operator delete(data);
+		throw;
+	}
+	::operator delete(_data);
+
+	_data     = data;
+	_capacity = capacity;
+}
+
+
+
+//
+// access elements
+//
+template <typename T>
+inline T& ptr_vector<T>::operator[](size_t i)
+{
+	assert(i < _size);
+	return _data[i];
+}
+
+template <typename T>
+inline const T& ptr_vector<T>::operator[](size_t i) const
+{
+	assert(i < _size);
+	return _data[i];
+}
+
+template <typename T>
+inline T& ptr_vector<T>::back()
+{
+	assert(_size);
+	return _data[_size - 1];
+}
+
+template <typename T>
+inline const T& ptr_vector<T>::back() const
+{
+	assert(_size);
+	return _data[_size - 1];
+}
+
+
+
+//
+// iteration
+//
+template <typename T>
+inline T* ptr_vector<T>::begin()
+{
+	return _data;
+}
+
+template <typename T>
+inline T* ptr_vector<T>::end()
+{
+	return _data + _size;
+}
+
+template <typename T>
+inline const T* ptr_vector<T>::begin() const
+{
+	return _data;
+}
+
+template <typename T>
+inline const T* ptr_vector<T>::end() const
+{
+	return _data + _size;
+}
+
+
+
+//
+// size queries
+//
+template <typename T>
+inline size_t ptr_vector<T>::size() const
+{
+	return _size;
+}
+
+template <typename T>
+inline size_t ptr_vector<T>::capacity() const
+{
+	return _capacity;
+}
+
+template <typename T>
+inline bool ptr_vector<T>::empty() const
+{
+	return _size == 0;
+}
+
+
+
+//
+// exchange contents with another vector
+//
+template <typename T>
+inline void ptr_vector<T>::swap(ptr_vector<T>& other)
+{
+	T*     data     = _data;
+	size_t size     = _size;
+	size_t capacity = _capacity;
+
+	_data     = other._data;
+	_size     = other._size;
+	_capacity = other._capacity;
+
+	other._data     = data;
+	other._size     = size;
+	other._capacity = capacity;
+}
+
+
+
+#endif // __ptr_vector_inl__